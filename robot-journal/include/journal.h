@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Append-only command journal in a dedicated flash partition.
+//
+// Records are collected in RAM and written by a background task, so
+// journal_append() never waits for flash. Sectors are used as a ring in
+// increasing sequence order, which spreads erases evenly across the
+// partition. Each record carries a CRC; a record torn by a reset is
+// ignored on replay.
+//
+// Typical use: call journal_begin_session() when a new sequence or program
+// is accepted, journal_append() each accepted command (or the program id),
+// and journal_checkpoint() as the executor completes steps. After a reset,
+// journal_replay_last_session() yields those records in order so the
+// caller can skip to the last checkpoint and resume.
+
+typedef enum {
+  JOURNAL_RECORD_SESSION = 1,    // start of a new command session
+  JOURNAL_RECORD_COMMAND = 2,    // accepted command JSON
+  JOURNAL_RECORD_PROGRAM = 3,    // stored-program id (string)
+  JOURNAL_RECORD_CHECKPOINT = 4, // journal_checkpoint_t
+} journal_record_type_t;
+
+// Execution progress, written whenever the executor completes a step.
+typedef struct {
+  uint32_t command_index; // index of the command within the session
+  uint32_t step_index;    // completed steps within that command
+} journal_checkpoint_t;
+
+typedef struct {
+  uint32_t records_appended;
+  uint32_t records_dropped; // staging buffer full or record too large
+  uint32_t bytes_appended;  // payload bytes passed to journal_append()
+  uint32_t bytes_written;   // bytes written to flash incl. headers/padding
+  uint32_t sectors_erased;
+  uint32_t flushes;
+} journal_stats_t;
+
+// Called for each record during replay. Return false to stop.
+typedef bool (*journal_replay_cb_t)(journal_record_type_t type,
+                                    const void *data,
+                                    size_t len,
+                                    void *ctx);
+
+// Mount the journal partition and start the writer task.
+esp_err_t journal_init(void);
+
+// Queue a record for writing. Returns ESP_ERR_NO_MEM if the staging buffer
+// is full, and ESP_ERR_INVALID_SIZE if len exceeds the largest payload (see
+// CONFIG_ROBOT_JOURNAL_STAGING_SIZE); the record is then dropped.
+esp_err_t journal_append(journal_record_type_t type,
+                         const void *data,
+                         size_t len);
+
+// Convenience wrappers around journal_append().
+esp_err_t journal_begin_session(void);
+esp_err_t journal_checkpoint(uint32_t command_index, uint32_t step_index);
+
+// Write any staged records now and wait until they are on flash.
+void journal_flush(void);
+
+// Replay every record written since the last JOURNAL_RECORD_SESSION, in
+// order. Intended for use at boot, before new records are appended.
+// Returns ESP_ERR_NOT_FOUND without calling cb if no session marker is left,
+// either because nothing was journaled or because the ring has wrapped over
+// the start of the last session; that session cannot be resumed.
+esp_err_t journal_replay_last_session(journal_replay_cb_t cb, void *ctx);
+
+// Bytes written to flash (including erases) per payload byte appended.
+// Returns 0 before anything was appended.
+float journal_write_amplification(const journal_stats_t *stats);
+
+void journal_get_stats(journal_stats_t *stats);
@@ -0,0 +1,481 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include "../include/journal.h"
+
+static const char *TAG = "journal";
+
+#define JOURNAL_SECTOR_SIZE   4096u
+#define JOURNAL_SECTOR_MAGIC  0x4C4E524Au // "JRNL"
+#define JOURNAL_RECORD_MAGIC  0x524Au     // "JR"
+#define JOURNAL_ERASED_U16    0xFFFFu
+#define JOURNAL_ERASED_U32    0xFFFFFFFFu
+#define JOURNAL_MAX_SECTORS   64u
+
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;
+} sector_header_t;
+
+typedef struct {
+  uint16_t magic;
+  uint8_t type;
+  uint8_t reserved;
+  uint16_t len;
+  uint16_t reserved2;
+  uint32_t crc;
+} record_header_t;
+
+#define JOURNAL_ALIGN4(x) (((x) + 3u) & ~3u)
+// A record must fit both a staging buffer and an empty sector; otherwise
+// write_records() would keep opening new sectors for it.
+#define JOURNAL_STAGING_PAYLOAD \
+  (CONFIG_ROBOT_JOURNAL_STAGING_SIZE - sizeof(record_header_t))
+#define JOURNAL_SECTOR_PAYLOAD \
+  (JOURNAL_SECTOR_SIZE - sizeof(sector_header_t) - sizeof(record_header_t))
+#define JOURNAL_MAX_PAYLOAD                                   \
+  (JOURNAL_STAGING_PAYLOAD < JOURNAL_SECTOR_PAYLOAD ? JOURNAL_STAGING_PAYLOAD \
+                                                    : JOURNAL_SECTOR_PAYLOAD)
+
+static const esp_partition_t *s_partition = NULL;
+static uint32_t s_sector_count = 0u;
+static uint32_t s_sector = 0u;     // sector currently appended to
+static uint32_t s_sector_seq = 0u; // its sequence number
+static uint32_t s_offset = 0u;     // write offset within that sector
+
+// Double-buffered staging: appends fill s_stage[s_active] while the writer
+// drains the other buffer.
+static uint8_t s_stage[2][CONFIG_ROBOT_JOURNAL_STAGING_SIZE];
+static size_t s_stage_len[2];
+static int s_active = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static SemaphoreHandle_t s_flash_mutex = NULL;
+static TaskHandle_t s_writer_task = NULL;
+static journal_stats_t s_stats;
+
+static uint32_t record_crc(const record_header_t *header, const void *data)
+{
+  record_header_t copy = *header;
+  copy.crc = 0u;
+  uint32_t crc = esp_rom_crc32_le(0u, (const uint8_t *)&copy, sizeof(copy));
+  return esp_rom_crc32_le(crc, data, header->len);
+}
+
+static size_t sector_base(uint32_t sector)
+{
+  return (size_t)sector * JOURNAL_SECTOR_SIZE;
+}
+
+static esp_err_t open_sector(uint32_t sector, uint32_t seq)
+{
+  esp_err_t err = esp_partition_erase_range(s_partition, sector_base(sector),
+                                            JOURNAL_SECTOR_SIZE);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to erase sector %u: %s", (unsigned)sector,
+             esp_err_to_name(err));
+    return err;
+  }
+  s_stats.sectors_erased++;
+
+  const sector_header_t header = {
+      .magic = JOURNAL_SECTOR_MAGIC,
+      .seq = seq,
+  };
+  err = esp_partition_write(s_partition, sector_base(sector), &header,
+                            sizeof(header));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write sector header: %s", esp_err_to_name(err));
+    return err;
+  }
+  s_stats.bytes_written += sizeof(header);
+
+  s_sector = sector;
+  s_sector_seq = seq;
+  s_offset = sizeof(header);
+  return ESP_OK;
+}
+
+static esp_err_t advance_sector(void)
+{
+  return open_sector((s_sector + 1u) % s_sector_count, s_sector_seq + 1u);
+}
+
+// Read and validate the record at offset. On success fills header and,
+// if payload is non-NULL, the payload. Returns false at the end of the
+// written area or on a torn/corrupt record.
+static bool read_record(uint32_t sector,
+                        uint32_t offset,
+                        record_header_t *header,
+                        uint8_t *payload)
+{
+  if (offset + sizeof(*header) > JOURNAL_SECTOR_SIZE) {
+    return false;
+  }
+  if (esp_partition_read(s_partition, sector_base(sector) + offset, header,
+                         sizeof(*header)) != ESP_OK) {
+    return false;
+  }
+  if (header->magic != JOURNAL_RECORD_MAGIC ||
+      header->len > JOURNAL_MAX_PAYLOAD ||
+      offset + sizeof(*header) + header->len > JOURNAL_SECTOR_SIZE) {
+    return false;
+  }
+  if (payload == NULL) {
+    return true;
+  }
+  if (esp_partition_read(s_partition,
+                         sector_base(sector) + offset + sizeof(*header),
+                         payload, header->len) != ESP_OK) {
+    return false;
+  }
+  return record_crc(header, payload) == header->crc;
+}
+
+static size_t record_size(const record_header_t *header)
+{
+  return JOURNAL_ALIGN4(sizeof(*header) + header->len);
+}
+
+// Collect valid sectors ordered by sequence number (oldest first).
+static uint32_t ordered_sectors(uint32_t *order)
+{
+  uint32_t seqs[JOURNAL_MAX_SECTORS];
+  uint32_t count = 0u;
+
+  for (uint32_t i = 0u; i < s_sector_count; ++i) {
+    sector_header_t header;
+    if (esp_partition_read(s_partition, sector_base(i), &header,
+                           sizeof(header)) != ESP_OK ||
+        header.magic != JOURNAL_SECTOR_MAGIC) {
+      continue;
+    }
+    uint32_t j = count;
+    while (j > 0u && seqs[j - 1u] > header.seq) {
+      seqs[j] = seqs[j - 1u];
+      order[j] = order[j - 1u];
+      --j;
+    }
+    seqs[j] = header.seq;
+    order[j] = i;
+    count++;
+  }
+  return count;
+}
+
+static esp_err_t mount(void)
+{
+  uint32_t order[JOURNAL_MAX_SECTORS];
+  uint32_t count = ordered_sectors(order);
+  if (count == 0u) {
+    ESP_LOGI(TAG, "Formatting journal partition");
+    return open_sector(0u, 1u);
+  }
+
+  uint32_t sector = order[count - 1u];
+  sector_header_t header;
+  (void)esp_partition_read(s_partition, sector_base(sector), &header,
+                           sizeof(header));
+  s_sector = sector;
+  s_sector_seq = header.seq;
+  s_offset = sizeof(header);
+
+  uint8_t *payload = malloc(JOURNAL_MAX_PAYLOAD);
+  if (payload == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  record_header_t record;
+  while (read_record(s_sector, s_offset, &record, payload)) {
+    s_offset += record_size(&record);
+  }
+
+  // Anything other than erased flash after the last good record is a torn
+  // write; continue in a fresh sector rather than writing after it.
+  bool clean = true;
+  if (s_offset + sizeof(record) <= JOURNAL_SECTOR_SIZE) {
+    if (esp_partition_read(s_partition, sector_base(s_sector) + s_offset,
+                           &record, sizeof(record)) != ESP_OK ||
+        record.magic != JOURNAL_ERASED_U16) {
+      clean = false;
+    }
+  }
+  free(payload);
+
+  ESP_LOGI(TAG, "Mounted journal: sector=%u seq=%u offset=%u%s",
+           (unsigned)s_sector, (unsigned)s_sector_seq, (unsigned)s_offset,
+           clean ? "" : " (torn tail)");
+  return clean ? ESP_OK : advance_sector();
+}
+
+// Write serialized records to flash. Must hold s_flash_mutex.
+static void write_records(const uint8_t *data, size_t len)
+{
+  size_t pos = 0u;
+  while (pos < len) {
+    // Group as many whole records as fit in the current sector.
+    size_t run = 0u;
+    while (pos + run < len) {
+      const record_header_t *header =
+          (const record_header_t *)(data + pos + run);
+      size_t size = record_size(header);
+      if (s_offset + run + size > JOURNAL_SECTOR_SIZE) {
+        break;
+      }
+      run += size;
+    }
+
+    if (run == 0u) {
+      if (advance_sector() != ESP_OK) {
+        return;
+      }
+      continue;
+    }
+
+    esp_err_t err = esp_partition_write(
+        s_partition, sector_base(s_sector) + s_offset, data + pos, run);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Journal write failed: %s", esp_err_to_name(err));
+      return;
+    }
+    s_offset += run;
+    s_stats.bytes_written += run;
+    pos += run;
+  }
+  s_stats.flushes++;
+}
+
+static void flush_staged(void)
+{
+  xSemaphoreTake(s_flash_mutex, portMAX_DELAY);
+
+  portENTER_CRITICAL(&s_lock);
+  int index = s_active;
+  size_t len = s_stage_len[index];
+  if (len != 0u) {
+    s_active ^= 1;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (len != 0u) {
+    write_records(s_stage[index], len);
+    s_stage_len[index] = 0u;
+  }
+
+  xSemaphoreGive(s_flash_mutex);
+}
+
+static void journal_writer_task(void *arg)
+{
+  for (;;) {
+    (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_ROBOT_JOURNAL_FLUSH_MS));
+    flush_staged();
+  }
+}
+
+esp_err_t journal_init(void)
+{
+  s_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         ESP_PARTITION_SUBTYPE_ANY,
+                                         CONFIG_ROBOT_JOURNAL_PARTITION_LABEL);
+  if (s_partition == NULL) {
+    ESP_LOGE(TAG, "Journal partition '%s' not found",
+             CONFIG_ROBOT_JOURNAL_PARTITION_LABEL);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  s_sector_count = s_partition->size / JOURNAL_SECTOR_SIZE;
+  if (s_sector_count > JOURNAL_MAX_SECTORS) {
+    s_sector_count = JOURNAL_MAX_SECTORS;
+  }
+  if (s_sector_count < 2u) {
+    ESP_LOGE(TAG, "Journal partition too small (%u bytes)",
+             (unsigned)s_partition->size);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  s_flash_mutex = xSemaphoreCreateMutex();
+  if (s_flash_mutex == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t err = mount();
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  if (xTaskCreate(journal_writer_task, "journal",
+                  CONFIG_ROBOT_JOURNAL_TASK_STACK_SIZE, NULL,
+                  CONFIG_ROBOT_JOURNAL_TASK_PRIORITY,
+                  &s_writer_task) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create journal writer task");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t journal_append(journal_record_type_t type,
+                         const void *data,
+                         size_t len)
+{
+  if (s_writer_task == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (len > JOURNAL_MAX_PAYLOAD || (len > 0u && data == NULL)) {
+    portENTER_CRITICAL(&s_lock);
+    s_stats.records_dropped++;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  record_header_t header = {
+      .magic = JOURNAL_RECORD_MAGIC,
+      .type = (uint8_t)type,
+      .reserved = 0xFFu,
+      .len = (uint16_t)len,
+      .reserved2 = JOURNAL_ERASED_U16,
+  };
+  header.crc = record_crc(&header, data);
+  size_t size = JOURNAL_ALIGN4(sizeof(header) + len);
+
+  bool wake = false;
+  portENTER_CRITICAL(&s_lock);
+  uint8_t *stage = s_stage[s_active];
+  size_t used = s_stage_len[s_active];
+  if (used + size > CONFIG_ROBOT_JOURNAL_STAGING_SIZE) {
+    s_stats.records_dropped++;
+    portEXIT_CRITICAL(&s_lock);
+    xTaskNotifyGive(s_writer_task);
+    return ESP_ERR_NO_MEM;
+  }
+  memcpy(stage + used, &header, sizeof(header));
+  if (len > 0u) {
+    memcpy(stage + used + sizeof(header), data, len);
+  }
+  // Pad with erased-flash bytes so padding does not add bit flips.
+  memset(stage + used + sizeof(header) + len, 0xFF,
+         size - sizeof(header) - len);
+  s_stage_len[s_active] = used + size;
+  s_stats.records_appended++;
+  s_stats.bytes_appended += len;
+  wake = (used + size) >= CONFIG_ROBOT_JOURNAL_STAGING_SIZE / 2u;
+  portEXIT_CRITICAL(&s_lock);
+
+  if (wake) {
+    xTaskNotifyGive(s_writer_task);
+  }
+  return ESP_OK;
+}
+
+esp_err_t journal_begin_session(void)
+{
+  return journal_append(JOURNAL_RECORD_SESSION, NULL, 0u);
+}
+
+esp_err_t journal_checkpoint(uint32_t command_index, uint32_t step_index)
+{
+  const journal_checkpoint_t checkpoint = {
+      .command_index = command_index,
+      .step_index = step_index,
+  };
+  return journal_append(JOURNAL_RECORD_CHECKPOINT, &checkpoint,
+                        sizeof(checkpoint));
+}
+
+void journal_flush(void)
+{
+  if (s_flash_mutex == NULL) {
+    return;
+  }
+  flush_staged();
+}
+
+esp_err_t journal_replay_last_session(journal_replay_cb_t cb, void *ctx)
+{
+  if (s_partition == NULL || s_flash_mutex == NULL || cb == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  uint8_t *payload = malloc(JOURNAL_MAX_PAYLOAD);
+  if (payload == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  xSemaphoreTake(s_flash_mutex, portMAX_DELAY);
+
+  uint32_t order[JOURNAL_MAX_SECTORS];
+  uint32_t count = ordered_sectors(order);
+
+  // First pass: locate the last session marker.
+  bool found = false;
+  uint32_t start_index = 0u;
+  uint32_t start_offset = sizeof(sector_header_t);
+  record_header_t header;
+  for (uint32_t i = 0u; i < count; ++i) {
+    uint32_t offset = sizeof(sector_header_t);
+    while (read_record(order[i], offset, &header, NULL)) {
+      if (header.type == JOURNAL_RECORD_SESSION) {
+        found = true;
+        start_index = i;
+        start_offset = offset;
+      }
+      offset += record_size(&header);
+    }
+  }
+
+  // Without a marker the session's head has been erased by the ring wrap
+  // (or nothing was journaled); its checkpoints would no longer line up
+  // with the commands still on flash.
+  if (!found) {
+    xSemaphoreGive(s_flash_mutex);
+    free(payload);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  // Second pass: validate and deliver everything after it.
+  bool keep_going = true;
+  for (uint32_t i = start_index; i < count && keep_going; ++i) {
+    uint32_t offset =
+        (i == start_index) ? start_offset : sizeof(sector_header_t);
+    while (keep_going && read_record(order[i], offset, &header, payload)) {
+      if (header.type != JOURNAL_RECORD_SESSION) {
+        keep_going = cb((journal_record_type_t)header.type, payload,
+                        header.len, ctx);
+      }
+      offset += record_size(&header);
+    }
+  }
+
+  xSemaphoreGive(s_flash_mutex);
+  free(payload);
+  return ESP_OK;
+}
+
+float journal_write_amplification(const journal_stats_t *stats)
+{
+  if (stats == NULL || stats->bytes_appended == 0u) {
+    return 0.0f;
+  }
+  float flash_bytes = (float)stats->bytes_written +
+                      (float)stats->sectors_erased * JOURNAL_SECTOR_SIZE;
+  return flash_bytes / (float)stats->bytes_appended;
+}
+
+void journal_get_stats(journal_stats_t *stats)
+{
+  if (stats == NULL) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  *stats = s_stats;
+  portEXIT_CRITICAL(&s_lock);
+}
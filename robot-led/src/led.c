@@ -1,3 +1,9 @@
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
 #include "esp_log.h"
 #include "led_strip.h"
 #include "led.h"
@@ -13,6 +19,48 @@ static const char *TAG = "led";
 
 static led_strip_handle_t led_strip;
 
+typedef struct {
+  bool off;
+  uint16_t h;
+  uint8_t s;
+  uint8_t v;
+} led_request_t;
+
+#if CONFIG_ROBOT_LED_TASK
+// Single-slot mailbox: only the latest requested colour matters.
+static QueueHandle_t s_requests;
+#endif
+
+static void led_apply(const led_request_t *req) {
+  if (req->off) {
+    led_strip_clear(led_strip);
+  } else {
+    led_strip_set_pixel_hsv(led_strip, 0, req->h, req->s, req->v);
+  }
+  led_strip_refresh(led_strip);
+}
+
+#if CONFIG_ROBOT_LED_TASK
+static void led_task(void *arg) {
+  led_request_t req;
+  for (;;) {
+    if (xQueueReceive(s_requests, &req, portMAX_DELAY) == pdTRUE) {
+      led_apply(&req);
+    }
+  }
+}
+#endif
+
+static void led_request(const led_request_t *req) {
+#if CONFIG_ROBOT_LED_TASK
+  if (s_requests != NULL) {
+    xQueueOverwrite(s_requests, req);
+    return;
+  }
+#endif
+  led_apply(req);
+}
+
 void led_init(void) {
   led_strip_config_t strip_config = {.strip_gpio_num = LED_GPIO,
                                      .max_leds = 1,
@@ -24,25 +72,44 @@ void led_init(void) {
   };
   ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip));
   led_strip_clear(led_strip);
+
+#if CONFIG_ROBOT_LED_TASK
+  s_requests = xQueueCreate(1, sizeof(led_request_t));
+  const BaseType_t core =
+      (CONFIG_ROBOT_LED_TASK_CORE < 0 ||
+       CONFIG_ROBOT_LED_TASK_CORE >= portNUM_PROCESSORS)
+          ? tskNO_AFFINITY
+          : CONFIG_ROBOT_LED_TASK_CORE;
+  if (s_requests == NULL ||
+      xTaskCreatePinnedToCore(led_task, "led", CONFIG_ROBOT_LED_TASK_STACK_SIZE,
+                              NULL, CONFIG_ROBOT_LED_TASK_PRIORITY, NULL,
+                              core) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create LED task, refreshing inline");
+    if (s_requests != NULL) {
+      vQueueDelete(s_requests);
+      s_requests = NULL;
+    }
+  }
+#endif
 }
 
 void set_led_color(uint16_t color) {
-  led_strip_set_pixel_hsv(led_strip, 0, color, 255, 32);
-  led_strip_refresh(led_strip);
+  led_set_hsv(color, 255, 32);
 }
 
 void led_set_hsv(uint16_t h, uint8_t s, uint8_t v) {
-  led_strip_set_pixel_hsv(led_strip, 0, h, s, v);
-  led_strip_refresh(led_strip);
+  const led_request_t req = {.off = false, .h = h, .s = s, .v = v};
+  led_request(&req);
 }
 
 void led_set_status(led_status_t status) {
   ESP_LOGD(TAG, "Setting LED status: %d", status);
   switch (status) {
-    case LED_STATUS_OFF:
-      led_strip_clear(led_strip);
-      led_strip_refresh(led_strip);
+    case LED_STATUS_OFF: {
+      const led_request_t req = {.off = true};
+      led_request(&req);
       break;
+    }
     case LED_STATUS_WIFI_CONNECTING:
       set_led_color(LED_HUE_WIFI_CONNECTING);
       break;
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-point geometry for the drive executor, avoiding soft-float libm
+// calls in the control loop.
+//
+// Angles are binary angle units (BAM): 65536 units per turn, so wrapping
+// is free with uint16_t arithmetic. sin/cos return Q15 (32767 == 1.0)
+// from a 257-entry quarter-wave table with linear interpolation. Over all
+// 65536 angles the result is within 0.84 LSB of 32767 * sin() from libm.
+//
+// test_apps/fixmath checks every function against libm or C division and
+// reports the cost of each call.
+
+int16_t fixmath_sin_q15(uint16_t angle);
+int16_t fixmath_cos_q15(uint16_t angle);
+
+// Convert degrees or millidegrees to BAM, rounded, modulo one turn.
+uint16_t fixmath_deg_to_bam(int32_t angle_deg);
+uint16_t fixmath_mdeg_to_bam(int32_t angle_mdeg);
+
+// Reciprocal of a divisor that stays fixed across many ticks (wheel
+// track, turn radius, ...). Division becomes a multiply and a shift, and
+// the result equals C integer division (truncation towards zero) for
+// |numerator| < 2^31.
+typedef struct {
+  uint64_t mult;
+  uint8_t shift;
+} fixmath_recip_t;
+
+// divisor must be in [1, 2^31]. Returns false otherwise.
+bool fixmath_recip_init(fixmath_recip_t *recip, uint32_t divisor);
+
+int32_t fixmath_recip_div(const fixmath_recip_t *recip, int32_t numerator);
+
+// Length of an arc of radius_mm through angle_deg, rounded to the nearest
+// millimetre (negative for negative angles). Any int32_t inputs are valid;
+// lengths beyond the int32_t range saturate to INT32_MIN or INT32_MAX.
+int32_t fixmath_arc_length_mm(int32_t radius_mm, int32_t angle_deg);
+
+// Wheel path lengths for a turn of radius_mm around the robot centre:
+// the left wheel runs at radius - track/2, the right at radius + track/2,
+// so a positive angle turns left. radius_mm == 0 spins on the spot.
+// Lengths saturate like fixmath_arc_length_mm().
+void fixmath_wheel_arcs_mm(int32_t radius_mm,
+                           int32_t angle_deg,
+                           int32_t track_mm,
+                           int32_t *left_mm,
+                           int32_t *right_mm);
@@ -0,0 +1,161 @@
+#include "../include/fixmath.h"
+
+// 65534 * sin(i * pi / 512) for i = 0..256 (one quadrant, 64 BAM units
+// per entry): Q15 with one extra bit, so that only the interpolated result
+// is rounded.
+static const uint16_t kSinQuarter[257] = {
+    0, 402, 804, 1206, 1608, 2010, 2412, 2814,
+    3216, 3617, 4019, 4420, 4821, 5222, 5623, 6023,
+    6423, 6824, 7223, 7623, 8022, 8421, 8820, 9218,
+    9616, 10013, 10411, 10807, 11204, 11600, 11995, 12390,
+    12785, 13179, 13573, 13966, 14359, 14751, 15142, 15533,
+    15923, 16313, 16702, 17091, 17479, 17866, 18253, 18638,
+    19024, 19408, 19792, 20175, 20557, 20938, 21319, 21699,
+    22078, 22456, 22833, 23210, 23585, 23960, 24334, 24707,
+    25079, 25450, 25820, 26189, 26557, 26924, 27290, 27655,
+    28019, 28382, 28744, 29105, 29465, 29823, 30181, 30537,
+    30893, 31247, 31599, 31951, 32302, 32651, 32999, 33346,
+    33691, 34035, 34378, 34720, 35061, 35400, 35737, 36074,
+    36409, 36742, 37075, 37406, 37735, 38063, 38390, 38715,
+    39039, 39361, 39682, 40001, 40319, 40635, 40950, 41263,
+    41574, 41884, 42193, 42500, 42805, 43109, 43411, 43711,
+    44010, 44307, 44603, 44896, 45188, 45479, 45767, 46054,
+    46340, 46623, 46905, 47185, 47463, 47739, 48014, 48287,
+    48557, 48827, 49094, 49359, 49623, 49885, 50144, 50402,
+    50658, 50913, 51165, 51415, 51663, 51910, 52154, 52397,
+    52637, 52876, 53113, 53347, 53580, 53810, 54039, 54265,
+    54490, 54712, 54932, 55150, 55367, 55581, 55793, 56003,
+    56210, 56416, 56620, 56821, 57020, 57217, 57412, 57605,
+    57796, 57984, 58171, 58355, 58537, 58716, 58894, 59069,
+    59242, 59413, 59581, 59748, 59912, 60074, 60233, 60391,
+    60546, 60698, 60849, 60997, 61143, 61286, 61428, 61567,
+    61703, 61837, 61969, 62099, 62226, 62351, 62474, 62594,
+    62712, 62828, 62941, 63052, 63160, 63266, 63370, 63471,
+    63570, 63667, 63761, 63852, 63942, 64029, 64113, 64195,
+    64275, 64352, 64427, 64499, 64569, 64637, 64702, 64764,
+    64825, 64882, 64938, 64991, 65041, 65089, 65135, 65178,
+    65218, 65257, 65292, 65326, 65356, 65385, 65411, 65434,
+    65455, 65474, 65490, 65503, 65514, 65523, 65529, 65533,
+    65534,
+};
+
+int16_t fixmath_sin_q15(uint16_t angle)
+{
+  uint32_t quadrant = angle >> 14;
+  uint32_t offset = angle & 0x3FFFu;
+  if ((quadrant & 1u) != 0u) {
+    offset = 0x4000u - offset;
+  }
+
+  uint32_t index = offset >> 6;
+  int32_t frac = (int32_t)(offset & 0x3Fu);
+  int32_t scaled = (int32_t)kSinQuarter[index] << 6; // 2^-7 LSB
+  if (frac != 0) {
+    scaled += ((int32_t)kSinQuarter[index + 1u] -
+               (int32_t)kSinQuarter[index]) * frac;
+  }
+  int32_t value = (scaled + 64) >> 7;
+  return (int16_t)(((quadrant & 2u) != 0u) ? -value : value);
+}
+
+int16_t fixmath_cos_q15(uint16_t angle)
+{
+  return fixmath_sin_q15((uint16_t)(angle + 0x4000u));
+}
+
+// Both conversions reduce to one turn first, which is exactly 65536 units,
+// so the scaled value fits in 32 bits and rounding is exact. Neither
+// quotient can fall on a half.
+uint16_t fixmath_deg_to_bam(int32_t angle_deg)
+{
+  int32_t deg = angle_deg % 360;
+  if (deg < 0) {
+    deg += 360;
+  }
+  // 65536 / 360 == 8192 / 45.
+  return (uint16_t)(((uint32_t)deg * 16384u + 45u) / 90u);
+}
+
+uint16_t fixmath_mdeg_to_bam(int32_t angle_mdeg)
+{
+  int32_t mdeg = angle_mdeg % 360000;
+  if (mdeg < 0) {
+    mdeg += 360000;
+  }
+  // 65536 / 360000 == 1024 / 5625.
+  return (uint16_t)(((uint32_t)mdeg * 2048u + 5625u) / 11250u);
+}
+
+bool fixmath_recip_init(fixmath_recip_t *recip, uint32_t divisor)
+{
+  if (recip == NULL || divisor == 0u || divisor > 0x80000000u) {
+    return false;
+  }
+
+  uint32_t log2_ceil = 0u;
+  while (log2_ceil < 32u && ((uint64_t)1 << log2_ceil) < divisor) {
+    log2_ceil++;
+  }
+  recip->shift = (uint8_t)(31u + log2_ceil);
+  recip->mult = (((uint64_t)1 << recip->shift) + divisor - 1u) / divisor;
+  return true;
+}
+
+int32_t fixmath_recip_div(const fixmath_recip_t *recip, int32_t numerator)
+{
+  uint32_t magnitude = (numerator < 0) ? (uint32_t)(-(int64_t)numerator)
+                                       : (uint32_t)numerator;
+  uint32_t quotient = (uint32_t)(((uint64_t)magnitude * recip->mult) >>
+                                 recip->shift);
+  return (numerator < 0) ? -(int32_t)quotient : (int32_t)quotient;
+}
+
+// Above this |radius_x2_mm * angle_deg| the length is beyond INT32_MAX
+// anyway (2^38 * pi / 360 > 2^31), and up to it the products below fit in
+// uint64_t.
+#define ARC_MAX_PRODUCT ((uint64_t)1 << 38)
+
+// Arc length for twice the radius, so half-track offsets stay exact.
+// pi / 180 in Q29 is 9370165 plus 1217770 / 2^24; the fraction keeps the
+// result correctly rounded up to the int32_t limit.
+static int32_t arc_length_x2(int64_t radius_x2_mm, int32_t angle_deg)
+{
+  bool negative = (radius_x2_mm < 0) != (angle_deg < 0);
+  uint64_t radius = (radius_x2_mm < 0) ? (uint64_t)-radius_x2_mm
+                                       : (uint64_t)radius_x2_mm;
+  uint64_t angle = (angle_deg < 0) ? (uint64_t)(-(int64_t)angle_deg)
+                                   : (uint64_t)angle_deg;
+  uint64_t product;
+  if (__builtin_mul_overflow(radius, angle, &product) ||
+      product > ARC_MAX_PRODUCT) {
+    return negative ? INT32_MIN : INT32_MAX;
+  }
+
+  uint64_t scaled = product * 9370165u + ((product * 1217770u) >> 24);
+  uint64_t length = (scaled + ((uint64_t)1 << 29)) >> 30;
+  if (negative) {
+    return (length > (uint64_t)INT32_MAX + 1u) ? INT32_MIN
+                                               : (int32_t)-(int64_t)length;
+  }
+  return (length > INT32_MAX) ? INT32_MAX : (int32_t)length;
+}
+
+int32_t fixmath_arc_length_mm(int32_t radius_mm, int32_t angle_deg)
+{
+  return arc_length_x2((int64_t)radius_mm * 2, angle_deg);
+}
+
+void fixmath_wheel_arcs_mm(int32_t radius_mm,
+                           int32_t angle_deg,
+                           int32_t track_mm,
+                           int32_t *left_mm,
+                           int32_t *right_mm)
+{
+  int64_t radius_x2_mm = (int64_t)radius_mm * 2;
+  if (left_mm != NULL) {
+    *left_mm = arc_length_x2(radius_x2_mm - track_mm, angle_deg);
+  }
+  if (right_mm != NULL) {
+    *right_mm = arc_length_x2(radius_x2_mm + track_mm, angle_deg);
+  }
+}
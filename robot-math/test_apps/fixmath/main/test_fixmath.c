@@ -0,0 +1,236 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_timer.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_cpu.h"
+#endif
+
+#include "fixmath.h"
+
+/* Accuracy of every fixmath function against libm (or C division), then
+ * the cost of each call. Builds for the Linux host target, where the
+ * accuracy sweep is quickest, and for the robot's chip, where cycles per
+ * call are what the control loop pays. */
+
+#define BENCH_CALLS 20000u
+
+static unsigned s_failures;
+
+static void check(bool ok, const char *what, long long a, long long b,
+                  long long got, long long expected)
+{
+  if (!ok) {
+    if (s_failures < 10u) {
+      printf("FAIL %s(%lld, %lld) = %lld, expected %lld\n", what, a, b, got,
+             expected);
+    }
+    s_failures++;
+  }
+}
+
+// The header promises 0.84 LSB over all 65536 angles.
+static void check_sin_cos(void)
+{
+  double worst = 0.0;
+  for (uint32_t angle = 0u; angle < 65536u; ++angle) {
+    double radians = (double)angle * (2.0 * M_PI / 65536.0);
+    double sin_err = fabs(fixmath_sin_q15((uint16_t)angle) -
+                          32767.0 * sin(radians));
+    double cos_err = fabs(fixmath_cos_q15((uint16_t)angle) -
+                          32767.0 * cos(radians));
+    worst = fmax(worst, fmax(sin_err, cos_err));
+  }
+  printf("sin/cos: worst error %.3f LSB\n", worst);
+  check(worst <= 0.84, "sin_cos_worst_milli_lsb", 0, 0,
+        (long long)(worst * 1000.0), 840);
+}
+
+static uint16_t bam_of(double turns)
+{
+  double units = floor(turns * 65536.0 + 0.5);
+  return (uint16_t)(int64_t)fmod(units, 65536.0);
+}
+
+static void check_bam(void)
+{
+  for (int32_t deg = -100000; deg <= 100000; ++deg) {
+    uint16_t expected = bam_of((double)deg / 360.0);
+    uint16_t got = fixmath_deg_to_bam(deg);
+    check(got == expected, "deg_to_bam", deg, 0, got, expected);
+  }
+  for (int32_t mdeg = -2000000; mdeg <= 2000000; mdeg += 7) {
+    uint16_t expected = bam_of((double)mdeg / 360000.0);
+    uint16_t got = fixmath_mdeg_to_bam(mdeg);
+    check(got == expected, "mdeg_to_bam", mdeg, 0, got, expected);
+  }
+}
+
+static uint32_t s_rand = 12345u;
+
+static uint32_t next_rand(void)
+{
+  s_rand ^= s_rand << 13;
+  s_rand ^= s_rand >> 17;
+  s_rand ^= s_rand << 5;
+  return s_rand;
+}
+
+static void check_recip_div(uint32_t divisor)
+{
+  fixmath_recip_t recip;
+  if (!fixmath_recip_init(&recip, divisor)) {
+    check(false, "recip_init", divisor, 0, 0, 1);
+    return;
+  }
+  static const int32_t kEdges[] = {0, 1, -1, INT32_MAX, -INT32_MAX};
+  for (size_t i = 0u; i < sizeof(kEdges) / sizeof(kEdges[0]); ++i) {
+    int32_t got = fixmath_recip_div(&recip, kEdges[i]);
+    int32_t expected = (int32_t)((int64_t)kEdges[i] / (int64_t)divisor);
+    check(got == expected, "recip_div", kEdges[i], divisor, got, expected);
+  }
+  for (uint32_t i = 0u; i < 64u; ++i) {
+    int32_t numerator = (int32_t)(next_rand() & 0x7fffffffu);
+    numerator = (i & 1u) ? -numerator : numerator;
+    int32_t got = fixmath_recip_div(&recip, numerator);
+    int32_t expected = (int32_t)((int64_t)numerator / (int64_t)divisor);
+    check(got == expected, "recip_div", numerator, divisor, got, expected);
+  }
+}
+
+static void check_recip(void)
+{
+  for (uint32_t divisor = 1u; divisor <= 4096u; ++divisor) {
+    check_recip_div(divisor);
+  }
+  for (uint32_t i = 0u; i < 4096u; ++i) {
+    check_recip_div(((next_rand() >> (i & 31u)) & 0x7fffffffu) | 1u);
+  }
+  check_recip_div(0x80000000u);
+  fixmath_recip_t recip;
+  check(!fixmath_recip_init(&recip, 0u), "recip_init", 0, 0, 1, 0);
+  check(!fixmath_recip_init(&recip, 0x80000001u), "recip_init", 0x80000001,
+        0, 1, 0);
+}
+
+// Nearest millimetre, halves away from zero, clamped to int32_t.
+static int32_t arc_of(double radius_mm, double angle_deg)
+{
+  double length = radius_mm * angle_deg * (M_PI / 180.0);
+  length = (length < 0.0) ? -floor(-length + 0.5) : floor(length + 0.5);
+  if (length > INT32_MAX) {
+    return INT32_MAX;
+  }
+  if (length < INT32_MIN) {
+    return INT32_MIN;
+  }
+  return (int32_t)length;
+}
+
+static void check_arc(int32_t radius_mm, int32_t angle_deg)
+{
+  int32_t got = fixmath_arc_length_mm(radius_mm, angle_deg);
+  int32_t expected = arc_of(radius_mm, angle_deg);
+  check(got == expected, "arc_length_mm", radius_mm, angle_deg, got,
+        expected);
+}
+
+static void check_arcs(void)
+{
+  // Everything a turn command can ask for at robot scale.
+  for (int32_t radius = -5000; radius <= 5000; radius += 7) {
+    for (int32_t angle = -1080; angle <= 1080; angle += 9) {
+      check_arc(radius, angle);
+    }
+  }
+  // Across the whole range, including saturation.
+  for (uint32_t i = 0u; i < 200000u; ++i) {
+    int32_t radius = (int32_t)next_rand() >> (next_rand() & 31u);
+    int32_t angle = (int32_t)next_rand() >> (next_rand() & 31u);
+    check_arc(radius, angle);
+  }
+  static const int32_t kEdges[] = {0, 1, -1, 360, -360, INT32_MAX, INT32_MIN};
+  for (size_t i = 0u; i < sizeof(kEdges) / sizeof(kEdges[0]); ++i) {
+    for (size_t j = 0u; j < sizeof(kEdges) / sizeof(kEdges[0]); ++j) {
+      check_arc(kEdges[i], kEdges[j]);
+    }
+  }
+  check_arc(2000000000, 360);
+
+  int32_t left;
+  int32_t right;
+  fixmath_wheel_arcs_mm(200, 90, 120, &left, &right);
+  check(left == arc_of(140, 90), "wheel_arcs_mm left", 200, 90, left,
+        arc_of(140, 90));
+  check(right == arc_of(260, 90), "wheel_arcs_mm right", 200, 90, right,
+        arc_of(260, 90));
+  fixmath_wheel_arcs_mm(INT32_MAX, INT32_MAX, INT32_MAX, &left, &right);
+  check(left == INT32_MAX, "wheel_arcs_mm left", INT32_MAX, INT32_MAX, left,
+        INT32_MAX);
+  check(right == INT32_MAX, "wheel_arcs_mm right", INT32_MAX, INT32_MAX,
+        right, INT32_MAX);
+}
+
+static uint32_t cycle_count(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+  return 0u;
+#else
+  return (uint32_t)esp_cpu_get_cycle_count();
+#endif
+}
+
+static volatile int32_t s_sink;
+static volatile int32_t s_divisor = 172;
+
+#define BENCH(name, expr)                                                 \
+  do {                                                                    \
+    int64_t start_us = esp_timer_get_time();                              \
+    uint32_t start_cycles = cycle_count();                                \
+    for (uint32_t i = 0u; i < BENCH_CALLS; ++i) {                         \
+      s_sink = (int32_t)(expr);                                           \
+    }                                                                     \
+    uint32_t cycles = cycle_count() - start_cycles;                       \
+    int64_t ns = (esp_timer_get_time() - start_us) * 1000;                \
+    printf("%-24s %8u %8u\n", name, (unsigned)(ns / BENCH_CALLS),         \
+           (unsigned)(cycles / BENCH_CALLS));                             \
+  } while (0)
+
+// The loop and the volatile store are part of every figure; "loop" shows
+// how much.
+static void bench(void)
+{
+  fixmath_recip_t recip;
+  fixmath_recip_init(&recip, 172u);
+  int32_t left;
+  int32_t right;
+
+  printf("%-24s %8s %8s\n", "call", "ns", "cycles");
+  BENCH("loop", i);
+  BENCH("fixmath_sin_q15", fixmath_sin_q15((uint16_t)(i * 2473u)));
+  BENCH("sinf", 32767.0f * sinf((float)i * 0.0001f));
+  BENCH("fixmath_deg_to_bam", fixmath_deg_to_bam((int32_t)i));
+  BENCH("fixmath_recip_div", fixmath_recip_div(&recip, (int32_t)i * 977));
+  BENCH("int32 division", ((int32_t)i * 977) / s_divisor);
+  BENCH("fixmath_arc_length_mm", fixmath_arc_length_mm((int32_t)i, 90));
+  BENCH("fixmath_wheel_arcs_mm",
+        (fixmath_wheel_arcs_mm((int32_t)i, 90, 172, &left, &right), left));
+}
+
+void app_main(void)
+{
+  check_sin_cos();
+  check_bam();
+  check_recip();
+  check_arcs();
+  printf("accuracy: %u failures\n", s_failures);
+
+  bench();
+
+#if CONFIG_IDF_TARGET_LINUX
+  exit(s_failures > 0u ? 1 : 0);
+#endif
+}
@@ -1,25 +1,144 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct {
   // Called when a command message arrives on CONFIG_COMMAND_TOPIC.
   void (*on_command_json)(const char *data, size_t len);
 
+  // Called with the drive config received on CONFIG_ROBOT_MQTT_CONFIG_TOPIC,
+  // and from mqtt_init() with the NVS cached copy. Only documents with
+  // "type":"config" are delivered. When NULL, live configs go to
+  // on_command_json and the cached copy is not replayed.
+  void (*on_config_json)(const char *data, size_t len);
+
+  // Called when a message arrives on <CONFIG_ROBOT_MQTT_KIND_TOPIC_PREFIX>
+  // <kind>. kind is the last topic level; data is the bare body and may be
+  // empty (len == 0).
+  void (*on_command_kind_json)(const char *kind, const char *data, size_t len);
+
   // Optional connection status notifications.
   void (*on_connected)(void);
   void (*on_disconnected)(void);
 } mqtt_handlers_t;
 
+// Priority classes for messages held in the outbox while disconnected.
+// Lower values drain first after a reconnect.
+typedef enum {
+  MQTT_PRIORITY_ACK = 0,
+  MQTT_PRIORITY_TELEMETRY = 1,
+  MQTT_PRIORITY_DEBUG = 2,
+} mqtt_priority_t;
+
+typedef struct {
+  uint32_t queued;   // messages stored while offline or after a failed publish
+  uint32_t dropped;  // messages evicted or rejected
+  uint32_t drained;  // stored messages handed to the client after reconnect
+  uint32_t depth;    // messages currently stored
+} mqtt_outbox_stats_t;
+
+typedef enum {
+  MQTT_CONFIG_SOURCE_NONE = 0,
+  MQTT_CONFIG_SOURCE_CACHE = 1,
+  MQTT_CONFIG_SOURCE_RETAINED = 2,
+} mqtt_config_source_t;
+
+// Boot timings in microseconds since boot (esp_timer_get_time()).
+// Zero means the event has not happened yet.
+typedef struct {
+  int64_t connected_us;       // first MQTT_EVENT_CONNECTED
+  int64_t config_applied_us;  // first config delivered to the handler
+  int64_t retained_config_us; // first config received from the broker
+  mqtt_config_source_t config_source; // source of the first config
+} mqtt_boot_metrics_t;
+
+// TLS handshake timings of one kind (full or resumed).
+typedef struct {
+  uint32_t count;
+  int64_t last_us;
+  int64_t max_us;
+  int64_t total_us;
+} mqtt_handshake_stats_t;
+
+// Connection setup timings, measured from MQTT_EVENT_BEFORE_CONNECT to
+// MQTT_EVENT_CONNECTED. For mqtts:// and wss:// brokers this covers the TLS
+// handshake plus the MQTT CONNECT/CONNACK round trip.
+typedef struct {
+  uint32_t count;
+  bool tls;
+  int64_t last_us;
+  int64_t min_us;
+  int64_t max_us;
+  int64_t total_us;
+  // The TLS handshake alone, split by whether the cached session was
+  // resumed. Only filled with CONFIG_ROBOT_MQTT_TLS_RESUMPTION, when the
+  // client uses robot-mqtt's TLS transport.
+  mqtt_handshake_stats_t full_handshake;
+  mqtt_handshake_stats_t resumed_handshake;
+} mqtt_connect_stats_t;
+
+// Handler worker task (CONFIG_ROBOT_MQTT_WORKER).
+typedef struct {
+  uint32_t posted;     // messages queued for the worker
+  uint32_t dropped;    // messages lost to a full queue
+  uint32_t max_depth;  // deepest the queue has been
+  struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+  } queue_wait;        // time from queueing to dispatch start
+} mqtt_worker_stats_t;
+
 void mqtt_set_handlers(const mqtt_handlers_t *handlers);
 
+// CA certificate (NUL-terminated PEM) that mqtts:// brokers are checked
+// against when CONFIG_ROBOT_MQTT_TLS_RESUMPTION is set, for example a
+// local broker's own CA. Call before mqtt_init(); the string must stay
+// valid. Without it the certificate bundle is used.
+void mqtt_set_ca_cert(const char *pem);
+
+// Drop the cached TLS session so the next connect runs a full handshake,
+// for example to compare both in mqtt_get_connect_stats().
+void mqtt_forget_tls_session(void);
+
 void mqtt_init(void);
 
 // Publish a debug JSON payload to the robot/debug topic.
 // The payload string must be a null-terminated JSON document.
+// Payloads published before the client is connected are kept in the outbox
+// at the lowest priority.
 void mqtt_publish_debug(const char *payload);
 
 // Publish a command JSON payload to the configured command topic
 // (CONFIG_COMMAND_TOPIC). The payload string must be a null-terminated
 // JSON document.
-void mqtt_publish_command(const char *payload);
\ No newline at end of file
+void mqtt_publish_command(const char *payload);
+
+// Publish a telemetry JSON payload to CONFIG_ROBOT_MQTT_TELEMETRY_TOPIC.
+// While disconnected the payload is kept in the outbox and published
+// after reconnect.
+void mqtt_publish_telemetry(const char *payload);
+
+// Publish a binary telemetry record to
+// CONFIG_ROBOT_MQTT_BINARY_TELEMETRY_TOPIC. Queued like telemetry while
+// disconnected, as long as it fits an outbox slot.
+void mqtt_publish_binary_telemetry(const void *data, size_t len);
+
+// Publish an acknowledgement JSON payload to CONFIG_ROBOT_MQTT_ACK_TOPIC
+// with QoS1. Acks drain from the outbox before telemetry and debug.
+void mqtt_publish_ack(const char *payload);
+
+void mqtt_get_outbox_stats(mqtt_outbox_stats_t *stats);
+
+void mqtt_get_boot_metrics(mqtt_boot_metrics_t *metrics);
+
+void mqtt_get_connect_stats(mqtt_connect_stats_t *stats);
+
+void mqtt_get_worker_stats(mqtt_worker_stats_t *stats);
+
+// esp_timer time at which the first chunk of the message currently being
+// delivered to a handler arrived. Only meaningful inside a handler, in the
+// worker task when CONFIG_ROBOT_MQTT_WORKER is set.
+int64_t mqtt_get_rx_timestamp_us(void);
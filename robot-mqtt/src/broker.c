@@ -0,0 +1,241 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+
+#include "broker.h"
+
+static const char *TAG = "mqtt_broker";
+
+#define BROKER_MAX_COUNT   4
+#define BROKER_URI_MAX_LEN 128
+#define BROKER_RTT_UNREACHABLE INT64_MAX
+
+typedef struct {
+  char uri[BROKER_URI_MAX_LEN];
+  int64_t rtt_us;
+} broker_entry_t;
+
+static broker_entry_t s_brokers[BROKER_MAX_COUNT];
+static size_t s_broker_count = 0u;
+static size_t s_current = 0u;
+
+static void add_broker(const char *uri, size_t len)
+{
+  while (len > 0u && (*uri == ' ')) {
+    ++uri;
+    --len;
+  }
+  while (len > 0u && uri[len - 1u] == ' ') {
+    --len;
+  }
+  if (len == 0u) {
+    return;
+  }
+  if (s_broker_count >= BROKER_MAX_COUNT || len >= BROKER_URI_MAX_LEN) {
+    ESP_LOGW(TAG, "Ignoring broker %.*s", (int)len, uri);
+    return;
+  }
+  memcpy(s_brokers[s_broker_count].uri, uri, len);
+  s_brokers[s_broker_count].uri[len] = '\0';
+  s_brokers[s_broker_count].rtt_us = BROKER_RTT_UNREACHABLE;
+  s_broker_count++;
+}
+
+static uint16_t default_port(const char *scheme, size_t len)
+{
+  if (len == 5u && strncmp(scheme, "mqtts", 5u) == 0) {
+    return 8883u;
+  }
+  if (len == 3u && strncmp(scheme, "wss", 3u) == 0) {
+    return 443u;
+  }
+  if (len == 2u && strncmp(scheme, "ws", 2u) == 0) {
+    return 80u;
+  }
+  return 1883u;
+}
+
+// Split scheme://host[:port][/path] into host and port.
+static bool parse_host_port(const char *uri,
+                            char *host,
+                            size_t host_size,
+                            uint16_t *port)
+{
+  const char *sep = strstr(uri, "://");
+  if (sep == NULL) {
+    return false;
+  }
+  *port = default_port(uri, (size_t)(sep - uri));
+
+  const char *start = sep + 3;
+  const char *end = start + strcspn(start, ":/");
+  size_t host_len = (size_t)(end - start);
+  if (host_len == 0u || host_len >= host_size) {
+    return false;
+  }
+  memcpy(host, start, host_len);
+  host[host_len] = '\0';
+
+  if (*end == ':') {
+    long value = strtol(end + 1, NULL, 10);
+    if (value <= 0 || value > 65535) {
+      return false;
+    }
+    *port = (uint16_t)value;
+  }
+  return true;
+}
+
+// Time a TCP connect to the broker. Returns BROKER_RTT_UNREACHABLE on
+// failure or timeout.
+static int64_t probe_rtt_us(const char *uri)
+{
+  char host[BROKER_URI_MAX_LEN];
+  uint16_t port;
+  if (!parse_host_port(uri, host, sizeof(host), &port)) {
+    ESP_LOGW(TAG, "Cannot parse broker URI %s", uri);
+    return BROKER_RTT_UNREACHABLE;
+  }
+
+  char port_str[6];
+  snprintf(port_str, sizeof(port_str), "%u", (unsigned)port);
+
+  // A literal address is converted without touching DNS. A name goes
+  // through lwIP's resolver, which is not bounded by the probe timeout.
+  struct addrinfo hints = {
+      .ai_family = AF_INET,
+      .ai_socktype = SOCK_STREAM,
+      .ai_flags = AI_NUMERICHOST,
+  };
+  struct addrinfo *res = NULL;
+  if (getaddrinfo(host, port_str, &hints, &res) != 0 || res == NULL) {
+    hints.ai_flags = 0;
+    int64_t dns_start_us = esp_timer_get_time();
+    if (getaddrinfo(host, port_str, &hints, &res) != 0 || res == NULL) {
+      ESP_LOGW(TAG, "DNS lookup failed for %s after %lldms", host,
+               (long long)((esp_timer_get_time() - dns_start_us) / 1000));
+      return BROKER_RTT_UNREACHABLE;
+    }
+  }
+
+  int64_t rtt_us = BROKER_RTT_UNREACHABLE;
+  int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (sock < 0) {
+    freeaddrinfo(res);
+    return BROKER_RTT_UNREACHABLE;
+  }
+
+  int flags = fcntl(sock, F_GETFL, 0);
+  (void)fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+  int64_t start_us = esp_timer_get_time();
+  int ret = connect(sock, res->ai_addr, res->ai_addrlen);
+  if (ret == 0) {
+    rtt_us = esp_timer_get_time() - start_us;
+  } else if (errno == EINPROGRESS) {
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(sock, &wfds);
+    struct timeval tv = {
+        .tv_sec = CONFIG_ROBOT_MQTT_BROKER_PROBE_TIMEOUT_MS / 1000,
+        .tv_usec = (CONFIG_ROBOT_MQTT_BROKER_PROBE_TIMEOUT_MS % 1000) * 1000,
+    };
+    if (select(sock + 1, NULL, &wfds, NULL, &tv) > 0) {
+      int err = 0;
+      socklen_t err_len = sizeof(err);
+      if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 &&
+          err == 0) {
+        rtt_us = esp_timer_get_time() - start_us;
+      }
+    }
+  }
+
+  close(sock);
+  freeaddrinfo(res);
+  return rtt_us;
+}
+
+void broker_list_init(void)
+{
+  s_broker_count = 0u;
+  s_current = 0u;
+
+  const char *list = CONFIG_ROBOT_MQTT_BROKER_URLS;
+  if (list[0] == '\0') {
+    add_broker(CONFIG_BROKER_URL, strlen(CONFIG_BROKER_URL));
+    return;
+  }
+
+  while (*list != '\0') {
+    size_t len = strcspn(list, ",");
+    add_broker(list, len);
+    list += len;
+    if (*list == ',') {
+      ++list;
+    }
+  }
+
+  if (s_broker_count == 0u) {
+    ESP_LOGW(TAG, "No usable broker in list, using %s", CONFIG_BROKER_URL);
+    add_broker(CONFIG_BROKER_URL, strlen(CONFIG_BROKER_URL));
+  }
+  if (s_broker_count <= 1u) {
+    return;
+  }
+
+  for (size_t i = 0u; i < s_broker_count; ++i) {
+    s_brokers[i].rtt_us = probe_rtt_us(s_brokers[i].uri);
+    if (s_brokers[i].rtt_us == BROKER_RTT_UNREACHABLE) {
+      ESP_LOGI(TAG, "Broker %s unreachable", s_brokers[i].uri);
+    } else {
+      ESP_LOGI(TAG, "Broker %s rtt=%lldus", s_brokers[i].uri,
+               (long long)s_brokers[i].rtt_us);
+    }
+  }
+
+  // Insertion sort by RTT; the list is tiny and this keeps equal entries
+  // in configured order.
+  for (size_t i = 1u; i < s_broker_count; ++i) {
+    broker_entry_t entry = s_brokers[i];
+    size_t j = i;
+    while (j > 0u && s_brokers[j - 1u].rtt_us > entry.rtt_us) {
+      s_brokers[j] = s_brokers[j - 1u];
+      --j;
+    }
+    s_brokers[j] = entry;
+  }
+}
+
+const char *broker_current_uri(void)
+{
+  return s_brokers[s_current].uri;
+}
+
+const char *broker_next_uri(void)
+{
+  if (s_broker_count > 0u) {
+    s_current = (s_current + 1u) % s_broker_count;
+  }
+  return s_brokers[s_current].uri;
+}
+
+size_t broker_count(void)
+{
+  return s_broker_count;
+}
+
+bool broker_all_tls(void)
+{
+  for (size_t i = 0u; i < s_broker_count; ++i) {
+    if (strncmp(s_brokers[i].uri, "mqtts://", 8) != 0) {
+      return false;
+    }
+  }
+  return s_broker_count > 0u;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Broker failover list built from CONFIG_ROBOT_MQTT_BROKER_URLS (or
+// CONFIG_BROKER_URL when that is empty).
+
+// Parse the broker list and probe each entry with a TCP connect, ordering
+// the list by round-trip time. Unreachable brokers are kept at the end.
+// Brokers are only probed here: failover later walks this order without
+// measuring again. Each connect is bounded by the probe timeout, and
+// literal IPv4 addresses skip DNS. A host name adds an lwIP lookup, which
+// can block for several seconds (DNS_MAX_RETRIES) if the server does not
+// answer.
+void broker_list_init(void);
+
+// URI of the broker currently in use.
+const char *broker_current_uri(void);
+
+// Advance to the next broker in probe order and return its URI.
+const char *broker_next_uri(void);
+
+size_t broker_count(void);
+
+// True if every broker in the list is an mqtts:// URI.
+bool broker_all_tls(void);
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "config_cache.h"
+
+static const char *TAG = "mqtt_config_cache";
+
+#define CONFIG_CACHE_NAMESPACE "robot_mqtt"
+#define CONFIG_CACHE_KEY       "config"
+
+bool config_cache_load(char **data, size_t *len)
+{
+  nvs_handle_t nvs;
+  if (nvs_open(CONFIG_CACHE_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+    return false;
+  }
+
+  size_t size = 0u;
+  esp_err_t err = nvs_get_blob(nvs, CONFIG_CACHE_KEY, NULL, &size);
+  if (err != ESP_OK || size == 0u) {
+    nvs_close(nvs);
+    return false;
+  }
+
+  char *buffer = malloc(size);
+  if (buffer == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate cached config buffer (%u bytes)",
+             (unsigned)size);
+    nvs_close(nvs);
+    return false;
+  }
+
+  err = nvs_get_blob(nvs, CONFIG_CACHE_KEY, buffer, &size);
+  nvs_close(nvs);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to read cached config: %s", esp_err_to_name(err));
+    free(buffer);
+    return false;
+  }
+
+  *data = buffer;
+  *len = size;
+  return true;
+}
+
+void config_cache_store(const char *data, size_t len)
+{
+  char *cached = NULL;
+  size_t cached_len = 0u;
+  if (config_cache_load(&cached, &cached_len)) {
+    // The broker re-delivers the retained config on every connect; skip
+    // the flash write when nothing changed.
+    bool same = (cached_len == len) && (memcmp(cached, data, len) == 0);
+    free(cached);
+    if (same) {
+      return;
+    }
+  }
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(CONFIG_CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to open NVS for config cache: %s",
+             esp_err_to_name(err));
+    return;
+  }
+
+  err = nvs_set_blob(nvs, CONFIG_CACHE_KEY, data, len);
+  if (err == ESP_OK) {
+    err = nvs_commit(nvs);
+  }
+  nvs_close(nvs);
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to store config cache: %s", esp_err_to_name(err));
+  }
+}
+
+void config_cache_erase(void)
+{
+  nvs_handle_t nvs;
+  if (nvs_open(CONFIG_CACHE_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+    return;
+  }
+
+  esp_err_t err = nvs_erase_key(nvs, CONFIG_CACHE_KEY);
+  if (err == ESP_OK) {
+    err = nvs_commit(nvs);
+  }
+  nvs_close(nvs);
+
+  if (err == ESP_OK) {
+    ESP_LOGI(TAG, "Cached config erased");
+  } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+    ESP_LOGW(TAG, "Failed to erase config cache: %s", esp_err_to_name(err));
+  }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// NVS copy of the last document received on CONFIG_ROBOT_MQTT_CONFIG_TOPIC.
+
+// Load the cached config into a newly allocated buffer. The caller frees
+// *data. Returns false if there is no cached config.
+bool config_cache_load(char **data, size_t *len);
+
+// Store the config if it differs from the cached copy.
+void config_cache_store(const char *data, size_t len);
+
+// Remove the cached config, if any.
+void config_cache_erase(void);
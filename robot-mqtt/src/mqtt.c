@@ -5,17 +5,81 @@
 #include <string.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "mqtt_client.h"
+#include <cJSON.h>
 
 #include "../include/mqtt.h"
+#include "broker.h"
+#include "config_cache.h"
+#include "outbox.h"
+#if CONFIG_ROBOT_MQTT_TLS_RESUMPTION
+#include "tls_transport.h"
+#endif
+#include "worker.h"
 
 static const char *TAG = "mqtt_client";
 static esp_mqtt_client_handle_t s_client = NULL;
 static mqtt_handlers_t s_handlers;
+static volatile bool s_connected = false;
+static esp_timer_handle_t s_drain_timer = NULL;
+static int64_t s_offline_since_us = 0;
 
 static char *s_rx_buffer = NULL;
 static size_t s_rx_buffer_len = 0u;
 static size_t s_rx_expected_len = 0u;
+static bool s_rx_is_config = false;
+static char s_rx_kind[24];
+static int64_t s_rx_started_us = 0;
+static int64_t s_dispatch_rx_us = 0;
+
+static mqtt_boot_metrics_t s_boot_metrics;
+static mqtt_connect_stats_t s_connect_stats;
+static int64_t s_connect_start_us = 0;
+static const char *s_ca_cert = NULL;
+
+static bool mqtt_has_config_topic(void)
+{
+  return CONFIG_ROBOT_MQTT_CONFIG_TOPIC[0] != '\0';
+}
+
+static bool mqtt_has_kind_topic(void)
+{
+  return CONFIG_ROBOT_MQTT_KIND_TOPIC_PREFIX[0] != '\0';
+}
+
+static bool mqtt_topic_equals(const esp_mqtt_event_handle_t event,
+                              const char *topic)
+{
+  return event->topic != NULL &&
+         (size_t)event->topic_len == strlen(topic) &&
+         strncmp(event->topic, topic, (size_t)event->topic_len) == 0;
+}
+
+// Extract the kind from <CONFIG_ROBOT_MQTT_KIND_TOPIC_PREFIX><kind> into
+// s_rx_kind. Leaves s_rx_kind empty if the topic does not match.
+static void mqtt_match_kind_topic(const esp_mqtt_event_handle_t event)
+{
+  static const size_t kPrefixLen =
+      sizeof(CONFIG_ROBOT_MQTT_KIND_TOPIC_PREFIX) - 1u;
+
+  s_rx_kind[0] = '\0';
+  if (!mqtt_has_kind_topic() || event->topic == NULL ||
+      (size_t)event->topic_len <= kPrefixLen ||
+      strncmp(event->topic, CONFIG_ROBOT_MQTT_KIND_TOPIC_PREFIX,
+              kPrefixLen) != 0) {
+    return;
+  }
+
+  size_t kind_len = (size_t)event->topic_len - kPrefixLen;
+  if (kind_len >= sizeof(s_rx_kind)) {
+    ESP_LOGW(TAG, "Command kind in topic too long (len=%u)",
+             (unsigned)kind_len);
+    return;
+  }
+  memcpy(s_rx_kind, event->topic + kPrefixLen, kind_len);
+  s_rx_kind[kind_len] = '\0';
+}
 
 static void log_error_if_nonzero(const char *message, int error_code) {
   if (error_code != 0) {
@@ -23,23 +87,147 @@ static void log_error_if_nonzero(const char *message, int error_code) {
   }
 }
 
+static void mqtt_handle_before_connect(void)
+{
+  s_connect_start_us = esp_timer_get_time();
+}
+
+static void mqtt_record_connect_time(void)
+{
+  if (s_connect_start_us == 0) {
+    return;
+  }
+
+  int64_t elapsed_us = esp_timer_get_time() - s_connect_start_us;
+  s_connect_start_us = 0;
+
+  const char *uri = broker_current_uri();
+  s_connect_stats.tls = strncmp(uri, "mqtts://", 8) == 0 ||
+                        strncmp(uri, "wss://", 6) == 0;
+  s_connect_stats.count++;
+  s_connect_stats.last_us = elapsed_us;
+  s_connect_stats.total_us += elapsed_us;
+  if (s_connect_stats.count == 1u || elapsed_us < s_connect_stats.min_us) {
+    s_connect_stats.min_us = elapsed_us;
+  }
+  if (elapsed_us > s_connect_stats.max_us) {
+    s_connect_stats.max_us = elapsed_us;
+  }
+
+  int64_t handshake_us = -1;
+  bool resumed = false;
+#if CONFIG_ROBOT_MQTT_TLS_RESUMPTION
+  tls_transport_handshake_t handshake;
+  if (tls_transport_take_handshake(&handshake)) {
+    mqtt_handshake_stats_t *stats = handshake.resumed
+                                        ? &s_connect_stats.resumed_handshake
+                                        : &s_connect_stats.full_handshake;
+    stats->count++;
+    stats->last_us = handshake.handshake_us;
+    stats->total_us += handshake.handshake_us;
+    if (handshake.handshake_us > stats->max_us) {
+      stats->max_us = handshake.handshake_us;
+    }
+    handshake_us = handshake.handshake_us;
+    resumed = handshake.resumed;
+  }
+#endif
+
+  char payload[160];
+  if (handshake_us >= 0) {
+    snprintf(payload,
+             sizeof(payload),
+             "{\"connect\":{\"us\":%lld,\"tls\":true,\"count\":%u,"
+             "\"handshake_us\":%lld,\"resumed\":%s}}",
+             (long long)elapsed_us,
+             (unsigned)s_connect_stats.count,
+             (long long)handshake_us,
+             resumed ? "true" : "false");
+  } else {
+    snprintf(payload,
+             sizeof(payload),
+             "{\"connect\":{\"us\":%lld,\"tls\":%s,\"count\":%u}}",
+             (long long)elapsed_us,
+             s_connect_stats.tls ? "true" : "false",
+             (unsigned)s_connect_stats.count);
+  }
+  mqtt_publish_telemetry(payload);
+}
+
+// The drain timer only runs while connected with messages in the outbox;
+// mqtt_drain_outbox() stops it once the outbox is empty.
+static void mqtt_arm_drain(void)
+{
+  if (s_drain_timer != NULL && s_connected &&
+      !esp_timer_is_active(s_drain_timer)) {
+    (void)esp_timer_start_periodic(
+        s_drain_timer, CONFIG_ROBOT_MQTT_OUTBOX_DRAIN_PERIOD_MS * 1000ULL);
+  }
+}
+
 static void mqtt_handle_connected(esp_mqtt_client_handle_t client)
 {
   int msg_id;
 
   ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+  s_connected = true;
+  s_offline_since_us = 0;
+  ESP_LOGI(TAG, "Connected to %s", broker_current_uri());
+  mqtt_record_connect_time();
+  if (!outbox_is_empty()) {
+    mqtt_arm_drain();
+  }
   mqtt_publish_debug("connected");
   if (s_handlers.on_connected != NULL) {
     s_handlers.on_connected();
   }
 
+  if (s_boot_metrics.connected_us == 0) {
+    s_boot_metrics.connected_us = esp_timer_get_time();
+  }
+
+  // Subscribe to the retained config first so the broker delivers it before
+  // anything arriving on the command topic.
+  if (mqtt_has_config_topic()) {
+    msg_id = esp_mqtt_client_subscribe(client, CONFIG_ROBOT_MQTT_CONFIG_TOPIC,
+                                       1);
+    ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d",
+             CONFIG_ROBOT_MQTT_CONFIG_TOPIC, msg_id);
+  }
+
   msg_id = esp_mqtt_client_subscribe(client, CONFIG_COMMAND_TOPIC, 1);
   ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", CONFIG_COMMAND_TOPIC, msg_id);
+
+  if (mqtt_has_kind_topic()) {
+    msg_id = esp_mqtt_client_subscribe(
+        client, CONFIG_ROBOT_MQTT_KIND_TOPIC_PREFIX "+", 1);
+    ESP_LOGI(TAG, "Subscribed to %s+, msg_id=%d",
+             CONFIG_ROBOT_MQTT_KIND_TOPIC_PREFIX, msg_id);
+  }
 }
 
 static void mqtt_handle_disconnected(void)
 {
   ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+  s_connected = false;
+  if (s_drain_timer != NULL) {
+    (void)esp_timer_stop(s_drain_timer);
+  }
+
+  // Failed connect attempts are also reported as disconnects, so this runs
+  // once per reconnect interval while the broker is unreachable.
+  int64_t now_us = esp_timer_get_time();
+  if (s_offline_since_us == 0) {
+    s_offline_since_us = now_us;
+  } else if (broker_count() > 1u &&
+             now_us - s_offline_since_us >=
+                 CONFIG_ROBOT_MQTT_FAILOVER_MS * 1000LL) {
+    const char *uri = broker_next_uri();
+    ESP_LOGW(TAG, "Broker unreachable for %lldms, failing over to %s",
+             (long long)((now_us - s_offline_since_us) / 1000), uri);
+    (void)esp_mqtt_client_set_uri(s_client, uri);
+    s_offline_since_us = now_us;
+  }
   if (s_handlers.on_disconnected != NULL) {
     s_handlers.on_disconnected();
   }
@@ -61,15 +249,151 @@ static void mqtt_handle_published(const esp_mqtt_event_handle_t event)
   ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
 }
 
+// Only documents with "type":"config" are applied or cached, so anything
+// else published to the config topic is neither run nor replayed at boot.
+static bool mqtt_is_config_document(const char *data, size_t len)
+{
+  cJSON *root = cJSON_ParseWithLength(data, len);
+  const cJSON *type = cJSON_GetObjectItemCaseSensitive(root, "type");
+  bool is_config = cJSON_IsString(type) && type->valuestring != NULL &&
+                   strcmp(type->valuestring, "config") == 0;
+  cJSON_Delete(root);
+  return is_config;
+}
+
+// The cached copy is only given to on_config_json.
+static void mqtt_deliver_config(const char *data,
+                                size_t len,
+                                mqtt_config_source_t source)
+{
+  if (s_handlers.on_config_json != NULL) {
+    s_handlers.on_config_json(data, len);
+  } else if (source == MQTT_CONFIG_SOURCE_RETAINED &&
+             s_handlers.on_command_json != NULL) {
+    s_handlers.on_command_json(data, len);
+  } else {
+    return;
+  }
+
+  if (s_boot_metrics.config_applied_us == 0) {
+    s_boot_metrics.config_applied_us = esp_timer_get_time();
+    s_boot_metrics.config_source = source;
+  }
+}
+
+static void mqtt_publish_boot_metrics(void)
+{
+  char payload[160];
+  snprintf(payload,
+           sizeof(payload),
+           "{\"boot\":{\"connected_ms\":%u,\"config_applied_ms\":%u,"
+           "\"retained_config_ms\":%u,\"config_source\":\"%s\"}}",
+           (unsigned)(s_boot_metrics.connected_us / 1000),
+           (unsigned)(s_boot_metrics.config_applied_us / 1000),
+           (unsigned)(s_boot_metrics.retained_config_us / 1000),
+           s_boot_metrics.config_source == MQTT_CONFIG_SOURCE_CACHE
+               ? "cache"
+               : "retained");
+  mqtt_publish_telemetry(payload);
+}
+
+// An empty payload is the broker clearing the retained config; the cached
+// copy is dropped with it.
+static void mqtt_handle_config(const char *data, size_t len)
+{
+  if (len == 0u) {
+#if CONFIG_ROBOT_MQTT_CONFIG_CACHE
+    config_cache_erase();
+#endif
+    return;
+  }
+  if (!mqtt_is_config_document(data, len)) {
+    ESP_LOGW(TAG, "Ignoring non-config document on config topic");
+    return;
+  }
+
+  bool first = (s_boot_metrics.retained_config_us == 0);
+  if (first) {
+    s_boot_metrics.retained_config_us = esp_timer_get_time();
+  }
+
+  mqtt_deliver_config(data, len, MQTT_CONFIG_SOURCE_RETAINED);
+
+#if CONFIG_ROBOT_MQTT_CONFIG_CACHE
+  config_cache_store(data, len);
+#endif
+
+  if (first) {
+    mqtt_publish_boot_metrics();
+  }
+}
+
+// Deliver a complete message to the handlers; runs in the esp-mqtt task,
+// or in the worker task with CONFIG_ROBOT_MQTT_WORKER.
+static void mqtt_dispatch(worker_msg_type_t type,
+                          const char *kind,
+                          const char *data,
+                          size_t len,
+                          int64_t rx_us)
+{
+  s_dispatch_rx_us = rx_us;
+  switch (type) {
+    case WORKER_MSG_CONFIG:
+      mqtt_handle_config(data, len);
+      break;
+    case WORKER_MSG_KIND:
+      if (s_handlers.on_command_kind_json != NULL) {
+        s_handlers.on_command_kind_json(kind, data, len);
+      }
+      break;
+    case WORKER_MSG_COMMAND:
+      if (s_handlers.on_command_json != NULL) {
+        s_handlers.on_command_json(data, len);
+      }
+      break;
+  }
+}
+
+// Takes ownership of data.
+static void mqtt_deliver(worker_msg_type_t type,
+                         const char *kind,
+                         char *data,
+                         size_t len)
+{
+#if CONFIG_ROBOT_MQTT_WORKER
+  (void)worker_post(type, kind, data, len, s_rx_started_us);
+#else
+  mqtt_dispatch(type, kind, data, len, s_rx_started_us);
+  free(data);
+#endif
+}
+
 static void mqtt_handle_data(const esp_mqtt_event_handle_t event)
 {
   ESP_LOGD(TAG, "MQTT_EVENT_DATA len=%d total=%d off=%d", event->data_len,
            event->total_data_len, event->current_data_offset);
 
-  if (s_handlers.on_command_json == NULL) {
+  if (s_handlers.on_command_json == NULL &&
+      s_handlers.on_config_json == NULL &&
+      s_handlers.on_command_kind_json == NULL) {
     return;
   }
 
+  if (event->current_data_offset == 0) {
+    s_rx_started_us = esp_timer_get_time();
+    mqtt_match_kind_topic(event);
+    if (event->total_data_len == 0 && mqtt_has_config_topic() &&
+        mqtt_topic_equals(event, CONFIG_ROBOT_MQTT_CONFIG_TOPIC)) {
+      mqtt_deliver(WORKER_MSG_CONFIG, NULL, NULL, 0u);
+      return;
+    }
+    if (s_rx_kind[0] != '\0' && event->total_data_len == 0 &&
+        s_handlers.on_command_kind_json != NULL) {
+      mqtt_deliver(WORKER_MSG_KIND, s_rx_kind, NULL, 0u);
+      return;
+    }
+  }
+
   if (event->total_data_len <= 0 || event->data_len <= 0) {
     return;
   }
@@ -82,6 +406,10 @@ static void mqtt_handle_data(const esp_mqtt_event_handle_t event)
       s_rx_expected_len = 0u;
     }
 
+    // The topic is only present on the first chunk of a message.
+    s_rx_is_config = mqtt_has_config_topic() &&
+                     mqtt_topic_equals(event, CONFIG_ROBOT_MQTT_CONFIG_TOPIC);
+
     size_t total = (size_t)event->total_data_len;
     const size_t kMaxJsonLen = 8192u;
     if (total == 0u || total > kMaxJsonLen) {
@@ -131,8 +459,13 @@ static void mqtt_handle_data(const esp_mqtt_event_handle_t event)
   s_rx_buffer_len += (size_t)event->data_len;
 
   if (s_rx_buffer_len == s_rx_expected_len) {
-    s_handlers.on_command_json(s_rx_buffer, s_rx_buffer_len);
-    free(s_rx_buffer);
+    worker_msg_type_t type = WORKER_MSG_COMMAND;
+    if (s_rx_is_config) {
+      type = WORKER_MSG_CONFIG;
+    } else if (s_rx_kind[0] != '\0') {
+      type = WORKER_MSG_KIND;
+    }
+    mqtt_deliver(type, s_rx_kind, s_rx_buffer, s_rx_buffer_len);
     s_rx_buffer = NULL;
     s_rx_buffer_len = 0u;
     s_rx_expected_len = 0u;
@@ -169,6 +502,18 @@ void mqtt_set_handlers(const mqtt_handlers_t *handlers)
   }
 }
 
+void mqtt_set_ca_cert(const char *pem)
+{
+  s_ca_cert = pem;
+}
+
+void mqtt_forget_tls_session(void)
+{
+#if CONFIG_ROBOT_MQTT_TLS_RESUMPTION
+  tls_transport_forget_session();
+#endif
+}
+
 /*
  * @brief Event handler registered to receive MQTT events
  *
@@ -187,6 +532,9 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
   esp_mqtt_event_handle_t event = event_data;
   esp_mqtt_client_handle_t client = event->client;
   switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_BEFORE_CONNECT:
+      mqtt_handle_before_connect();
+      break;
     case MQTT_EVENT_CONNECTED:
       mqtt_handle_connected(client);
       break;
@@ -215,14 +563,103 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
   }
 }
 
+/*
+ * Hand up to CONFIG_ROBOT_MQTT_OUTBOX_DRAIN_BURST stored messages to the
+ * client per period. esp_mqtt_client_enqueue() does not block on the
+ * network, so this is safe to run from the esp_timer task.
+ */
+static void mqtt_drain_outbox(void *arg)
+{
+  static char data[CONFIG_ROBOT_MQTT_OUTBOX_SLOT_SIZE];
+
+  for (int i = 0; i < CONFIG_ROBOT_MQTT_OUTBOX_DRAIN_BURST; ++i) {
+    if (!s_connected) {
+      return;
+    }
+
+    mqtt_priority_t priority;
+    const char *topic;
+    int qos;
+    size_t len;
+    size_t slot;
+    if (!outbox_take(&priority, &topic, &qos, data, &len, &slot)) {
+      // A push racing with the stop finds the timer still active and
+      // leaves it alone, so look again once it is stopped.
+      (void)esp_timer_stop(s_drain_timer);
+      if (!outbox_is_empty()) {
+        mqtt_arm_drain();
+      }
+      return;
+    }
+
+    int msg_id = esp_mqtt_client_enqueue(s_client, topic, data, (int)len,
+                                         qos, 0, true);
+    // When the client outbox is full the message keeps its place and is
+    // retried next period.
+    outbox_release(slot, msg_id >= 0);
+    if (msg_id < 0) {
+      return;
+    }
+  }
+}
+
 void mqtt_init(void) {
+  broker_list_init();
+
   esp_mqtt_client_config_t mqtt_cfg = {
-      .broker.address.uri = CONFIG_BROKER_URL,
+      .broker.address.uri = broker_current_uri(),
       .credentials.username = CONFIG_BROKER_USERNAME,
       .credentials.authentication.password = CONFIG_BROKER_PASSWORD,
-      .session.keepalive = 10
+      .session.keepalive = 10,
+      .network.reconnect_timeout_ms = CONFIG_ROBOT_MQTT_RECONNECT_MS,
+      .task.priority = CONFIG_ROBOT_MQTT_TASK_PRIORITY,
+      .task.stack_size = CONFIG_ROBOT_MQTT_TASK_STACK_SIZE,
   };
 
+#if CONFIG_ROBOT_MQTT_WORKER
+  if (!worker_init(mqtt_dispatch)) {
+    ESP_LOGE(TAG, "Worker unavailable, messages will be dropped");
+  }
+#endif
+
+#if CONFIG_ROBOT_MQTT_CONFIG_CACHE
+  // Apply the last known config before the network is up so the robot is
+  // drive-ready without waiting for the broker.
+  if (mqtt_has_config_topic()) {
+    char *cached = NULL;
+    size_t cached_len = 0u;
+    if (config_cache_load(&cached, &cached_len)) {
+      if (mqtt_is_config_document(cached, cached_len)) {
+        ESP_LOGI(TAG, "Applying cached config (%u bytes)",
+                 (unsigned)cached_len);
+        mqtt_deliver_config(cached, cached_len, MQTT_CONFIG_SOURCE_CACHE);
+      } else {
+        ESP_LOGW(TAG, "Cached config is not a config document, erasing");
+        config_cache_erase();
+      }
+      free(cached);
+    }
+  }
+#endif
+
+  const esp_timer_create_args_t drain_timer_args = {
+      .callback = mqtt_drain_outbox,
+      .name = "mqtt_outbox",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&drain_timer_args, &s_drain_timer));
+
+#if CONFIG_ROBOT_MQTT_TLS_RESUMPTION
+  // esp-mqtt uses a custom transport for every broker, so only take over
+  // when the whole failover list is mqtts://.
+  if (broker_all_tls()) {
+    mqtt_cfg.network.transport = tls_transport_create(s_ca_cert);
+    if (mqtt_cfg.network.transport == NULL) {
+      ESP_LOGE(TAG, "TLS transport unavailable, using esp-mqtt's own");
+    }
+  }
+#endif
+
+  s_offline_since_us = esp_timer_get_time();
   s_client = esp_mqtt_client_init(&mqtt_cfg);
   esp_mqtt_client_register_event(s_client,
                                  ESP_EVENT_ANY_ID,
@@ -231,19 +668,44 @@ void mqtt_init(void) {
   esp_mqtt_client_start(s_client);
 }
 
-void mqtt_publish_debug(const char *payload)
+static void mqtt_publish_len(mqtt_priority_t priority,
+                             const char *topic,
+                             int qos,
+                             const char *data,
+                             size_t len)
 {
-  if (s_client == NULL || payload == NULL) {
+  if (data == NULL || len == 0u) {
+    return;
+  }
+
+  // Publish directly only when nothing older is waiting, so that per-class
+  // ordering is preserved while the outbox drains.
+  if (s_client != NULL && s_connected && outbox_is_empty() &&
+      esp_mqtt_client_publish(s_client, topic, data, (int)len, qos, 0) >= 0) {
     return;
   }
 
+  // Offline, behind older messages, or rejected by the client.
+  if (outbox_push(priority, topic, qos, data, len)) {
+    mqtt_arm_drain();
+  }
+}
+
+static void mqtt_publish(mqtt_priority_t priority,
+                         const char *topic,
+                         int qos,
+                         const char *payload)
+{
+  if (payload == NULL) {
+    return;
+  }
+  mqtt_publish_len(priority, topic, qos, payload, strlen(payload));
+}
+
+void mqtt_publish_debug(const char *payload)
+{
   // QoS0, non-retained debug message on robot/debug
-  (void)esp_mqtt_client_publish(s_client,
-                                "robot/debug",
-                                payload,
-                                0,
-                                0,
-                                0);
+  mqtt_publish(MQTT_PRIORITY_DEBUG, "robot/debug", 0, payload);
 }
 
 void mqtt_publish_command(const char *payload)
@@ -260,3 +722,56 @@ void mqtt_publish_command(const char *payload)
                                 1,
                                 0);
 }
+
+void mqtt_publish_telemetry(const char *payload)
+{
+  mqtt_publish(MQTT_PRIORITY_TELEMETRY,
+               CONFIG_ROBOT_MQTT_TELEMETRY_TOPIC,
+               0,
+               payload);
+}
+
+void mqtt_publish_binary_telemetry(const void *data, size_t len)
+{
+  mqtt_publish_len(MQTT_PRIORITY_TELEMETRY,
+                   CONFIG_ROBOT_MQTT_BINARY_TELEMETRY_TOPIC,
+                   0,
+                   (const char *)data,
+                   len);
+}
+
+void mqtt_publish_ack(const char *payload)
+{
+  mqtt_publish(MQTT_PRIORITY_ACK, CONFIG_ROBOT_MQTT_ACK_TOPIC, 1, payload);
+}
+
+void mqtt_get_outbox_stats(mqtt_outbox_stats_t *stats)
+{
+  outbox_get_stats(stats);
+}
+
+void mqtt_get_boot_metrics(mqtt_boot_metrics_t *metrics)
+{
+  if (metrics != NULL) {
+    *metrics = s_boot_metrics;
+  }
+}
+
+void mqtt_get_connect_stats(mqtt_connect_stats_t *stats)
+{
+  if (stats != NULL) {
+    *stats = s_connect_stats;
+  }
+}
+
+void mqtt_get_worker_stats(mqtt_worker_stats_t *stats)
+{
+  if (stats != NULL) {
+    worker_get_stats(stats);
+  }
+}
+
+int64_t mqtt_get_rx_timestamp_us(void)
+{
+  return s_dispatch_rx_us;
+}
@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+
+#include "outbox.h"
+
+static const char *TAG = "mqtt_outbox";
+
+// Slots are reserved and released under s_lock, but payloads are copied
+// outside it: WRITING and TAKEN slots are owned by one caller and are
+// never evicted or popped.
+typedef enum {
+  SLOT_FREE = 0,
+  SLOT_WRITING, // reserved by outbox_push(), payload being copied in
+  SLOT_READY,
+  SLOT_TAKEN,   // handed out by outbox_take(), awaiting outbox_release()
+} slot_state_t;
+
+typedef struct {
+  slot_state_t state;
+  mqtt_priority_t priority;
+  const char *topic;
+  int qos;
+  uint32_t seq;
+  size_t len;
+  char data[CONFIG_ROBOT_MQTT_OUTBOX_SLOT_SIZE];
+} outbox_slot_t;
+
+static outbox_slot_t s_slots[CONFIG_ROBOT_MQTT_OUTBOX_SLOTS];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_next_seq = 0u;
+static mqtt_outbox_stats_t s_stats;
+
+// Lower enum value == higher priority. Returns true if a should drain
+// before b.
+static bool slot_before(const outbox_slot_t *a, const outbox_slot_t *b)
+{
+  if (a->priority != b->priority) {
+    return a->priority < b->priority;
+  }
+  return (int32_t)(a->seq - b->seq) < 0;
+}
+
+// Must be called with s_lock held.
+static outbox_slot_t *find_slot_for(mqtt_priority_t priority)
+{
+  outbox_slot_t *victim = NULL;
+
+  for (size_t i = 0u; i < CONFIG_ROBOT_MQTT_OUTBOX_SLOTS; ++i) {
+    if (s_slots[i].state == SLOT_FREE) {
+      return &s_slots[i];
+    }
+    if (s_slots[i].state != SLOT_READY) {
+      continue;
+    }
+    // Evict the oldest entry of the lowest priority class.
+    if (victim == NULL ||
+        s_slots[i].priority > victim->priority ||
+        (s_slots[i].priority == victim->priority &&
+         (int32_t)(s_slots[i].seq - victim->seq) < 0)) {
+      victim = &s_slots[i];
+    }
+  }
+
+  if (victim == NULL || victim->priority < priority) {
+    return NULL;
+  }
+  victim->state = SLOT_FREE;
+  s_stats.dropped++;
+  s_stats.depth--;
+  return victim;
+}
+
+bool outbox_push(mqtt_priority_t priority,
+                 const char *topic,
+                 int qos,
+                 const char *data,
+                 size_t len)
+{
+  if (len > CONFIG_ROBOT_MQTT_OUTBOX_SLOT_SIZE) {
+    portENTER_CRITICAL(&s_lock);
+    s_stats.dropped++;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGW(TAG, "Payload too large for outbox (len=%u)", (unsigned)len);
+    return false;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  outbox_slot_t *slot = find_slot_for(priority);
+  if (slot == NULL) {
+    s_stats.dropped++;
+    portEXIT_CRITICAL(&s_lock);
+    return false;
+  }
+  slot->state = SLOT_WRITING;
+  slot->priority = priority;
+  slot->topic = topic;
+  slot->qos = qos;
+  slot->seq = s_next_seq++;
+  slot->len = len;
+  s_stats.queued++;
+  s_stats.depth++;
+  portEXIT_CRITICAL(&s_lock);
+
+  memcpy(slot->data, data, len);
+
+  portENTER_CRITICAL(&s_lock);
+  slot->state = SLOT_READY;
+  portEXIT_CRITICAL(&s_lock);
+  return true;
+}
+
+bool outbox_take(mqtt_priority_t *priority,
+                 const char **topic,
+                 int *qos,
+                 char *data,
+                 size_t *len,
+                 size_t *slot)
+{
+  portENTER_CRITICAL(&s_lock);
+  outbox_slot_t *next = NULL;
+  for (size_t i = 0u; i < CONFIG_ROBOT_MQTT_OUTBOX_SLOTS; ++i) {
+    if (s_slots[i].state == SLOT_READY &&
+        (next == NULL || slot_before(&s_slots[i], next))) {
+      next = &s_slots[i];
+    }
+  }
+  if (next == NULL) {
+    portEXIT_CRITICAL(&s_lock);
+    return false;
+  }
+  next->state = SLOT_TAKEN;
+  portEXIT_CRITICAL(&s_lock);
+
+  *priority = next->priority;
+  *topic = next->topic;
+  *qos = next->qos;
+  *len = next->len;
+  *slot = (size_t)(next - s_slots);
+  memcpy(data, next->data, next->len);
+  return true;
+}
+
+void outbox_release(size_t slot, bool sent)
+{
+  if (slot >= CONFIG_ROBOT_MQTT_OUTBOX_SLOTS) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  if (sent) {
+    s_slots[slot].state = SLOT_FREE;
+    s_stats.depth--;
+    s_stats.drained++;
+  } else {
+    s_slots[slot].state = SLOT_READY;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+bool outbox_is_empty(void)
+{
+  portENTER_CRITICAL(&s_lock);
+  bool empty = (s_stats.depth == 0u);
+  portEXIT_CRITICAL(&s_lock);
+  return empty;
+}
+
+void outbox_get_stats(mqtt_outbox_stats_t *stats)
+{
+  if (stats == NULL) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  *stats = s_stats;
+  portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../include/mqtt.h"
+
+// Bounded RAM store-and-forward queue used while the client is offline or
+// rejects a publish.
+// Topics are stored by pointer and must have static storage duration.
+
+// Copy a message into the outbox. Returns false if it was dropped.
+bool outbox_push(mqtt_priority_t priority,
+                 const char *topic,
+                 int qos,
+                 const char *data,
+                 size_t len);
+
+// Copy the oldest message of the highest priority class into data (which
+// must hold CONFIG_ROBOT_MQTT_OUTBOX_SLOT_SIZE bytes). Its slot stays
+// reserved until outbox_release(). Returns false when nothing is ready.
+bool outbox_take(mqtt_priority_t *priority,
+                 const char **topic,
+                 int *qos,
+                 char *data,
+                 size_t *len,
+                 size_t *slot);
+
+// Free a taken slot once its message was handed to the client, or return
+// it with its original position in the drain order if it was not.
+void outbox_release(size_t slot, bool sent);
+
+bool outbox_is_empty(void);
+
+void outbox_get_stats(mqtt_outbox_stats_t *stats);
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_transport.h"
+#include "esp_transport_tcp.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "nvs.h"
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+#include "tls_transport.h"
+
+#if CONFIG_ROBOT_MQTT_TLS_RESUMPTION
+
+static const char *TAG = "mqtt_tls";
+
+#define TLS_DEFAULT_PORT      8883
+#define TLS_PEER_MAX_LEN      136 // "<host>:<port>"
+#define TLS_MASTER_LEN        48
+#define TLS_SESSION_MAX_LEN   4096
+#define TLS_SESSION_NAMESPACE "robot_mqtt"
+#define TLS_SESSION_KEY       "tls_session"
+
+typedef struct {
+  esp_transport_handle_t tcp;
+  int timeout_ms; // bound for each TCP read or write of the current call
+  bool ssl_active;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_x509_crt ca;
+  // Master secret of the handshake in progress. A TLS 1.2 resumption
+  // reuses the cached session's master secret; a full handshake makes a
+  // new one.
+  uint8_t master[TLS_MASTER_LEN];
+  bool master_valid;
+} tls_ctx_t;
+
+// NVS layout: this header, then mbedtls_ssl_session_save() output.
+typedef struct {
+  char peer[TLS_PEER_MAX_LEN];
+  uint8_t master[TLS_MASTER_LEN];
+} tls_stored_header_t;
+
+// The one cached session and the broker it belongs to.
+static mbedtls_ssl_session s_session;
+static bool s_session_valid = false;
+static tls_stored_header_t s_session_header;
+
+static volatile bool s_forget_session = false;
+
+static tls_transport_handshake_t s_handshake;
+static bool s_handshake_pending = false;
+
+static void tls_export_keys(void *data,
+                            mbedtls_ssl_key_export_type type,
+                            const unsigned char *secret,
+                            size_t secret_len,
+                            const unsigned char client_random[32],
+                            const unsigned char server_random[32],
+                            mbedtls_tls_prf_types tls_prf_type)
+{
+  tls_ctx_t *ctx = data;
+  if (type == MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET &&
+      secret_len == TLS_MASTER_LEN) {
+    memcpy(ctx->master, secret, TLS_MASTER_LEN);
+    ctx->master_valid = true;
+  }
+}
+
+static int tls_bio_send(void *data, const unsigned char *buf, size_t len)
+{
+  tls_ctx_t *ctx = data;
+  int ret = esp_transport_write(ctx->tcp, (const char *)buf, (int)len,
+                                ctx->timeout_ms);
+  if (ret > 0) {
+    return ret;
+  }
+  return (ret == 0) ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+static int tls_bio_recv(void *data, unsigned char *buf, size_t len)
+{
+  tls_ctx_t *ctx = data;
+  int ret = esp_transport_read(ctx->tcp, (char *)buf, (int)len,
+                               ctx->timeout_ms);
+  if (ret > 0) {
+    return ret;
+  }
+  return (ret == 0) ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+#if CONFIG_ROBOT_MQTT_TLS_SESSION_NVS
+static void tls_session_erase_nvs(void)
+{
+  nvs_handle_t nvs;
+  if (nvs_open(TLS_SESSION_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+    return;
+  }
+  if (nvs_erase_key(nvs, TLS_SESSION_KEY) == ESP_OK) {
+    (void)nvs_commit(nvs);
+  }
+  nvs_close(nvs);
+}
+
+static void tls_session_load_nvs(void)
+{
+  nvs_handle_t nvs;
+  if (nvs_open(TLS_SESSION_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+    return;
+  }
+  size_t size = 0u;
+  esp_err_t err = nvs_get_blob(nvs, TLS_SESSION_KEY, NULL, &size);
+  if (err != ESP_OK || size <= sizeof(tls_stored_header_t) ||
+      size > sizeof(tls_stored_header_t) + TLS_SESSION_MAX_LEN) {
+    nvs_close(nvs);
+    return;
+  }
+  uint8_t *blob = malloc(size);
+  if (blob == NULL) {
+    nvs_close(nvs);
+    return;
+  }
+  err = nvs_get_blob(nvs, TLS_SESSION_KEY, blob, &size);
+  nvs_close(nvs);
+
+  const tls_stored_header_t *header = (const tls_stored_header_t *)blob;
+  if (err == ESP_OK &&
+      memchr(header->peer, '\0', sizeof(header->peer)) != NULL &&
+      mbedtls_ssl_session_load(&s_session, blob + sizeof(*header),
+                               size - sizeof(*header)) == 0) {
+    s_session_header = *header;
+    s_session_valid = true;
+    ESP_LOGI(TAG, "Loaded TLS session for %s", s_session_header.peer);
+  } else {
+    // Saved by a build with a different mbedtls configuration.
+    ESP_LOGW(TAG, "Stored TLS session unusable, erasing");
+    mbedtls_ssl_session_free(&s_session);
+    mbedtls_ssl_session_init(&s_session);
+    tls_session_erase_nvs();
+  }
+  free(blob);
+}
+
+// Writes only when the session changed: a broker that resumes by session
+// id hands back the same session on every reconnect.
+static void tls_session_store_nvs(void)
+{
+  size_t len = 0u;
+  (void)mbedtls_ssl_session_save(&s_session, NULL, 0u, &len);
+  if (len == 0u || len > TLS_SESSION_MAX_LEN) {
+    return;
+  }
+  size_t size = sizeof(tls_stored_header_t) + len;
+  uint8_t *blob = malloc(size);
+  uint8_t *stored = malloc(size);
+  if (blob == NULL || stored == NULL ||
+      mbedtls_ssl_session_save(&s_session, blob + sizeof(tls_stored_header_t),
+                               len, &len) != 0) {
+    free(blob);
+    free(stored);
+    return;
+  }
+  memcpy(blob, &s_session_header, sizeof(tls_stored_header_t));
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(TLS_SESSION_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    size_t stored_size = size;
+    bool same = nvs_get_blob(nvs, TLS_SESSION_KEY, stored, &stored_size) ==
+                    ESP_OK &&
+                stored_size == size && memcmp(stored, blob, size) == 0;
+    if (!same) {
+      err = nvs_set_blob(nvs, TLS_SESSION_KEY, blob, size);
+      if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+      }
+    }
+    nvs_close(nvs);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to store TLS session: %s", esp_err_to_name(err));
+  }
+  free(blob);
+  free(stored);
+}
+#endif
+
+static void tls_session_keep(tls_ctx_t *ctx, const char *peer)
+{
+  mbedtls_ssl_session_free(&s_session);
+  mbedtls_ssl_session_init(&s_session);
+  s_session_valid = ctx->master_valid &&
+                    mbedtls_ssl_get_session(&ctx->ssl, &s_session) == 0;
+  if (!s_session_valid) {
+    return;
+  }
+  snprintf(s_session_header.peer, sizeof(s_session_header.peer), "%s", peer);
+  memcpy(s_session_header.master, ctx->master, TLS_MASTER_LEN);
+#if CONFIG_ROBOT_MQTT_TLS_SESSION_NVS
+  tls_session_store_nvs();
+#endif
+}
+
+static void tls_session_drop(void)
+{
+  mbedtls_ssl_session_free(&s_session);
+  mbedtls_ssl_session_init(&s_session);
+  s_session_valid = false;
+#if CONFIG_ROBOT_MQTT_TLS_SESSION_NVS
+  tls_session_erase_nvs();
+#endif
+}
+
+// Sessions are only touched from the esp-mqtt task, in tls_connect().
+void tls_transport_forget_session(void)
+{
+  s_forget_session = true;
+}
+
+static void tls_teardown(tls_ctx_t *ctx)
+{
+  if (ctx->ssl_active) {
+    ctx->timeout_ms = 0;
+    (void)mbedtls_ssl_close_notify(&ctx->ssl);
+    mbedtls_ssl_free(&ctx->ssl);
+    ctx->ssl_active = false;
+  }
+  (void)esp_transport_close(ctx->tcp);
+}
+
+static int tls_connect(esp_transport_handle_t t,
+                       const char *host,
+                       int port,
+                       int timeout_ms)
+{
+  tls_ctx_t *ctx = esp_transport_get_context_data(t);
+  tls_teardown(ctx);
+  s_handshake_pending = false;
+  if (s_forget_session) {
+    s_forget_session = false;
+    tls_session_drop();
+  }
+
+  if (esp_transport_connect(ctx->tcp, host, port, timeout_ms) < 0) {
+    return -1;
+  }
+
+  int64_t start_us = esp_timer_get_time();
+  mbedtls_ssl_init(&ctx->ssl);
+  ctx->ssl_active = true;
+  ctx->master_valid = false;
+  ctx->timeout_ms = timeout_ms;
+  int ret = mbedtls_ssl_setup(&ctx->ssl, &ctx->conf);
+  if (ret == 0) {
+    ret = mbedtls_ssl_set_hostname(&ctx->ssl, host);
+  }
+  if (ret != 0) {
+    ESP_LOGE(TAG, "TLS setup failed: -0x%04x", (unsigned)-ret);
+    tls_teardown(ctx);
+    return -1;
+  }
+  mbedtls_ssl_set_bio(&ctx->ssl, ctx, tls_bio_send, tls_bio_recv, NULL);
+  mbedtls_ssl_set_export_keys_cb(&ctx->ssl, tls_export_keys, ctx);
+
+  char peer[TLS_PEER_MAX_LEN];
+  snprintf(peer, sizeof(peer), "%s:%d", host, port);
+  bool offered = s_session_valid &&
+                 strcmp(peer, s_session_header.peer) == 0 &&
+                 mbedtls_ssl_set_session(&ctx->ssl, &s_session) == 0;
+
+  while ((ret = mbedtls_ssl_handshake(&ctx->ssl)) != 0) {
+    bool again = ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                 ret == MBEDTLS_ERR_SSL_WANT_WRITE;
+    if (!again ||
+        esp_timer_get_time() - start_us > (int64_t)timeout_ms * 1000) {
+      ESP_LOGE(TAG, "TLS handshake with %s failed: -0x%04x", peer,
+               (unsigned)-ret);
+      tls_teardown(ctx);
+      if (offered) {
+        // In case the broker chokes on the session rather than refusing
+        // it; the next attempt runs a full handshake.
+        tls_session_drop();
+      }
+      return -1;
+    }
+  }
+
+  s_handshake.offered = offered;
+  s_handshake.resumed = offered && ctx->master_valid &&
+                        memcmp(ctx->master, s_session_header.master,
+                               TLS_MASTER_LEN) == 0;
+  s_handshake.handshake_us = esp_timer_get_time() - start_us;
+  s_handshake_pending = true;
+  ESP_LOGI(TAG, "TLS handshake with %s: %lldus%s", peer,
+           (long long)s_handshake.handshake_us,
+           s_handshake.resumed ? ", resumed"
+                               : (offered ? ", resumption refused" : ""));
+
+  // Also after a resumption, which may come with a fresh ticket.
+  tls_session_keep(ctx, peer);
+  return 0;
+}
+
+static int tls_read(esp_transport_handle_t t,
+                    char *buffer,
+                    int len,
+                    int timeout_ms)
+{
+  tls_ctx_t *ctx = esp_transport_get_context_data(t);
+  if (!ctx->ssl_active) {
+    return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+  }
+  if (mbedtls_ssl_get_bytes_avail(&ctx->ssl) == 0u) {
+    int poll = esp_transport_poll_read(ctx->tcp, timeout_ms);
+    if (poll <= 0) {
+      return (poll == 0) ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT
+                         : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+  }
+
+  ctx->timeout_ms = timeout_ms;
+  int ret = mbedtls_ssl_read(&ctx->ssl, (unsigned char *)buffer, (size_t)len);
+  if (ret > 0) {
+    return ret;
+  }
+  if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+  }
+  if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+    return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+  }
+  ESP_LOGW(TAG, "TLS read failed: -0x%04x", (unsigned)-ret);
+  return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+}
+
+static int tls_write(esp_transport_handle_t t,
+                     const char *buffer,
+                     int len,
+                     int timeout_ms)
+{
+  tls_ctx_t *ctx = esp_transport_get_context_data(t);
+  if (!ctx->ssl_active) {
+    return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+  }
+  int poll = esp_transport_poll_write(ctx->tcp, timeout_ms);
+  if (poll <= 0) {
+    return (poll == 0) ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT
+                       : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+  }
+
+  ctx->timeout_ms = timeout_ms;
+  int ret = mbedtls_ssl_write(&ctx->ssl, (const unsigned char *)buffer,
+                              (size_t)len);
+  if (ret >= 0) {
+    return ret;
+  }
+  if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+  }
+  ESP_LOGW(TAG, "TLS write failed: -0x%04x", (unsigned)-ret);
+  return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+}
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+  tls_ctx_t *ctx = esp_transport_get_context_data(t);
+  if (ctx->ssl_active && mbedtls_ssl_get_bytes_avail(&ctx->ssl) > 0u) {
+    return 1;
+  }
+  return esp_transport_poll_read(ctx->tcp, timeout_ms);
+}
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+  tls_ctx_t *ctx = esp_transport_get_context_data(t);
+  return esp_transport_poll_write(ctx->tcp, timeout_ms);
+}
+
+static int tls_close(esp_transport_handle_t t)
+{
+  tls_teardown(esp_transport_get_context_data(t));
+  return 0;
+}
+
+static void tls_ctx_free(tls_ctx_t *ctx)
+{
+  if (ctx->tcp != NULL) {
+    esp_transport_destroy(ctx->tcp);
+  }
+  mbedtls_ssl_config_free(&ctx->conf);
+  mbedtls_x509_crt_free(&ctx->ca);
+  mbedtls_ctr_drbg_free(&ctx->drbg);
+  mbedtls_entropy_free(&ctx->entropy);
+  free(ctx);
+}
+
+// esp_transport_destroy() frees t itself after this returns.
+static int tls_destroy(esp_transport_handle_t t)
+{
+  tls_ctx_t *ctx = esp_transport_get_context_data(t);
+  tls_teardown(ctx);
+  tls_ctx_free(ctx);
+  return 0;
+}
+
+static bool tls_config_init(tls_ctx_t *ctx, const char *ca_pem)
+{
+  mbedtls_ssl_config_init(&ctx->conf);
+  mbedtls_x509_crt_init(&ctx->ca);
+  mbedtls_entropy_init(&ctx->entropy);
+  mbedtls_ctr_drbg_init(&ctx->drbg);
+
+  int ret = mbedtls_ctr_drbg_seed(&ctx->drbg, mbedtls_entropy_func,
+                                  &ctx->entropy, NULL, 0u);
+  if (ret == 0) {
+    ret = mbedtls_ssl_config_defaults(&ctx->conf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT);
+  }
+  if (ret != 0) {
+    ESP_LOGE(TAG, "TLS config failed: -0x%04x", (unsigned)-ret);
+    return false;
+  }
+  mbedtls_ssl_conf_rng(&ctx->conf, mbedtls_ctr_drbg_random, &ctx->drbg);
+  mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&ctx->conf,
+                                   MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+  if (ca_pem != NULL) {
+    ret = mbedtls_x509_crt_parse(&ctx->ca, (const unsigned char *)ca_pem,
+                                 strlen(ca_pem) + 1u);
+    if (ret != 0) {
+      ESP_LOGE(TAG, "Invalid CA certificate: -0x%04x", (unsigned)-ret);
+      return false;
+    }
+    mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->ca, NULL);
+    return true;
+  }
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+  return esp_crt_bundle_attach(&ctx->conf) == ESP_OK;
+#else
+  ESP_LOGE(TAG, "No CA certificate set and the certificate bundle is "
+                "disabled (CONFIG_MBEDTLS_CERTIFICATE_BUNDLE)");
+  return false;
+#endif
+}
+
+esp_transport_handle_t tls_transport_create(const char *ca_pem)
+{
+  tls_ctx_t *ctx = calloc(1u, sizeof(tls_ctx_t));
+  if (ctx == NULL) {
+    return NULL;
+  }
+  if (!tls_config_init(ctx, ca_pem)) {
+    tls_ctx_free(ctx);
+    return NULL;
+  }
+
+  ctx->tcp = esp_transport_tcp_init();
+  esp_transport_handle_t t = (ctx->tcp != NULL) ? esp_transport_init() : NULL;
+  if (t == NULL) {
+    tls_ctx_free(ctx);
+    return NULL;
+  }
+
+  esp_transport_set_context_data(t, ctx);
+  esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close,
+                         tls_poll_read, tls_poll_write, tls_destroy);
+  esp_transport_set_default_port(t, TLS_DEFAULT_PORT);
+
+  if (!s_session_valid) {
+    mbedtls_ssl_session_init(&s_session);
+#if CONFIG_ROBOT_MQTT_TLS_SESSION_NVS
+    tls_session_load_nvs();
+#endif
+  }
+  return t;
+}
+
+bool tls_transport_take_handshake(tls_transport_handshake_t *handshake)
+{
+  if (!s_handshake_pending) {
+    return false;
+  }
+  s_handshake_pending = false;
+  if (handshake != NULL) {
+    *handshake = s_handshake;
+  }
+  return true;
+}
+
+#endif
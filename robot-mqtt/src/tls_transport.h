@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_transport.h"
+
+// TLS transport for mqtts:// brokers that resumes the last session on the
+// next connect (CONFIG_ROBOT_MQTT_TLS_RESUMPTION). esp-mqtt's own SSL
+// transport creates a fresh esp-tls context for every connect and gives
+// no access to the session, so this one runs mbedtls over a plain TCP
+// transport. One session is cached, in RAM and optionally in NVS
+// (CONFIG_ROBOT_MQTT_TLS_SESSION_NVS), for the broker it was made with.
+
+typedef struct {
+  bool offered;         // a cached session was offered to the broker
+  bool resumed;         // the broker accepted it
+  int64_t handshake_us; // TLS handshake only, after the TCP connect
+} tls_transport_handshake_t;
+
+// Certificates are checked against ca_pem (NUL-terminated PEM, must stay
+// valid) or, when NULL, the certificate bundle. Returns NULL on failure.
+esp_transport_handle_t tls_transport_create(const char *ca_pem);
+
+// Result of the last successful handshake, once. Returns false if there
+// has been none since the previous call.
+bool tls_transport_take_handshake(tls_transport_handshake_t *handshake);
+
+// Drop the cached session, in RAM and NVS, when the next connect starts,
+// so that it runs a full handshake. Safe to call from any task.
+void tls_transport_forget_session(void);
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "worker.h"
+
+static const char *TAG = "mqtt_worker";
+
+typedef struct {
+  worker_msg_type_t type;
+  char kind[WORKER_KIND_MAX];
+  char *data;
+  size_t len;
+  int64_t rx_us;
+  int64_t posted_us;
+} worker_item_t;
+
+static QueueHandle_t s_queue = NULL;
+static worker_dispatch_t s_dispatch = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_worker_stats_t s_stats;
+
+static void worker_task(void *arg)
+{
+  worker_item_t item;
+  for (;;) {
+    if (xQueueReceive(s_queue, &item, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+
+    uint32_t wait_us = (uint32_t)(esp_timer_get_time() - item.posted_us);
+    portENTER_CRITICAL(&s_lock);
+    s_stats.queue_wait.count++;
+    s_stats.queue_wait.total_us += wait_us;
+    if (wait_us > s_stats.queue_wait.max_us) {
+      s_stats.queue_wait.max_us = wait_us;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    s_dispatch(item.type, item.kind, item.data, item.len, item.rx_us);
+    free(item.data);
+  }
+}
+
+bool worker_init(worker_dispatch_t dispatch)
+{
+  if (s_queue != NULL) {
+    return true;
+  }
+
+  s_dispatch = dispatch;
+  s_queue = xQueueCreate(CONFIG_ROBOT_MQTT_WORKER_QUEUE_LEN,
+                         sizeof(worker_item_t));
+  if (s_queue == NULL) {
+    ESP_LOGE(TAG, "Failed to create worker queue");
+    return false;
+  }
+
+  const BaseType_t core =
+      (CONFIG_ROBOT_MQTT_WORKER_CORE < 0 ||
+       CONFIG_ROBOT_MQTT_WORKER_CORE >= portNUM_PROCESSORS)
+          ? tskNO_AFFINITY
+          : CONFIG_ROBOT_MQTT_WORKER_CORE;
+  if (xTaskCreatePinnedToCore(worker_task, "mqtt_worker",
+                              CONFIG_ROBOT_MQTT_WORKER_STACK_SIZE, NULL,
+                              CONFIG_ROBOT_MQTT_WORKER_PRIORITY, NULL,
+                              core) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create worker task");
+    vQueueDelete(s_queue);
+    s_queue = NULL;
+    return false;
+  }
+  return true;
+}
+
+bool worker_post(worker_msg_type_t type,
+                 const char *kind,
+                 char *data,
+                 size_t len,
+                 int64_t rx_us)
+{
+  worker_item_t item = {
+      .type = type,
+      .data = data,
+      .len = len,
+      .rx_us = rx_us,
+      .posted_us = esp_timer_get_time(),
+  };
+  if (kind != NULL) {
+    strncpy(item.kind, kind, sizeof(item.kind) - 1u);
+  }
+
+  bool queued = s_queue != NULL && xQueueSend(s_queue, &item, 0) == pdTRUE;
+  UBaseType_t depth = s_queue != NULL ? uxQueueMessagesWaiting(s_queue) : 0u;
+
+  portENTER_CRITICAL(&s_lock);
+  if (queued) {
+    s_stats.posted++;
+    if (depth > s_stats.max_depth) {
+      s_stats.max_depth = depth;
+    }
+  } else {
+    s_stats.dropped++;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (!queued) {
+    ESP_LOGW(TAG, "Worker queue full, message dropped (%u bytes)",
+             (unsigned)len);
+    free(data);
+  }
+  return queued;
+}
+
+void worker_get_stats(mqtt_worker_stats_t *stats)
+{
+  portENTER_CRITICAL(&s_lock);
+  *stats = s_stats;
+  portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/mqtt.h"
+
+// Optional handler task (CONFIG_ROBOT_MQTT_WORKER). Complete messages are
+// queued by the esp-mqtt task and dispatched from the worker.
+
+typedef enum {
+  WORKER_MSG_COMMAND = 0,
+  WORKER_MSG_KIND,
+  WORKER_MSG_CONFIG,
+} worker_msg_type_t;
+
+#define WORKER_KIND_MAX 24
+
+// Called in the worker task for each message. data is released by the
+// worker after the call.
+typedef void (*worker_dispatch_t)(worker_msg_type_t type,
+                                  const char *kind,
+                                  const char *data,
+                                  size_t len,
+                                  int64_t rx_us);
+
+bool worker_init(worker_dispatch_t dispatch);
+
+// Queue a message, taking ownership of data (heap allocated, or NULL when
+// len is 0). Returns false and frees data if the queue is full.
+bool worker_post(worker_msg_type_t type,
+                 const char *kind,
+                 char *data,
+                 size_t len,
+                 int64_t rx_us);
+
+void worker_get_stats(mqtt_worker_stats_t *stats);
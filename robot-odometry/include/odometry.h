@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Wheel velocity from encoder edges.
+//
+// Counting ticks per control period is quantised to one tick per period,
+// which at low speed is most of the signal. Instead, the ISR stamps every
+// edge, and each update divides the ticks since the previous update by the
+// time between the last edge then and the last edge now (M/T method). At
+// high speed this averages many ticks; when at most one tick arrives per
+// period it becomes inter-edge period timing. Between edges, the estimate
+// can only fall: it is bounded by one tick over the time since the last
+// edge, and reaches 0 after stop_timeout_ms without an edge, so the
+// slowest measurable speed is one tick per stop_timeout_ms.
+//
+// The ISR side (odometry_wheel_record) and the control side
+// (odometry_wheel_update) share a single-writer sequence lock, so neither
+// blocks or disables interrupts. Each wheel must have a single writer.
+//
+// Velocities are in micrometres per second; timestamps are the low 32
+// bits of esp_timer_get_time() (or any microsecond clock), which wrap
+// safely as long as updates are less than 35 minutes apart. While
+// stopped, the last edge time is aged with each update, so standstills of
+// any length are fine.
+
+typedef enum {
+  ODOMETRY_SOURCE_STOPPED = 0, // no edge within stop_timeout_ms
+  ODOMETRY_SOURCE_EDGES,       // ticks over edge-to-edge time
+  ODOMETRY_SOURCE_COUNT,       // ticks over the update interval (reversal)
+  ODOMETRY_SOURCE_DECAY,       // no new edge; bounded by time since last
+} odometry_source_t;
+
+typedef struct {
+  // Configuration, set by odometry_wheel_init().
+  uint32_t nm_per_tick;
+  uint32_t stop_timeout_us;
+
+  // Written only by odometry_wheel_record().
+  uint32_t seq; // odd while an update is in progress
+  int32_t ticks;
+  uint32_t edge_us;
+  uint32_t reversals;
+  int8_t last_dir;
+
+  // Control-side state, owned by odometry_wheel_update().
+  bool started;
+  int32_t prev_ticks;
+  uint32_t prev_edge_us;
+  uint32_t prev_reversals;
+  uint32_t prev_update_us;
+  int32_t velocity_um_per_s;
+  odometry_source_t source;
+} odometry_wheel_t;
+
+// Returns false if the geometry gives less than 1 nm or more than 4 m of
+// travel per tick.
+bool odometry_wheel_init(odometry_wheel_t *wheel,
+                         float ticks_per_revolution,
+                         float wheel_radius_mm,
+                         uint32_t stop_timeout_ms);
+
+// Record delta_ticks (signed, normally +-1 per edge) observed at edge_us.
+// Safe to call from an ISR (place the caller in IRAM); never blocks.
+// Batched counts (e.g. from PCNT) work too, with edge_us the read time,
+// at the cost of period resolution.
+void odometry_wheel_record(odometry_wheel_t *wheel,
+                           int32_t delta_ticks,
+                           uint32_t edge_us);
+
+// Update and return the velocity estimate, once per control tick.
+int32_t odometry_wheel_update(odometry_wheel_t *wheel, uint32_t now_us);
+
+// Travel since init up to the last update, in micrometres.
+int64_t odometry_wheel_distance_um(const odometry_wheel_t *wheel);
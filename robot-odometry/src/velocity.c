@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "esp_attr.h"
+
+#include "../include/odometry.h"
+
+#define ODOMETRY_PI 3.14159265358979f
+
+typedef struct {
+  int32_t ticks;
+  uint32_t edge_us;
+  uint32_t reversals;
+} edge_snapshot_t;
+
+bool odometry_wheel_init(odometry_wheel_t *wheel,
+                         float ticks_per_revolution,
+                         float wheel_radius_mm,
+                         uint32_t stop_timeout_ms)
+{
+  if (wheel == NULL || !(ticks_per_revolution > 0.0f) ||
+      !(wheel_radius_mm > 0.0f)) {
+    return false;
+  }
+
+  float nm = 2.0f * ODOMETRY_PI * wheel_radius_mm * 1.0e6f /
+             ticks_per_revolution;
+  if (!(nm >= 1.0f && nm < 4.0e9f)) {
+    return false;
+  }
+
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->nm_per_tick = (uint32_t)(nm + 0.5f);
+  wheel->stop_timeout_us = stop_timeout_ms * 1000u;
+  return true;
+}
+
+void IRAM_ATTR odometry_wheel_record(odometry_wheel_t *wheel,
+                                     int32_t delta_ticks,
+                                     uint32_t edge_us)
+{
+  if (delta_ticks == 0) {
+    return;
+  }
+
+  int8_t dir = delta_ticks > 0 ? 1 : -1;
+  uint32_t seq = __atomic_load_n(&wheel->seq, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&wheel->seq, seq + 1u, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __atomic_store_n(&wheel->ticks, wheel->ticks + delta_ticks,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&wheel->edge_us, edge_us, __ATOMIC_RELAXED);
+  if (dir != wheel->last_dir) {
+    if (wheel->last_dir != 0) {
+      __atomic_store_n(&wheel->reversals, wheel->reversals + 1u,
+                       __ATOMIC_RELAXED);
+    }
+    wheel->last_dir = dir;
+  }
+
+  __atomic_store_n(&wheel->seq, seq + 2u, __ATOMIC_RELEASE);
+}
+
+// Consistent copy of the ISR-side fields. Retries only if an edge is being
+// recorded at the same moment, which takes a few instructions.
+static void read_snapshot(const odometry_wheel_t *wheel, edge_snapshot_t *snap)
+{
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = __atomic_load_n(&wheel->seq, __ATOMIC_ACQUIRE);
+    snap->ticks = __atomic_load_n(&wheel->ticks, __ATOMIC_RELAXED);
+    snap->edge_us = __atomic_load_n(&wheel->edge_us, __ATOMIC_RELAXED);
+    snap->reversals = __atomic_load_n(&wheel->reversals, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&wheel->seq, __ATOMIC_RELAXED);
+  } while ((before & 1u) != 0u || before != after);
+}
+
+static int32_t ticks_to_um_per_s(const odometry_wheel_t *wheel,
+                                 int32_t ticks,
+                                 uint32_t interval_us)
+{
+  if (interval_us == 0u) {
+    interval_us = 1u;
+  }
+  // nm * 1e6 / us / 1000 = um/s
+  int64_t um_per_s = (int64_t)ticks * wheel->nm_per_tick * 1000 /
+                     (int64_t)interval_us;
+  if (um_per_s > INT32_MAX) {
+    return INT32_MAX;
+  }
+  if (um_per_s < -INT32_MAX) {
+    return -INT32_MAX;
+  }
+  return (int32_t)um_per_s;
+}
+
+int32_t odometry_wheel_update(odometry_wheel_t *wheel, uint32_t now_us)
+{
+  edge_snapshot_t snap;
+  read_snapshot(wheel, &snap);
+
+  if (!wheel->started) {
+    wheel->started = true;
+    wheel->prev_ticks = snap.ticks;
+    wheel->prev_edge_us = snap.ticks != 0 ? snap.edge_us : now_us;
+    wheel->prev_reversals = snap.reversals;
+    wheel->prev_update_us = now_us;
+    wheel->velocity_um_per_s = 0;
+    wheel->source = ODOMETRY_SOURCE_STOPPED;
+    return 0;
+  }
+
+  int32_t ticks = snap.ticks - wheel->prev_ticks;
+  if (ticks != 0) {
+    if (snap.reversals == wheel->prev_reversals) {
+      // After a standstill the previous edge is stale; the first estimate
+      // is then low and is corrected by the next edge.
+      uint32_t interval = snap.edge_us - wheel->prev_edge_us;
+      if (wheel->source == ODOMETRY_SOURCE_STOPPED &&
+          interval > wheel->stop_timeout_us) {
+        interval = wheel->stop_timeout_us;
+      }
+      wheel->velocity_um_per_s = ticks_to_um_per_s(wheel, ticks, interval);
+      wheel->source = ODOMETRY_SOURCE_EDGES;
+    } else {
+      // The direction changed since the last update; edge timing would mix
+      // both directions, so fall back to the net count.
+      wheel->velocity_um_per_s =
+          ticks_to_um_per_s(wheel, ticks, now_us - wheel->prev_update_us);
+      wheel->source = ODOMETRY_SOURCE_COUNT;
+    }
+    wheel->prev_ticks = snap.ticks;
+    wheel->prev_edge_us = snap.edge_us;
+  } else {
+    uint32_t since = now_us - wheel->prev_edge_us;
+    if (since >= wheel->stop_timeout_us || wheel->velocity_um_per_s == 0) {
+      wheel->velocity_um_per_s = 0;
+      wheel->source = ODOMETRY_SOURCE_STOPPED;
+      // Keep the stale edge within stop_timeout_us of now so the unsigned
+      // interval to the next edge cannot wrap during a long standstill.
+      if (since > wheel->stop_timeout_us) {
+        wheel->prev_edge_us = now_us - wheel->stop_timeout_us;
+      }
+    } else {
+      // The next edge is at least `since` away, so the speed is at most
+      // one tick over that time.
+      int32_t bound = ticks_to_um_per_s(wheel, 1, since);
+      int32_t v = wheel->velocity_um_per_s;
+      if (v > bound) {
+        v = bound;
+      } else if (v < -bound) {
+        v = -bound;
+      }
+      wheel->velocity_um_per_s = v;
+      wheel->source = ODOMETRY_SOURCE_DECAY;
+    }
+  }
+
+  wheel->prev_reversals = snap.reversals;
+  wheel->prev_update_us = now_us;
+  return wheel->velocity_um_per_s;
+}
+
+int64_t odometry_wheel_distance_um(const odometry_wheel_t *wheel)
+{
+  return (int64_t)wheel->prev_ticks * wheel->nm_per_tick / 1000;
+}
@@ -0,0 +1,387 @@
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include <cJSON.h>
+
+#include "protocol.h"
+
+/* Worst-case cost harness for protocol_handle_command_json() and
+ * protocol_handle_kind_json(). Each input is measured for wall time and
+ * for the allocations it causes; every protocol allocation goes through
+ * cJSON's hooks, which count them here.
+ *
+ * An input is a message as received on the command topic, or
+ * "@<kind>\n<body>" for an envelope-free body on a kind topic.
+ *
+ * Built normally, the app replays regress/budgets.txt and fails when an
+ * input exceeds its time or allocation budget. Built with FUZZ_LIBFUZZER,
+ * app_main() hands over to libFuzzer and feeds the cost of every input
+ * back as extra coverage, so the corpus climbs towards slow,
+ * allocation-heavy messages rather than only towards new code.
+ */
+
+#define FUZZ_MAX_INPUT (64u * 1024u)
+#define FUZZ_KIND_MAX 32u
+#define FUZZ_REGRESS_RUNS 5u
+#define FUZZ_FUZZ_RUNS 3u
+#define FUZZ_MAX_RUNS 8u
+
+typedef struct {
+  uint64_t ns;        // median over the timed runs
+  uint32_t allocs;    // per delivery
+  size_t peak_bytes;  // most bytes live at once
+} fuzz_cost_t;
+
+static uint32_t s_allocs;
+static size_t s_live_bytes;
+static size_t s_peak_bytes;
+
+static void *counting_malloc(size_t size)
+{
+  void *ptr = malloc(size);
+  if (ptr != NULL) {
+    s_allocs++;
+    s_live_bytes += malloc_usable_size(ptr);
+    if (s_live_bytes > s_peak_bytes) {
+      s_peak_bytes = s_live_bytes;
+    }
+  }
+  return ptr;
+}
+
+static void counting_free(void *ptr)
+{
+  if (ptr != NULL) {
+    size_t size = malloc_usable_size(ptr);
+    s_live_bytes = s_live_bytes > size ? s_live_bytes - size : 0u;
+  }
+  free(ptr);
+}
+
+// Handlers that accept everything, so dispatch runs to the end. Kinds that
+// start long-running work (profile, calibrate, sched_bench) stay without a
+// handler and are rejected; bench is not built (sdkconfig.defaults).
+static void on_drive(const char *direction,
+                     int32_t speed_mm_per_s,
+                     uint32_t duration_ms,
+                     uint32_t distance_mm)
+{
+}
+
+static void on_turn(int32_t radius_mm,
+                    int32_t angle_deg,
+                    int32_t speed_mm_per_s,
+                    uint32_t duration_ms)
+{
+}
+
+static void on_stop(void)
+{
+}
+
+static void on_wait(uint32_t duration_ms)
+{
+}
+
+static void on_wait_until(const protocol_condition_t *condition,
+                          uint32_t timeout_ms)
+{
+}
+
+static void on_branch(protocol_branch_marker_t marker,
+                      const protocol_condition_t *condition)
+{
+}
+
+static void on_led_hsv(uint16_t h, uint8_t s, uint8_t v)
+{
+}
+
+static void on_drive_config(const protocol_drive_config_t *config)
+{
+}
+
+static void on_immediate(float left_frac,
+                         float right_frac,
+                         uint32_t timeout_ms,
+                         uint32_t now_ms,
+                         uint32_t buttons_mask)
+{
+}
+
+static const protocol_handlers_t kHandlers = {
+    .drive = on_drive,
+    .turn = on_turn,
+    .stop = on_stop,
+    .wait = on_wait,
+    .wait_until = on_wait_until,
+    .branch = on_branch,
+    .clear_queue = on_stop,
+    .set_led_hsv = on_led_hsv,
+    .set_drive_config = on_drive_config,
+    .immediate = on_immediate,
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void deliver(const uint8_t *data, size_t size)
+{
+  const char *text = (const char *)data;
+  if (size == 0u || text[0] != '@') {
+    protocol_handle_command_json(text, size);
+    return;
+  }
+
+  const char *newline = memchr(text, '\n', size);
+  if (newline == NULL || newline - text < 2 ||
+      (size_t)(newline - text) > FUZZ_KIND_MAX) {
+    return;
+  }
+  char kind[FUZZ_KIND_MAX];
+  size_t kind_len = (size_t)(newline - text) - 1u;
+  memcpy(kind, text + 1, kind_len);
+  kind[kind_len] = '\0';
+  size_t header = kind_len + 2u;
+  protocol_handle_kind_json(kind, text + header, size - header);
+}
+
+// One untimed warm-up delivery, then runs timed ones. Allocations are
+// counted over the timed runs and reported per delivery.
+static void measure(const uint8_t *data,
+                    size_t size,
+                    uint32_t runs,
+                    fuzz_cost_t *cost)
+{
+  deliver(data, size);
+
+  s_allocs = 0u;
+  s_live_bytes = 0u;
+  s_peak_bytes = 0u;
+  uint64_t samples[FUZZ_MAX_RUNS];
+  for (uint32_t r = 0u; r < runs; ++r) {
+    uint64_t start = now_ns();
+    deliver(data, size);
+    uint64_t ns = now_ns() - start;
+
+    // Insertion sort; runs is small.
+    uint32_t i = r;
+    while (i > 0u && samples[i - 1u] > ns) {
+      samples[i] = samples[i - 1u];
+      --i;
+    }
+    samples[i] = ns;
+  }
+
+  cost->ns = samples[runs / 2u];
+  cost->allocs = s_allocs / runs;
+  cost->peak_bytes = s_peak_bytes;
+}
+
+#if FUZZ_LIBFUZZER
+
+int LLVMFuzzerRunDriver(int *argc,
+                        char ***argv,
+                        int (*callback)(const uint8_t *data, size_t size));
+
+#define COST_BUCKETS 64u
+
+// libFuzzer treats every non-zero byte in this section as a coverage
+// feature and clears the section before each input.
+__attribute__((used, section("__libfuzzer_extra_counters")))
+static uint8_t s_cost_features[3][COST_BUCKETS];
+
+static uint64_t s_worst_ns;
+static uint64_t s_max_us;
+static uint32_t s_max_allocs;
+
+// Two buckets per power of two: 0, 1, 2, 3, 4-5, 6-7, 8-11, ...
+static uint32_t cost_bucket(uint64_t value)
+{
+  if (value == 0u) {
+    return 0u;
+  }
+  uint32_t octave = 63u - (uint32_t)__builtin_clzll(value);
+  uint32_t half = octave > 0u ? (uint32_t)((value >> (octave - 1u)) & 1u) : 0u;
+  uint32_t bucket = 1u + octave * 2u + half;
+  return bucket < COST_BUCKETS ? bucket : COST_BUCKETS - 1u;
+}
+
+// Every bucket up to the cost is set, so only a new maximum is new
+// coverage and inputs that merely cost something different are not kept.
+static void note_cost(uint8_t *features, uint64_t value)
+{
+  memset(features, 1, cost_bucket(value) + 1u);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if (size > FUZZ_MAX_INPUT) {
+    return -1;
+  }
+
+  fuzz_cost_t cost;
+  measure(data, size, FUZZ_FUZZ_RUNS, &cost);
+  note_cost(s_cost_features[0], cost.ns);
+  note_cost(s_cost_features[1], cost.allocs);
+  note_cost(s_cost_features[2], cost.peak_bytes);
+
+  if (cost.ns > s_worst_ns) {
+    s_worst_ns = cost.ns;
+    fprintf(stderr, "#cost max %llu us, %u allocs, %zu bytes peak, %zu bytes\n",
+            (unsigned long long)(cost.ns / 1000u), (unsigned)cost.allocs,
+            cost.peak_bytes, size);
+  }
+  // Over a limit counts as a crash, so libFuzzer saves and can minimise it.
+  if ((s_max_us > 0u && cost.ns / 1000u > s_max_us) ||
+      (s_max_allocs > 0u && cost.allocs > s_max_allocs)) {
+    fprintf(stderr, "input over budget: %llu us, %u allocs\n",
+            (unsigned long long)(cost.ns / 1000u), (unsigned)cost.allocs);
+    abort();
+  }
+  return 0;
+}
+
+// app_main() gets no argv on the Linux target, so libFuzzer's options and
+// corpus directories come from FUZZ_ARGS, split on spaces.
+static int run_fuzzer(void)
+{
+  static char args[1024];
+  static char *argv[32];
+  int argc = 0;
+  argv[argc++] = "protocol_fuzz";
+
+  const char *env = getenv("FUZZ_ARGS");
+  if (env != NULL) {
+    snprintf(args, sizeof(args), "%s", env);
+    for (char *arg = strtok(args, " "); arg != NULL && argc < 31;
+         arg = strtok(NULL, " ")) {
+      argv[argc++] = arg;
+    }
+  }
+  argv[argc] = NULL;
+
+  env = getenv("FUZZ_MAX_US");
+  s_max_us = env != NULL ? strtoull(env, NULL, 10) : 0u;
+  env = getenv("FUZZ_MAX_ALLOCS");
+  s_max_allocs = env != NULL ? (uint32_t)strtoul(env, NULL, 10) : 0u;
+
+  char **argvp = argv;
+  return LLVMFuzzerRunDriver(&argc, &argvp, LLVMFuzzerTestOneInput);
+}
+
+#else
+
+static size_t read_file(const char *path, uint8_t *buffer, size_t size)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return SIZE_MAX;
+  }
+  size_t len = fread(buffer, 1u, size, file);
+  bool truncated = fgetc(file) != EOF;
+  fclose(file);
+  return truncated ? SIZE_MAX : len;
+}
+
+// Each line of budgets.txt is "<file> <max_us> <max_allocs>". Time budgets
+// are scaled by FUZZ_BUDGET_SCALE (default 1) for slower machines;
+// allocation counts are deterministic and are not.
+static int run_regression(void)
+{
+  const char *dir = getenv("FUZZ_REGRESS_DIR");
+  if (dir == NULL) {
+    dir = FUZZ_REGRESS_DIR;
+  }
+  const char *env = getenv("FUZZ_BUDGET_SCALE");
+  double scale = env != NULL ? strtod(env, NULL) : 1.0;
+  if (!(scale > 0.0)) {
+    scale = 1.0;
+  }
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/budgets.txt", dir);
+  FILE *budgets = fopen(path, "r");
+  if (budgets == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  uint8_t *data = malloc(FUZZ_MAX_INPUT);
+  if (data == NULL) {
+    fclose(budgets);
+    return 1;
+  }
+
+  unsigned inputs = 0u;
+  unsigned failures = 0u;
+  char line[256];
+  printf("%-28s %17s %15s %10s\n", "input", "us (budget)", "allocs (budget)",
+         "peak B");
+  while (fgets(line, sizeof(line), budgets) != NULL) {
+    char name[128];
+    unsigned max_us;
+    unsigned max_allocs;
+    if (line[0] == '#' ||
+        sscanf(line, "%127s %u %u", name, &max_us, &max_allocs) != 3) {
+      continue;
+    }
+    inputs++;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    size_t len = read_file(path, data, FUZZ_MAX_INPUT);
+    if (len == SIZE_MAX) {
+      printf("%-28s missing or larger than %u bytes  FAIL\n", name,
+             FUZZ_MAX_INPUT);
+      failures++;
+      continue;
+    }
+
+    fuzz_cost_t cost;
+    measure(data, len, FUZZ_REGRESS_RUNS, &cost);
+    unsigned us = (unsigned)((cost.ns + 999u) / 1000u);
+    unsigned budget_us = (unsigned)(max_us * scale + 0.5);
+    bool ok = us <= budget_us && cost.allocs <= max_allocs;
+    printf("%-28s %7u (%7u) %6u (%6u) %10zu  %s\n", name, us, budget_us,
+           (unsigned)cost.allocs, max_allocs, cost.peak_bytes,
+           ok ? "ok" : "FAIL");
+    if (!ok) {
+      failures++;
+    }
+  }
+  fclose(budgets);
+  free(data);
+
+  printf("%u inputs, %u over budget\n", inputs, failures);
+  return (inputs == 0u || failures > 0u) ? 1 : 0;
+}
+
+#endif
+
+void app_main(void)
+{
+  // Rejected inputs log on every delivery; keep that out of the timings.
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  cJSON_Hooks hooks = {
+      .malloc_fn = counting_malloc,
+      .free_fn = counting_free,
+  };
+  cJSON_InitHooks(&hooks);
+  protocol_set_handlers(&kHandlers);
+
+#if FUZZ_LIBFUZZER
+  exit(run_fuzzer());
+#else
+  exit(run_regression());
+#endif
+}
@@ -0,0 +1,263 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cJSON.h>
+
+#include "protocol.h"
+#include "scan.h"
+#include "schema.h"
+
+/* Host benchmark of the single-pass scanner against cJSON. Each corpus
+ * line is a bare command object, decoded two ways:
+ *   fast: scan_object() + schema_decode_scan(), falling back to the cJSON
+ *         path when the scanner declines, as protocol.c does;
+ *   cjson: cJSON_ParseWithLength() + schema_decode_json() + cJSON_Delete().
+ * Both must produce the same args. The corpus is main/corpus.jsonl, or
+ * the file named by SCAN_BENCH_CORPUS (for example a capture of a real
+ * session, one command object per line).
+ */
+
+#define SCAN_BENCH_MAX_LINES 4096u
+#define SCAN_BENCH_MAX_FIELDS 8 // FAST_PATH_MAX_FIELDS in protocol.c
+#define SCAN_BENCH_MIN_NS 200000000ull
+
+extern const char corpus_start[] asm("_binary_corpus_jsonl_start");
+extern const char corpus_end[] asm("_binary_corpus_jsonl_end");
+
+typedef struct {
+  const char *text;
+  size_t len;
+  protocol_kind_t kind;
+  bool fast; // the scanner decodes it without falling back
+} bench_line_t;
+
+static bench_line_t s_lines[SCAN_BENCH_MAX_LINES];
+static size_t s_line_count;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool decode_cjson(const char *text, size_t len,
+                         protocol_kind_t *kind, protocol_args_t *args)
+{
+  cJSON *root = cJSON_ParseWithLength(text, len);
+  if (root == NULL) {
+    return false;
+  }
+  const cJSON *name = cJSON_GetObjectItemCaseSensitive(root, "kind");
+  const char *bad_key = NULL;
+  bool ok = cJSON_IsString(name) &&
+            schema_find_kind(name->valuestring, strlen(name->valuestring),
+                             kind) &&
+            schema_decode_json(*kind, root, args, &bad_key);
+  cJSON_Delete(root);
+  return ok;
+}
+
+static bool decode_fast(const char *text, size_t len,
+                        protocol_kind_t *kind, protocol_args_t *args)
+{
+  scan_field_t fields[SCAN_BENCH_MAX_FIELDS];
+  int count = scan_object(text, len, fields, SCAN_BENCH_MAX_FIELDS);
+  if (count < 0) {
+    return false;
+  }
+  const scan_field_t *name = scan_find(fields, count, "kind");
+  return name != NULL && name->type == SCAN_VALUE_STRING &&
+         schema_find_kind(name->value, name->value_len, kind) &&
+         schema_decode_scan(*kind, fields, count, args);
+}
+
+static bool decode_with_fallback(const bench_line_t *line,
+                                 protocol_args_t *args)
+{
+  protocol_kind_t kind;
+  return decode_fast(line->text, line->len, &kind, args) ||
+         decode_cjson(line->text, line->len, &kind, args);
+}
+
+// Splits the corpus into lines and keeps those that cJSON decodes as a
+// schema command. Returns false if a line decodes differently on the two
+// paths.
+static bool load_corpus(char *text, size_t len)
+{
+  size_t skipped = 0u;
+  char *end = text + len;
+  for (char *line = text; line < end && s_line_count < SCAN_BENCH_MAX_LINES;) {
+    char *newline = memchr(line, '\n', (size_t)(end - line));
+    size_t line_len = newline != NULL ? (size_t)(newline - line)
+                                      : (size_t)(end - line);
+    bench_line_t *entry = &s_lines[s_line_count];
+    entry->text = line;
+    entry->len = line_len;
+    line += line_len + 1u;
+
+    protocol_kind_t kind;
+    protocol_args_t expected;
+    memset(&expected, 0, sizeof(expected));
+    if (line_len == 0u ||
+        !decode_cjson(entry->text, entry->len, &kind, &expected)) {
+      skipped++;
+      continue;
+    }
+
+    protocol_kind_t fast_kind;
+    protocol_args_t args;
+    memset(&args, 0, sizeof(args));
+    entry->kind = kind;
+    entry->fast = decode_fast(entry->text, entry->len, &fast_kind, &args);
+    if (entry->fast &&
+        (fast_kind != kind || memcmp(&args, &expected, sizeof(args)) != 0)) {
+      printf("decoded differently: %.*s\n", (int)line_len, entry->text);
+      return false;
+    }
+    s_line_count++;
+  }
+  if (skipped > 0u) {
+    printf("%zu lines skipped (not a schema command)\n", skipped);
+  }
+  return s_line_count > 0u;
+}
+
+typedef bool (*bench_fn_t)(const bench_line_t *line, protocol_args_t *args);
+
+static bool bench_cjson(const bench_line_t *line, protocol_args_t *args)
+{
+  protocol_kind_t kind;
+  return decode_cjson(line->text, line->len, &kind, args);
+}
+
+// Runs fn over the lines of one kind (or all, for PROTOCOL_KIND_COUNT)
+// until SCAN_BENCH_MIN_NS have passed. Returns ns per message.
+static double time_lines(bench_fn_t fn, protocol_kind_t kind, size_t *count)
+{
+  protocol_args_t args;
+  uint64_t messages = 0u;
+  uint64_t start = now_ns();
+  uint64_t elapsed;
+  do {
+    for (size_t i = 0u; i < s_line_count; ++i) {
+      if (kind != PROTOCOL_KIND_COUNT && s_lines[i].kind != kind) {
+        continue;
+      }
+      if (!fn(&s_lines[i], &args)) {
+        abort();
+      }
+      messages++;
+    }
+    elapsed = now_ns() - start;
+  } while (messages > 0u && elapsed < SCAN_BENCH_MIN_NS);
+
+  size_t per_pass = 0u;
+  for (size_t i = 0u; i < s_line_count; ++i) {
+    if (kind == PROTOCOL_KIND_COUNT || s_lines[i].kind == kind) {
+      per_pass++;
+    }
+  }
+  *count = per_pass;
+  return messages > 0u ? (double)elapsed / (double)messages : 0.0;
+}
+
+static const char *kind_name(protocol_kind_t kind)
+{
+#define SCAN_BENCH_KIND_NAME(ID, name, ...) \
+  case PROTOCOL_KIND_##ID:                  \
+    return #name;
+  switch (kind) {
+    PROTOCOL_SCHEMA_KINDS(SCAN_BENCH_KIND_NAME, SCAN_BENCH_KIND_NAME)
+    case PROTOCOL_KIND_COUNT:
+      break;
+  }
+#undef SCAN_BENCH_KIND_NAME
+  return "all";
+}
+
+static void report(protocol_kind_t kind)
+{
+  size_t count;
+  double fast_ns = time_lines(decode_with_fallback, kind, &count);
+  if (count == 0u) {
+    return;
+  }
+  double cjson_ns = time_lines(bench_cjson, kind, &count);
+
+  size_t hits = 0u;
+  for (size_t i = 0u; i < s_line_count; ++i) {
+    if ((kind == PROTOCOL_KIND_COUNT || s_lines[i].kind == kind) &&
+        s_lines[i].fast) {
+      hits++;
+    }
+  }
+  printf("%-16s %6zu %9.1f%% %12.0f %12.0f %8.2fx\n", kind_name(kind), count,
+         100.0 * (double)hits / (double)count, fast_ns, cjson_ns,
+         cjson_ns / fast_ns);
+}
+
+static char *read_corpus(const char *path, size_t *len)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  char *text = NULL;
+  size_t size = 0u;
+  char chunk[4096];
+  size_t got;
+  while ((got = fread(chunk, 1u, sizeof(chunk), file)) > 0u) {
+    char *grown = realloc(text, size + got);
+    if (grown == NULL) {
+      free(text);
+      fclose(file);
+      return NULL;
+    }
+    text = grown;
+    memcpy(text + size, chunk, got);
+    size += got;
+  }
+  fclose(file);
+  *len = size;
+  return text;
+}
+
+void app_main(void)
+{
+  const char *path = getenv("SCAN_BENCH_CORPUS");
+  char *text;
+  size_t len;
+  if (path != NULL) {
+    text = read_corpus(path, &len);
+    if (text == NULL) {
+      printf("cannot read %s\n", path);
+      exit(1);
+    }
+  } else {
+    // EMBED_TXTFILES appends a NUL that is not part of the corpus.
+    len = (size_t)(corpus_end - corpus_start) - 1u;
+    text = malloc(len);
+    if (text == NULL) {
+      exit(1);
+    }
+    memcpy(text, corpus_start, len);
+  }
+  if (!load_corpus(text, len)) {
+    exit(1);
+  }
+
+  printf("%-16s %6s %10s %12s %12s %9s\n", "kind", "msgs", "fast hits",
+         "fast ns/msg", "cJSON ns/msg", "speedup");
+  for (int kind = 0; kind < PROTOCOL_KIND_COUNT; ++kind) {
+    report((protocol_kind_t)kind);
+  }
+  report(PROTOCOL_KIND_COUNT);
+
+  free(text);
+  exit(0);
+}
@@ -4,6 +4,26 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "protocol_schema.h"
+
+#define PROTOCOL_GAIN_CURVE_SEGMENTS 8
+
+// Speed -> motor output curve for one wheel, replacing the scalar
+// motor_gain_* when valid. Segment i covers |speed| in
+// [i << step_shift, (i + 1) << step_shift) mm/s; the output is
+// base + delta * (offset within segment) >> step_shift, in Q15 of full
+// scale. Speeds past the last segment get its end value. Evaluate with
+// protocol_gain_curve_eval().
+typedef struct {
+  struct {
+    int16_t base_q15;
+    int16_t delta_q15;
+  } segments[PROTOCOL_GAIN_CURVE_SEGMENTS];
+  uint16_t deadband_mm_per_s; // |speed| below this gives 0
+  uint8_t step_shift;
+  bool valid;
+} protocol_gain_curve_t;
+
 typedef struct {
   float wheel_track_mm;
   float wheel_radius_mm;
@@ -16,8 +36,41 @@ typedef struct {
   float speed_ki;
   float motor_gain_left;
   float motor_gain_right;
+  protocol_gain_curve_t gain_curve_left;
+  protocol_gain_curve_t gain_curve_right;
 } protocol_drive_config_t;
 
+// Condition over local state, evaluated on-device by the executor in
+// each control tick (see protocol_condition_eval()).
+typedef enum {
+  PROTOCOL_CONDITION_ELAPSED_MS = 0, // step running for >= value ms
+  PROTOCOL_CONDITION_DISTANCE_MM,    // travelled >= value mm since step start
+  PROTOCOL_CONDITION_BUTTONS,        // any button bit in value is set
+  PROTOCOL_CONDITION_QUEUE_EMPTY,    // no commands queued behind this step
+} protocol_condition_kind_t;
+
+typedef struct {
+  protocol_condition_kind_t kind;
+  uint32_t value;
+  bool negate;
+} protocol_condition_t;
+
+// Local state sampled by the executor for condition evaluation.
+typedef struct {
+  uint32_t elapsed_ms;
+  uint32_t distance_mm;
+  uint32_t buttons_mask;
+  bool queue_empty;
+} protocol_condition_state_t;
+
+// Markers bracketing the steps of a "branch" in the handler stream:
+// BEGIN(cond), then-steps, ELSE, else-steps, END. Branches may nest.
+typedef enum {
+  PROTOCOL_BRANCH_BEGIN = 0,
+  PROTOCOL_BRANCH_ELSE,
+  PROTOCOL_BRANCH_END,
+} protocol_branch_marker_t;
+
 typedef struct {
   void (*drive)(const char *direction,
                 int32_t speed_mm_per_s,
@@ -27,8 +80,20 @@ typedef struct {
                int32_t angle_deg,
                int32_t speed_mm_per_s,
                uint32_t duration_ms);
+  // Also called by the immediate-stream deadman
+  // (CONFIG_ROBOT_PROTOCOL_DEADMAN) from the esp_timer task, so it must not
+  // block and must be safe to call concurrently with the other handlers.
   void (*stop)(void);
   void (*wait)(uint32_t duration_ms);
+  // Hold the queue until condition is true or timeout_ms (0 = none)
+  // elapses.
+  void (*wait_until)(const protocol_condition_t *condition,
+                     uint32_t timeout_ms);
+  // condition is only set for PROTOCOL_BRANCH_BEGIN. The executor
+  // evaluates it when the marker reaches the head of the queue and skips
+  // the steps of the branch not taken.
+  void (*branch)(protocol_branch_marker_t marker,
+                 const protocol_condition_t *condition);
   void (*clear_queue)(void);
   void (*set_led_hsv)(uint16_t h, uint8_t s, uint8_t v);
   void (*set_drive_config)(const protocol_drive_config_t *config);
@@ -37,12 +102,137 @@ typedef struct {
                     uint32_t timeout_ms,
                     uint32_t now_ms,
                     uint32_t buttons_mask);
+  // Results of a "bench" command as a JSON document, typically published
+  // with mqtt_publish_telemetry().
+  void (*bench_report)(const char *json, size_t len);
+  // Start a sampling profile of duration_ms, e.g. with profiler_start()
+  // from robot-stats, which publishes the histogram when it ends.
+  void (*profile)(uint32_t duration_ms);
+  // Run a gain calibration: drive each wheel at duty_steps evenly spaced
+  // output levels, wait settle_ms, measure speed over sample_ms, then fit
+  // curves with protocol_gain_curve_fit(step_mm_per_s) and report them
+  // with protocol_format_gain_curves_json().
+  void (*calibrate)(uint32_t duty_steps,
+                    uint32_t settle_ms,
+                    uint32_t sample_ms,
+                    uint32_t step_mm_per_s);
+  // Measure task wake-up latency for duration_ms, e.g. with
+  // stats_latency_start() from robot-stats, which publishes the result.
+  void (*sched_bench)(uint32_t duration_ms);
 } protocol_handlers_t;
 
+// Statistics for the immediate-command deadman (CONFIG_ROBOT_PROTOCOL_DEADMAN).
+typedef struct {
+  uint32_t frames;              // immediate frames that re-armed the deadman
+  uint32_t expirations;         // times the deadman called stop
+  uint32_t near_misses;         // frames arriving after timeout_ms, within grace
+  int64_t max_gap_us;           // largest gap between consecutive frames
+  int64_t max_stop_latency_us;  // worst lateness of stop past its deadline
+} protocol_deadman_stats_t;
+
+// Receive-to-dispatch latency of decoded messages, from the transport's
+// receive time (protocol_trace_set_rx_time()) to the first handler call.
+typedef struct {
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t total_us;
+} protocol_latency_stats_t;
+
+// Power-management locks taken during immediate streaming and sequences
+// (CONFIG_ROBOT_PROTOCOL_PM_LOCKS, effective with CONFIG_PM_ENABLE).
+// Latencies only cover messages given a receive time with
+// protocol_trace_set_rx_time().
+typedef struct {
+  protocol_latency_stats_t locked;    // messages received with locks held
+  protocol_latency_stats_t unlocked;  // messages received with locks free
+  uint32_t acquisitions;              // idle -> active transitions
+  uint64_t held_us;                   // total time the locks were held
+} protocol_pm_stats_t;
+
 void protocol_set_handlers(const protocol_handlers_t *handlers);
 
 void protocol_handle_command_json(const char *data, size_t len);
 
+void protocol_get_deadman_stats(protocol_deadman_stats_t *stats);
+
+void protocol_get_pm_stats(protocol_pm_stats_t *stats);
+
+bool protocol_condition_eval(const protocol_condition_t *condition,
+                             const protocol_condition_state_t *state);
+
+// Motor output for a signed wheel speed, Q15 of full scale with the sign
+// of the speed. Cheap enough to call every control tick.
+int32_t protocol_gain_curve_eval(const protocol_gain_curve_t *curve,
+                                 int32_t speed_mm_per_s);
+
+// One steady-state measurement of a calibration run.
+typedef struct {
+  float output;          // commanded output, 0 .. 1
+  float speed_mm_per_s;  // measured speed, 0 if the wheel did not move
+} protocol_gain_sample_t;
+
+// Build a curve from samples sorted by increasing output. step_mm_per_s is
+// the segment width and must be a power of two. The deadband is the
+// lowest speed the wheel sustained. Returns false if the step is invalid
+// or fewer than two samples moved the wheel.
+bool protocol_gain_curve_fit(const protocol_gain_sample_t *samples,
+                             size_t count,
+                             uint32_t step_mm_per_s,
+                             protocol_gain_curve_t *curve);
+
+// Format both curves as a config message that can be sent back to the
+// robot (or stored with a "profile" id):
+//   {"type":"config","drive":{"gain_curves":{...}}}
+// snprintf semantics, like protocol_encode_command_json().
+size_t protocol_format_gain_curves_json(const protocol_gain_curve_t *left,
+                                        const protocol_gain_curve_t *right,
+                                        char *buffer,
+                                        size_t buffer_size);
+
+// Load drive-config profiles persisted in NVS. Call once at startup,
+// after nvs_flash_init().
+void protocol_load_drive_profiles(void);
+
+// Called from the control loop at a tick boundary. If a "select_profile"
+// command arrived since the last call, copies the selected profile into
+// *config and returns true. Never blocks and never parses.
+bool protocol_take_drive_profile(protocol_drive_config_t *config);
+
+// Handle a message whose kind is known out of band (e.g. from the MQTT
+// topic robot/<id>/cmd/<kind>). The body is the bare command object
+// without the "type"/"command"/"kind" envelope; an empty body is treated
+// as {}. kind may also be "sequence" or "config", in which case the body is
+// the corresponding message without "type".
+void protocol_handle_kind_json(const char *kind, const char *data, size_t len);
+
+// Binary form of any schema command (see protocol_schema.h), accepted by
+// protocol_handle_command_json():
+//   PROTOCOL_BINARY_MAGIC, kind id (uint8), then each field in schema
+//   order: I32/U32/F32 as 4 bytes little endian, STR as a uint8 length
+//   followed by the bytes.
+#define PROTOCOL_BINARY_MAGIC "\x1bRB"
+
+bool protocol_is_binary(const char *data, size_t len);
+
+// "drive", "turn", ... for a schema kind, or NULL.
+const char *protocol_kind_name(protocol_kind_t kind);
+
+// Encode args (the protocol_<kind>_args_t for kind) as a
+// {"type":"command",...} document. Behaves like snprintf: the output is
+// always terminated and the return value is the full length, which is
+// >= buffer_size if it was truncated.
+size_t protocol_encode_command_json(protocol_kind_t kind,
+                                    const void *args,
+                                    char *buffer,
+                                    size_t buffer_size);
+
+// Encode args in the binary form. Returns the length, or 0 if the buffer
+// is too small.
+size_t protocol_encode_command_binary(protocol_kind_t kind,
+                                      const void *args,
+                                      char *buffer,
+                                      size_t buffer_size);
+
 // Format an "immediate" command JSON into the provided buffer.
 // The output is a null-terminated JSON document matching the
 // format expected by protocol_handle_command_json / handle_immediate_command.
@@ -54,4 +244,164 @@ void protocol_generate_immediate_command(char *buffer,
                                 float right_frac,
                                 uint32_t timeout_ms,
                                 uint32_t now_ms,
-                                uint32_t buttons_mask);
\ No newline at end of file
+                                uint32_t buttons_mask);
+
+// Upper bound on the length of a frame written by
+// protocol_generate_immediate_command(), including the terminator.
+#define PROTOCOL_IMMEDIATE_MAX_LEN 160
+
+// Sender-side pacer for "immediate" frames. Joystick samples are fed in
+// with protocol_immediate_stream_update() at whatever rate they arrive;
+// protocol_immediate_stream_poll() decides when a frame is due:
+//  - a changed state is sent at most once per min_interval_ms (the latest
+//    value wins),
+//  - an unchanged non-idle state is refreshed every refresh_ms so the
+//    robot never reaches timeout_ms,
+//  - an unchanged idle state (both outputs 0, no buttons) is not refreshed;
+//    letting the robot's timeout lapse has the same effect as sending it.
+typedef struct {
+  uint32_t min_interval_ms;
+  uint32_t refresh_ms;
+  uint32_t timeout_ms;
+  float deadband;
+
+  float left_frac;
+  float right_frac;
+  uint32_t buttons_mask;
+
+  bool has_sent;
+  float sent_left_frac;
+  float sent_right_frac;
+  uint32_t sent_buttons_mask;
+  uint32_t last_sent_ms;
+
+  uint32_t updates;      // samples passed to _update()
+  uint32_t frames_sent;  // frames returned by _poll()
+
+  char buffer[PROTOCOL_IMMEDIATE_MAX_LEN];
+} protocol_immediate_stream_t;
+
+// rate_hz bounds the frame rate for a changing input; refreshes are sent
+// at a third of timeout_ms. Changes smaller than 0.01 are treated as
+// unchanged.
+void protocol_immediate_stream_init(protocol_immediate_stream_t *stream,
+                                    uint32_t rate_hz,
+                                    uint32_t timeout_ms);
+
+void protocol_immediate_stream_update(protocol_immediate_stream_t *stream,
+                                      float left_frac,
+                                      float right_frac,
+                                      uint32_t buttons_mask);
+
+// Returns the length of the frame to send now and points *frame at the
+// stream's internal buffer, or returns 0 if nothing is due. The buffer is
+// reused by the next successful poll.
+size_t protocol_immediate_stream_poll(protocol_immediate_stream_t *stream,
+                                      uint32_t now_ms,
+                                      const char **frame);
+
+// Optional compressed envelope for large sequence/config payloads.
+// A message starting with PROTOCOL_COMPRESSED_MAGIC is decompressed before
+// parsing by protocol_handle_command_json / protocol_handle_kind_json.
+// JSON never starts with this prefix, so detection is unambiguous.
+#define PROTOCOL_COMPRESSED_MAGIC "\x1bRZ"
+
+// Format version, sent right after the magic. Bumped whenever the token
+// format or the built-in dictionary changes; other versions are rejected.
+#define PROTOCOL_COMPRESSED_VERSION 1u
+
+bool protocol_is_compressed(const char *data, size_t len);
+
+// Version byte of a compressed message, or 0 if data is not compressed.
+uint8_t protocol_compressed_version(const char *data, size_t len);
+
+// Length of the decompressed payload, or 0 if data is not compressed or
+// uses a version other than PROTOCOL_COMPRESSED_VERSION.
+size_t protocol_decompressed_len(const char *data, size_t len);
+
+// Decompress into out. Returns the decompressed length, or 0 if the
+// payload is malformed or does not fit in out_size bytes.
+size_t protocol_decompress(const char *data,
+                           size_t len,
+                           char *out,
+                           size_t out_size);
+
+// Bytes of scratch memory protocol_compress() needs for a len-byte input.
+size_t protocol_compress_work_size(size_t len);
+
+// Compress a JSON document (at most 65535 bytes) for sending. work must
+// point to protocol_compress_work_size(len) bytes, suitably aligned for
+// int32_t. Returns the compressed length, or 0 if out_size is too small.
+size_t protocol_compress(const char *data,
+                         size_t len,
+                         char *out,
+                         size_t out_size,
+                         int32_t *work);
+
+// Host-side pass that shrinks a sequence message before it is sent. Only
+// built with CONFIG_ROBOT_PROTOCOL_OPTIMIZER.
+// Rewrites the tree in place without changing what the robot does:
+//  - {"type":"command","command":{...}} steps become bare commands, and
+//    nested sequences that run once are inlined;
+//  - adjacent drives with the same direction and speed, bounded by the same
+//    field, are merged, as are waits (up to the 30 s clamp) and turns along
+//    the same arc in the same direction;
+//  - zero-length waits after a step that leaves the motors stopped, repeated
+//    stops, and led_hsv steps that are overwritten at once or set the
+//    colour already shown are removed;
+//  - runs of a repeated block become a nested sequence with "repeat", or
+//    multiply the enclosing repeat when they cover the whole list.
+// Only the wheel stop/start between merged steps is lost. State from before
+// a list (or from the previous repeat) is never assumed, and nesting stays
+// within CONFIG_ROBOT_PROTOCOL_MAX_SEQUENCE_DEPTH.
+typedef struct {
+  uint32_t steps_before;      // step objects, nested ones included
+  uint32_t steps_after;
+  uint64_t dispatched_before; // steps charged to CONFIG_ROBOT_PROTOCOL_MAX_STEPS,
+  uint64_t dispatched_after;  // with repeats expanded
+  size_t bytes_before;        // cJSON_PrintUnformatted() length
+  size_t bytes_after;
+  uint32_t merged;            // steps folded into their predecessor
+  uint32_t removed;           // no-op steps and dissolved wrappers
+  uint32_t hoisted;           // repeated runs replaced by a repeat
+} protocol_optimize_stats_t;
+
+struct cJSON;
+
+// sequence is a {"type":"sequence",...} message or a body without "type".
+// stats may be NULL. Returns false if sequence has no "steps" array, or if
+// an allocation failed; the tree is then valid but partly optimised.
+bool protocol_optimize_sequence(struct cJSON *sequence,
+                                protocol_optimize_stats_t *stats);
+
+// Pipeline stages recorded for messages that carry a "trace" id.
+typedef enum {
+  PROTOCOL_TRACE_RX = 0,     // transport receive (see set_rx_time)
+  PROTOCOL_TRACE_DECODED,    // message parsed and trace id found
+  PROTOCOL_TRACE_DISPATCH,   // first handler called
+  PROTOCOL_TRACE_QUEUED,     // marked by the consumer when queued
+  PROTOCOL_TRACE_EXEC_START, // marked by the consumer
+  PROTOCOL_TRACE_EXEC_END,   // marked by the consumer; closes the record
+  PROTOCOL_TRACE_STAGE_COUNT,
+} protocol_trace_stage_t;
+
+// Receive time (esp_timer_get_time()) of the next message passed to
+// protocol_handle_*; defaults to the time of the call.
+void protocol_trace_set_rx_time(int64_t rx_us);
+
+// Trace id of the message currently being dispatched, or 0. Handlers
+// that queue work should carry it with the queued item.
+uint32_t protocol_trace_current(void);
+
+// Record a consumer-side stage for a trace id. If a handler marks QUEUED,
+// the record stays open until EXEC_END; otherwise it closes when the
+// handler returns.
+void protocol_trace_mark(uint32_t trace_id, protocol_trace_stage_t stage);
+
+// Format closed, not yet reported records as
+//   {"traces":[[id,rx_us,decoded,dispatch,queued,exec_start,exec_end],...]}
+// where rx_us is the low 32 bits of the receive time and the remaining
+// values are microseconds after it (-1 if the stage was not recorded).
+// Returns the length written, or 0 (and an empty string) if there is
+// nothing to report.
+size_t protocol_trace_format_batch(char *buffer, size_t buffer_size);
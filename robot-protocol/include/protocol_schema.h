@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+
+// Single source of truth for the fields of every flat command kind.
+//
+// Each PROTOCOL_<KIND>_FIELDS(F, X) list expands F once per field:
+//   F(X, member, "json key", TYPE, PRESENCE, default)
+// TYPE is I32, U32, F32 or STR; PRESENCE is REQUIRED or OPTIONAL, and the
+// default applies to optional fields that are missing or invalid. X is
+// passed through untouched so expansions can refer to the args struct.
+//
+// From these lists the component generates the protocol_<kind>_args_t
+// structs below, the field descriptor tables used by the JSON, fast-path
+// and binary decoders, the JSON and binary encoders, and the field
+// reference in README.md (tools/gen_schema_docs.py). Kinds whose payload
+// is not a flat object (wait_until, branch, config, sequence) are decoded
+// by hand in protocol.c.
+//
+// Kind ids are part of the binary format: append new kinds at the end.
+
+// String fields hold at most PROTOCOL_SCHEMA_STR_MAX - 1 bytes; longer
+// values are invalid, so a required one rejects the command. The only
+// string field is drive's "direction", whose longest value ("backward")
+// fits easily.
+#define PROTOCOL_SCHEMA_STR_MAX 16
+
+#define PROTOCOL_DRIVE_FIELDS(F, X)                                \
+  F(X, direction, "direction", STR, REQUIRED, 0)                   \
+  F(X, speed_mm_per_s, "speed", I32, REQUIRED, 0)                  \
+  F(X, duration_ms, "duration", U32, OPTIONAL, 0)                  \
+  F(X, distance_mm, "distance", U32, OPTIONAL, 0)
+
+#define PROTOCOL_TURN_FIELDS(F, X)                                 \
+  F(X, radius_mm, "radius", I32, REQUIRED, 0)                      \
+  F(X, angle_deg, "angle", I32, REQUIRED, 0)                       \
+  F(X, speed_mm_per_s, "speed", I32, OPTIONAL, 0)                  \
+  F(X, duration_ms, "duration", U32, OPTIONAL, 0)
+
+#define PROTOCOL_LED_HSV_FIELDS(F, X)                              \
+  F(X, h, "h", U32, REQUIRED, 0)                                   \
+  F(X, s, "s", U32, OPTIONAL, 255)                                 \
+  F(X, v, "v", U32, OPTIONAL, 32)
+
+#define PROTOCOL_IMMEDIATE_FIELDS(F, X)                            \
+  F(X, left_frac, "left", F32, REQUIRED, 0)                        \
+  F(X, right_frac, "right", F32, REQUIRED, 0)                      \
+  F(X, timeout_ms, "timeout_ms", U32, OPTIONAL, 200)               \
+  F(X, now_ms, "now_ms", U32, OPTIONAL, 0)                         \
+  F(X, buttons_mask, "buttons", U32, OPTIONAL, 0)
+
+#define PROTOCOL_WAIT_FIELDS(F, X)                                 \
+  F(X, duration_ms, "duration", U32, OPTIONAL, 0)
+
+#define PROTOCOL_SELECT_PROFILE_FIELDS(F, X)                       \
+  F(X, id, "id", U32, REQUIRED, 0)
+
+#define PROTOCOL_BENCH_FIELDS(F, X)                                \
+  F(X, iterations, "iterations", U32, OPTIONAL, 100)
+
+#define PROTOCOL_PROFILE_FIELDS(F, X)                              \
+  F(X, duration_ms, "duration", U32, OPTIONAL, 5000)
+
+#define PROTOCOL_CALIBRATE_FIELDS(F, X)                            \
+  F(X, duty_steps, "steps", U32, OPTIONAL, 16)                     \
+  F(X, settle_ms, "settle_ms", U32, OPTIONAL, 300)                 \
+  F(X, sample_ms, "sample_ms", U32, OPTIONAL, 200)                 \
+  F(X, step_mm_per_s, "step", U32, OPTIONAL, 64)
+
+#define PROTOCOL_SCHED_BENCH_FIELDS(F, X)                          \
+  F(X, duration_ms, "duration", U32, OPTIONAL, 5000)
+
+// K(ID, name, FIELDS) for kinds with fields; B(ID, name) for kinds without.
+#define PROTOCOL_SCHEMA_KINDS(K, B)                                \
+  K(DRIVE, drive, PROTOCOL_DRIVE_FIELDS)                           \
+  K(TURN, turn, PROTOCOL_TURN_FIELDS)                              \
+  K(LED_HSV, led_hsv, PROTOCOL_LED_HSV_FIELDS)                     \
+  K(IMMEDIATE, immediate, PROTOCOL_IMMEDIATE_FIELDS)               \
+  K(WAIT, wait, PROTOCOL_WAIT_FIELDS)                              \
+  K(SELECT_PROFILE, select_profile, PROTOCOL_SELECT_PROFILE_FIELDS) \
+  B(STOP, stop)                                                    \
+  B(PAUSE, pause)                                                  \
+  B(RESUME, resume)                                                \
+  B(CLEAR_QUEUE, clear_queue)                                      \
+  K(BENCH, bench, PROTOCOL_BENCH_FIELDS)                           \
+  K(PROFILE, profile, PROTOCOL_PROFILE_FIELDS)                     \
+  K(CALIBRATE, calibrate, PROTOCOL_CALIBRATE_FIELDS)               \
+  K(SCHED_BENCH, sched_bench, PROTOCOL_SCHED_BENCH_FIELDS)
+
+#define PROTOCOL_SCHEMA_CTYPE_I32 int32_t
+#define PROTOCOL_SCHEMA_CTYPE_U32 uint32_t
+#define PROTOCOL_SCHEMA_CTYPE_F32 float
+#define PROTOCOL_SCHEMA_CTYPE_STR char
+#define PROTOCOL_SCHEMA_EXTENT_I32
+#define PROTOCOL_SCHEMA_EXTENT_U32
+#define PROTOCOL_SCHEMA_EXTENT_F32
+#define PROTOCOL_SCHEMA_EXTENT_STR [PROTOCOL_SCHEMA_STR_MAX]
+
+#define PROTOCOL_SCHEMA_MEMBER(X, member, key, type, presence, def)    \
+  PROTOCOL_SCHEMA_CTYPE_##type member PROTOCOL_SCHEMA_EXTENT_##type;
+#define PROTOCOL_SCHEMA_ARGS(ID, name, FIELDS)                         \
+  typedef struct {                                                     \
+    FIELDS(PROTOCOL_SCHEMA_MEMBER, ~)                                  \
+  } protocol_##name##_args_t;
+#define PROTOCOL_SCHEMA_NO_ARGS(ID, name)
+
+PROTOCOL_SCHEMA_KINDS(PROTOCOL_SCHEMA_ARGS, PROTOCOL_SCHEMA_NO_ARGS)
+
+#define PROTOCOL_SCHEMA_ENUM(ID, name, ...) PROTOCOL_KIND_##ID,
+
+typedef enum {
+  PROTOCOL_SCHEMA_KINDS(PROTOCOL_SCHEMA_ENUM, PROTOCOL_SCHEMA_ENUM)
+  PROTOCOL_KIND_COUNT,
+} protocol_kind_t;
+
+#define PROTOCOL_SCHEMA_UNION_MEMBER(ID, name, FIELDS) \
+  protocol_##name##_args_t name;
+
+// Storage large enough for the args of any kind.
+typedef union {
+  PROTOCOL_SCHEMA_KINDS(PROTOCOL_SCHEMA_UNION_MEMBER, PROTOCOL_SCHEMA_NO_ARGS)
+} protocol_args_t;
@@ -0,0 +1,345 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#else
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#endif
+#include <cJSON.h>
+
+#include "bench.h"
+#include "scan.h"
+#include "schema.h"
+
+#if CONFIG_ROBOT_PROTOCOL_BENCH
+
+static const char *TAG = "protocol_bench";
+
+#ifdef CONFIG_IDF_TARGET
+#define BENCH_TARGET CONFIG_IDF_TARGET
+#else
+#define BENCH_TARGET "unknown"
+#endif
+
+#define BENCH_REPORT_LEN 1024
+#define BENCH_MAX_ITERATIONS 10000u
+#define BENCH_STACK_SIZE 8192u
+
+/* Fixed corpus, so results are comparable across targets and builds.
+ * Only kinds without motion side effects are dispatched end to end. */
+static const char kImmediateJson[] =
+    "{\"type\":\"command\",\"command\":{\"kind\":\"immediate\","
+    "\"left\":-0.500,\"right\":0.500,\"timeout_ms\":200,\"now_ms\":123456,"
+    "\"buttons\":0}}";
+static const char kImmediateBody[] =
+    "{\"left\":-0.500,\"right\":0.500,\"timeout_ms\":200,\"now_ms\":123456,"
+    "\"buttons\":0}";
+static const char kDriveJson[] =
+    "{\"type\":\"command\",\"command\":{\"kind\":\"drive\","
+    "\"direction\":\"forward\",\"speed\":200,\"distance\":1000}}";
+static const char kLedJson[] =
+    "{\"type\":\"command\",\"command\":{\"kind\":\"led_hsv\","
+    "\"h\":120,\"s\":255,\"v\":32}}";
+static const char kSequenceJson[] =
+    "{\"type\":\"sequence\",\"repeat\":2,\"steps\":["
+    "{\"kind\":\"led_hsv\",\"h\":0},{\"kind\":\"wait\",\"duration\":100},"
+    "{\"kind\":\"led_hsv\",\"h\":240},{\"kind\":\"wait\",\"duration\":100}]}";
+static const char kConfigJson[] =
+    "{\"type\":\"config\",\"drive\":{\"wheel_track_mm\":120.0,"
+    "\"wheel_radius_mm\":32.5,\"min_speed_mm_per_s\":20,"
+    "\"max_speed_mm_per_s\":400,\"ticks_per_revolution\":1200,"
+    "\"brake_on_stop\":true,\"enable_speed_control\":true,"
+    "\"speed_kp\":0.8,\"speed_ki\":0.1}}";
+
+typedef enum {
+  BENCH_JSON_PARSE,
+  BENCH_FAST_DECODE,
+  BENCH_BINARY_DECODE,
+  BENCH_GENERATE,
+  BENCH_DISPATCH,
+  BENCH_LED_REFRESH,
+} bench_op_t;
+
+typedef struct {
+  const char *name;
+  bench_op_t op;
+  const char *data;
+  size_t len;
+} bench_case_t;
+
+#define BENCH_CASE(name, op, text) {name, op, text, sizeof(text) - 1u}
+
+static const bench_case_t kCases[] = {
+    BENCH_CASE("json_parse/immediate", BENCH_JSON_PARSE, kImmediateJson),
+    BENCH_CASE("json_parse/drive", BENCH_JSON_PARSE, kDriveJson),
+    BENCH_CASE("json_parse/sequence", BENCH_JSON_PARSE, kSequenceJson),
+    BENCH_CASE("json_parse/config", BENCH_JSON_PARSE, kConfigJson),
+    BENCH_CASE("fast_decode/immediate", BENCH_FAST_DECODE, kImmediateBody),
+    {"binary_decode/immediate", BENCH_BINARY_DECODE, NULL, 0u},
+    {"generate/immediate", BENCH_GENERATE, NULL, 0u},
+    BENCH_CASE("dispatch/led_hsv", BENCH_DISPATCH, kLedJson),
+    BENCH_CASE("dispatch/sequence", BENCH_DISPATCH, kSequenceJson),
+    BENCH_CASE("dispatch/config", BENCH_DISPATCH, kConfigJson),
+    {"led_refresh", BENCH_LED_REFRESH, NULL, 0u},
+};
+
+static uint32_t cycle_count(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+  return 0u;
+#else
+  return (uint32_t)esp_cpu_get_cycle_count();
+#endif
+}
+
+/* Allocation accounting. For one instrumented iteration per case, cJSON's
+ * hooks, which protocol.c also uses for its parse buffers, go through
+ * counting wrappers around malloc/free. Only the bench task is counted, so other
+ * tasks parsing JSON at the same time do not skew the figures. */
+static TaskHandle_t s_alloc_task;
+static uint32_t s_allocs;
+static size_t s_live_bytes;
+static size_t s_peak_bytes;
+
+static size_t alloc_size(void *ptr)
+{
+#if CONFIG_IDF_TARGET_LINUX
+  return malloc_usable_size(ptr);
+#elif ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+  return heap_caps_get_allocated_size(ptr);
+#else
+  (void)ptr;
+  return 0u;
+#endif
+}
+
+static void *counting_malloc(size_t size)
+{
+  void *ptr = malloc(size);
+  if (ptr != NULL && xTaskGetCurrentTaskHandle() == s_alloc_task) {
+    s_allocs++;
+    s_live_bytes += alloc_size(ptr);
+    if (s_live_bytes > s_peak_bytes) {
+      s_peak_bytes = s_live_bytes;
+    }
+  }
+  return ptr;
+}
+
+static void counting_free(void *ptr)
+{
+  if (ptr != NULL && xTaskGetCurrentTaskHandle() == s_alloc_task) {
+    size_t size = alloc_size(ptr);
+    s_live_bytes = s_live_bytes > size ? s_live_bytes - size : 0u;
+  }
+  free(ptr);
+}
+
+// One iteration of a case. Returns false if the case cannot run.
+static bool run_once(const bench_case_t *bench,
+                     const protocol_handlers_t *handlers,
+                     const char *binary,
+                     size_t binary_len,
+                     uint32_t i)
+{
+  switch (bench->op) {
+    case BENCH_JSON_PARSE: {
+      cJSON *root = cJSON_ParseWithLength(bench->data, bench->len);
+      if (root == NULL) {
+        return false;
+      }
+      cJSON_Delete(root);
+      return true;
+    }
+    case BENCH_FAST_DECODE: {
+      scan_field_t fields[8];
+      protocol_args_t args;
+      int count = scan_object(bench->data, bench->len, fields, 8);
+      return count >= 0 &&
+             schema_decode_scan(PROTOCOL_KIND_IMMEDIATE, fields, count, &args);
+    }
+    case BENCH_BINARY_DECODE: {
+      protocol_kind_t kind;
+      protocol_args_t args;
+      return schema_decode_binary(binary, binary_len, &kind, &args);
+    }
+    case BENCH_GENERATE: {
+      char frame[PROTOCOL_IMMEDIATE_MAX_LEN];
+      protocol_generate_immediate_command(frame, sizeof(frame), -0.5f, 0.5f,
+                                          200u, i, 0u);
+      return true;
+    }
+    case BENCH_DISPATCH:
+      protocol_bench_dispatch(bench->data, bench->len);
+      return true;
+    case BENCH_LED_REFRESH:
+      if (handlers->set_led_hsv == NULL) {
+        return false;
+      }
+      handlers->set_led_hsv((uint16_t)((i * 37u) % 360u), 255u, 32u);
+      return true;
+  }
+  return false;
+}
+
+typedef struct {
+  const bench_case_t *bench;
+  const protocol_handlers_t *handlers;
+  const char *binary;
+  size_t binary_len;
+  uint32_t iterations;
+  TaskHandle_t caller;
+
+  bool ok;
+  int64_t elapsed_us;
+  uint32_t cycles;
+  uint32_t allocs;     // per message
+  uint32_t peak_bytes; // per message
+  int32_t stack_used;  // bytes, -1 where not measurable
+} bench_job_t;
+
+// Runs one case on a fresh task, so the stack high-water mark belongs to
+// that case alone.
+static void bench_case_task(void *arg)
+{
+  bench_job_t *job = arg;
+  const bench_case_t *bench = job->bench;
+
+  // Warm caches and lazily initialised state outside the measurement.
+  job->ok = run_once(bench, job->handlers, job->binary, job->binary_len, 0u);
+  if (job->ok) {
+    uint32_t cycles_before = cycle_count();
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t i = 0u; i < job->iterations; ++i) {
+      (void)run_once(bench, job->handlers, job->binary, job->binary_len, i);
+    }
+    job->elapsed_us = esp_timer_get_time() - start_us;
+    job->cycles = cycle_count() - cycles_before;
+
+    s_alloc_task = xTaskGetCurrentTaskHandle();
+    s_allocs = 0u;
+    s_live_bytes = 0u;
+    s_peak_bytes = 0u;
+    cJSON_Hooks hooks = {
+        .malloc_fn = counting_malloc,
+        .free_fn = counting_free,
+    };
+    cJSON_InitHooks(&hooks);
+    (void)run_once(bench, job->handlers, job->binary, job->binary_len,
+                   job->iterations);
+    cJSON_InitHooks(NULL);
+    s_alloc_task = NULL;
+    job->allocs = s_allocs;
+    job->peak_bytes = (uint32_t)s_peak_bytes;
+  }
+
+#if CONFIG_IDF_TARGET_LINUX
+  // Host tasks run on pthread stacks that FreeRTOS does not paint.
+  job->stack_used = -1;
+#else
+  job->stack_used = (int32_t)BENCH_STACK_SIZE -
+                    (int32_t)uxTaskGetStackHighWaterMark(NULL);
+#endif
+
+  xTaskNotifyGive(job->caller);
+  vTaskDelete(NULL);
+}
+
+void bench_run(const protocol_handlers_t *handlers, uint32_t iterations)
+{
+  if (iterations == 0u) {
+    iterations = 1u;
+  } else if (iterations > BENCH_MAX_ITERATIONS) {
+    iterations = BENCH_MAX_ITERATIONS;
+  }
+
+  const protocol_immediate_args_t immediate = {
+      .left_frac = -0.5f,
+      .right_frac = 0.5f,
+      .timeout_ms = 200u,
+      .now_ms = 123456u,
+  };
+  char binary[32];
+  size_t binary_len = protocol_encode_command_binary(
+      PROTOCOL_KIND_IMMEDIATE, &immediate, binary, sizeof(binary));
+
+  char *report = malloc(BENCH_REPORT_LEN);
+  if (report == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate bench report");
+    return;
+  }
+  int used = snprintf(report, BENCH_REPORT_LEN,
+                      "{\"bench\":{\"target\":\"%s\",\"iterations\":%u,"
+                      "\"results\":[",
+                      BENCH_TARGET, (unsigned)iterations);
+  size_t reported = 0u;
+
+  for (size_t c = 0u; c < sizeof(kCases) / sizeof(kCases[0]); ++c) {
+    const bench_case_t *bench = &kCases[c];
+    bench_job_t job = {
+        .bench = bench,
+        .handlers = handlers,
+        .binary = binary,
+        .binary_len = binary_len,
+        .iterations = iterations,
+        .caller = xTaskGetCurrentTaskHandle(),
+    };
+
+    // Same priority and core as the caller, which waits; cycle counters
+    // are per core.
+    if (xTaskCreatePinnedToCore(bench_case_task, "bench", BENCH_STACK_SIZE,
+                                &job, uxTaskPriorityGet(NULL), NULL,
+                                xPortGetCoreID()) != pdPASS) {
+      ESP_LOGE(TAG, "%s: failed to create bench task", bench->name);
+      continue;
+    }
+    (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (!job.ok) {
+      ESP_LOGW(TAG, "%s: skipped", bench->name);
+      continue;
+    }
+
+    uint32_t ns_per_op = (uint32_t)((job.elapsed_us * 1000) / iterations);
+    uint32_t cycles_per_op = job.cycles / iterations;
+    ESP_LOGI(TAG, "%s: %u ns, %u cycles, %u allocs, peak %u bytes, stack %d",
+             bench->name, (unsigned)ns_per_op, (unsigned)cycles_per_op,
+             (unsigned)job.allocs, (unsigned)job.peak_bytes,
+             (int)job.stack_used);
+
+    char stack[12];
+    if (job.stack_used >= 0) {
+      snprintf(stack, sizeof(stack), "%d", (int)job.stack_used);
+    } else {
+      snprintf(stack, sizeof(stack), "null");
+    }
+    if (used > 0 && used < BENCH_REPORT_LEN) {
+      used += snprintf(report + used, BENCH_REPORT_LEN - (size_t)used,
+                       "%s[\"%s\",%u,%u,%u,%u,%s]", reported++ > 0u ? "," : "",
+                       bench->name, (unsigned)ns_per_op,
+                       (unsigned)cycles_per_op, (unsigned)job.allocs,
+                       (unsigned)job.peak_bytes, stack);
+    }
+  }
+
+  if (used > 0 && used < BENCH_REPORT_LEN) {
+    used += snprintf(report + used, BENCH_REPORT_LEN - (size_t)used, "]}}");
+  }
+  if (used <= 0 || used >= BENCH_REPORT_LEN) {
+    ESP_LOGW(TAG, "Bench report truncated");
+  } else if (handlers->bench_report != NULL) {
+    handlers->bench_report(report, (size_t)used);
+  }
+  free(report);
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "../include/protocol.h"
+
+// Run the built-in microbenchmarks over the embedded corpus and report the
+// results through handlers->bench_report (or the log). handlers is the
+// application's table, of which only set_led_hsv (for the LED refresh
+// case) and bench_report are used. Each case runs on a temporary task;
+// cJSON's hooks are replaced for one counted iteration per case and then
+// reset to the defaults.
+void bench_run(const protocol_handlers_t *handlers, uint32_t iterations);
+
+// Decode and dispatch one corpus message as protocol_handle_command_json()
+// would, but against an empty handler table and without the trace, power
+// management and deadman bookkeeping of a received message. Implemented
+// in protocol.c.
+void protocol_bench_dispatch(const char *data, size_t len);
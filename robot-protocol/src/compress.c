@@ -0,0 +1,260 @@
+#include <string.h>
+
+#include "../include/protocol.h"
+
+/* LZSS with a static protocol dictionary.
+ *
+ * Envelope:  PROTOCOL_COMPRESSED_MAGIC (3 bytes)
+ *            PROTOCOL_COMPRESSED_VERSION (1 byte)
+ *            raw length (uint16, little endian)
+ *            token stream
+ *
+ * The token stream is a sequence of groups: one flag byte, then up to 8
+ * tokens, flag bit i (LSB first) describing token i:
+ *   0: one literal byte
+ *   1: a match, two bytes: offset = 1 + (b0 | (b1 & 0x0f) << 8),
+ *      length = 3 + (b1 >> 4)
+ * Offsets reach back into the output produced so far, preceded by
+ * s_dictionary, so the very first occurrence of a common key is already a
+ * match. The decoder needs no state beyond the output buffer.
+ */
+
+#define LZ_MIN_MATCH   3u
+#define LZ_MAX_MATCH   (LZ_MIN_MATCH + 15u)
+#define LZ_WINDOW      4096u
+#define LZ_MAGIC_LEN   (sizeof(PROTOCOL_COMPRESSED_MAGIC) - 1u)
+#define LZ_HEADER_LEN  (LZ_MAGIC_LEN + 1u + 2u)
+#define LZ_HASH_BITS   10u
+#define LZ_HASH_SIZE   (1u << LZ_HASH_BITS)
+#define LZ_MAX_CHAIN   32u
+
+/* The dictionary is part of the wire format: matches into it are encoded
+ * as offsets, so a sender and receiver built with different contents
+ * silently decode different bytes. NEVER edit it in place. Any change,
+ * even whitespace, must bump PROTOCOL_COMPRESSED_VERSION so older peers
+ * reject the message instead of misreading it.
+ */
+static const char s_dictionary[] =
+    "\"wheel_track_mm\":\"wheel_radius_mm\":\"ticks_per_revolution\":"
+    "\"min_speed_mm_per_s\":\"max_speed_mm_per_s\":\"brake_on_stop\":"
+    "\"enable_speed_control\":\"speed_kp\":\"speed_ki\":"
+    "\"motor_gain_left\":\"motor_gain_right\":true,false,"
+    "{\"type\":\"config\",\"drive\":{"
+    "{\"kind\":\"led_hsv\",\"h\":\"s\":255,\"v\":32},"
+    "{\"kind\":\"immediate\",\"left\":\"right\":\"timeout_ms\":200,"
+    "\"now_ms\":\"buttons\":0}"
+    "{\"kind\":\"stop\"},{\"kind\":\"clear_queue\"},"
+    "{\"kind\":\"turn\",\"radius\":\"angle\":90,\"speed\":100,"
+    "{\"kind\":\"wait\",\"duration\":1000},"
+    "{\"type\":\"command\",\"command\":"
+    "{\"type\":\"sequence\",\"repeat\":\"steps\":["
+    "{\"kind\":\"drive\",\"direction\":\"backward\",\"speed\":100,"
+    "\"distance\":\"duration\":"
+    "{\"kind\":\"drive\",\"direction\":\"forward\",\"speed\":100,"
+    "\"distance\":";
+
+#define LZ_DICT_LEN (sizeof(s_dictionary) - 1u)
+
+bool protocol_is_compressed(const char *data, size_t len)
+{
+  return data != NULL && len >= LZ_HEADER_LEN &&
+         memcmp(data, PROTOCOL_COMPRESSED_MAGIC, LZ_MAGIC_LEN) == 0;
+}
+
+uint8_t protocol_compressed_version(const char *data, size_t len)
+{
+  if (!protocol_is_compressed(data, len)) {
+    return 0u;
+  }
+  return (uint8_t)data[LZ_MAGIC_LEN];
+}
+
+size_t protocol_decompressed_len(const char *data, size_t len)
+{
+  if (protocol_compressed_version(data, len) != PROTOCOL_COMPRESSED_VERSION) {
+    return 0u;
+  }
+  const uint8_t *p = (const uint8_t *)data + LZ_MAGIC_LEN + 1u;
+  return (size_t)p[0] | ((size_t)p[1] << 8);
+}
+
+size_t protocol_decompress(const char *data,
+                           size_t len,
+                           char *out,
+                           size_t out_size)
+{
+  size_t raw_len = protocol_decompressed_len(data, len);
+  if (raw_len == 0u || raw_len > out_size) {
+    return 0u;
+  }
+
+  const uint8_t *in = (const uint8_t *)data;
+  size_t pos = LZ_HEADER_LEN;
+  size_t produced = 0u;
+
+  while (produced < raw_len) {
+    if (pos >= len) {
+      return 0u;
+    }
+    uint8_t flags = in[pos++];
+
+    for (int bit = 0; bit < 8 && produced < raw_len; ++bit) {
+      if ((flags & (1u << bit)) == 0u) {
+        if (pos >= len) {
+          return 0u;
+        }
+        out[produced++] = (char)in[pos++];
+        continue;
+      }
+
+      if (pos + 2u > len) {
+        return 0u;
+      }
+      size_t offset = 1u + ((size_t)in[pos] | ((size_t)(in[pos + 1u] & 0x0fu) << 8));
+      size_t match_len = LZ_MIN_MATCH + (in[pos + 1u] >> 4);
+      pos += 2u;
+
+      if (offset > produced + LZ_DICT_LEN ||
+          match_len > raw_len - produced) {
+        return 0u;
+      }
+
+      // Byte-by-byte so overlapping matches replicate correctly.
+      for (size_t i = 0u; i < match_len; ++i) {
+        size_t virt = LZ_DICT_LEN + produced - offset;
+        out[produced] = (virt < LZ_DICT_LEN) ? s_dictionary[virt]
+                                             : out[virt - LZ_DICT_LEN];
+        ++produced;
+      }
+    }
+  }
+  return produced;
+}
+
+static uint8_t lz_byte(const char *data, size_t virt)
+{
+  return (uint8_t)((virt < LZ_DICT_LEN) ? s_dictionary[virt]
+                                        : data[virt - LZ_DICT_LEN]);
+}
+
+static size_t lz_hash(const char *data, size_t virt)
+{
+  uint32_t v = ((uint32_t)lz_byte(data, virt) << 16) |
+               ((uint32_t)lz_byte(data, virt + 1u) << 8) |
+               lz_byte(data, virt + 2u);
+  return (size_t)((v * 2654435761u) >> (32u - LZ_HASH_BITS));
+}
+
+size_t protocol_compress(const char *data,
+                         size_t len,
+                         char *out,
+                         size_t out_size,
+                         int32_t *work)
+{
+  if (data == NULL || out == NULL || work == NULL || len == 0u ||
+      len > 0xffffu || out_size < LZ_HEADER_LEN) {
+    return 0u;
+  }
+
+  // work: hash heads followed by one chain link per virtual position.
+  int32_t *head = work;
+  int32_t *prev = work + LZ_HASH_SIZE;
+  size_t total = LZ_DICT_LEN + len;
+  for (size_t i = 0u; i < LZ_HASH_SIZE; ++i) {
+    head[i] = -1;
+  }
+
+  uint8_t *o = (uint8_t *)out;
+  memcpy(o, PROTOCOL_COMPRESSED_MAGIC, LZ_MAGIC_LEN);
+  o[LZ_MAGIC_LEN] = PROTOCOL_COMPRESSED_VERSION;
+  o[LZ_MAGIC_LEN + 1u] = (uint8_t)(len & 0xffu);
+  o[LZ_MAGIC_LEN + 2u] = (uint8_t)(len >> 8);
+  size_t written = LZ_HEADER_LEN;
+
+  size_t flag_pos = 0u;
+  int bit = 8;
+  size_t virt = 0u;
+
+  while (virt < total) {
+    size_t best_len = 0u;
+    size_t best_off = 0u;
+
+    if (virt + LZ_MIN_MATCH <= total) {
+      size_t h = lz_hash(data, virt);
+      if (virt >= LZ_DICT_LEN) {
+        size_t limit = total - virt;
+        if (limit > LZ_MAX_MATCH) {
+          limit = LZ_MAX_MATCH;
+        }
+        int32_t cand = head[h];
+        for (uint32_t chain = 0u;
+             cand >= 0 && chain < LZ_MAX_CHAIN &&
+             virt - (size_t)cand <= LZ_WINDOW;
+             ++chain, cand = prev[cand]) {
+          size_t n = 0u;
+          while (n < limit &&
+                 lz_byte(data, (size_t)cand + n) == lz_byte(data, virt + n)) {
+            ++n;
+          }
+          if (n > best_len) {
+            best_len = n;
+            best_off = virt - (size_t)cand;
+            if (n == limit) {
+              break;
+            }
+          }
+        }
+      }
+      prev[virt] = head[h];
+      head[h] = (int32_t)virt;
+    }
+
+    // The dictionary is only indexed, never emitted.
+    if (virt < LZ_DICT_LEN) {
+      ++virt;
+      continue;
+    }
+
+    if (bit == 8) {
+      if (written >= out_size) {
+        return 0u;
+      }
+      flag_pos = written++;
+      o[flag_pos] = 0u;
+      bit = 0;
+    }
+
+    if (best_len >= LZ_MIN_MATCH) {
+      if (written + 2u > out_size) {
+        return 0u;
+      }
+      size_t code = best_off - 1u;
+      o[flag_pos] |= (uint8_t)(1u << bit);
+      o[written++] = (uint8_t)(code & 0xffu);
+      o[written++] =
+          (uint8_t)(((code >> 8) & 0x0fu) | ((best_len - LZ_MIN_MATCH) << 4));
+      // Index the positions covered by the match.
+      for (size_t i = 1u; i < best_len; ++i) {
+        if (virt + i + LZ_MIN_MATCH <= total) {
+          size_t h = lz_hash(data, virt + i);
+          prev[virt + i] = head[h];
+          head[h] = (int32_t)(virt + i);
+        }
+      }
+      virt += best_len;
+    } else {
+      if (written >= out_size) {
+        return 0u;
+      }
+      o[written++] = (uint8_t)data[virt - LZ_DICT_LEN];
+      ++virt;
+    }
+    ++bit;
+  }
+  return written;
+}
+
+size_t protocol_compress_work_size(size_t len)
+{
+  return (LZ_HASH_SIZE + LZ_DICT_LEN + len) * sizeof(int32_t);
+}
@@ -0,0 +1,26 @@
+#include "../include/protocol.h"
+
+bool protocol_condition_eval(const protocol_condition_t *condition,
+                             const protocol_condition_state_t *state)
+{
+  if (condition == NULL || state == NULL) {
+    return false;
+  }
+
+  bool result = false;
+  switch (condition->kind) {
+    case PROTOCOL_CONDITION_ELAPSED_MS:
+      result = state->elapsed_ms >= condition->value;
+      break;
+    case PROTOCOL_CONDITION_DISTANCE_MM:
+      result = state->distance_mm >= condition->value;
+      break;
+    case PROTOCOL_CONDITION_BUTTONS:
+      result = (state->buttons_mask & condition->value) != 0u;
+      break;
+    case PROTOCOL_CONDITION_QUEUE_EMPTY:
+      result = state->queue_empty;
+      break;
+  }
+  return result != condition->negate;
+}
@@ -0,0 +1,136 @@
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "deadman.h"
+
+static const char *TAG = "protocol_deadman";
+
+static esp_timer_handle_t s_timer = NULL;
+static void (*s_on_expire)(void) = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+// Held by deadman_fire() from its armed check until on_expire returns, and
+// by feed/disarm, so a frame either lands before the check (and cancels
+// the stop) or after the stop has run.
+static SemaphoreHandle_t s_fire_mutex = NULL;
+
+static bool s_armed = false;
+static int64_t s_last_feed_us = 0;
+static int64_t s_deadline_us = 0;
+static uint32_t s_timeout_ms = 0u;
+static protocol_deadman_stats_t s_stats;
+
+static void deadman_fire(void *arg)
+{
+  xSemaphoreTake(s_fire_mutex, portMAX_DELAY);
+  int64_t now_us = esp_timer_get_time();
+
+  portENTER_CRITICAL(&s_lock);
+  // Disarmed, or re-armed by a frame that raced with this callback.
+  if (!s_armed || now_us < s_deadline_us) {
+    portEXIT_CRITICAL(&s_lock);
+    xSemaphoreGive(s_fire_mutex);
+    return;
+  }
+  s_armed = false;
+  int64_t latency_us = now_us - s_deadline_us;
+  s_stats.expirations++;
+  if (latency_us > s_stats.max_stop_latency_us) {
+    s_stats.max_stop_latency_us = latency_us;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (s_on_expire != NULL) {
+    s_on_expire();
+  }
+  xSemaphoreGive(s_fire_mutex);
+
+  ESP_LOGW(TAG, "Immediate stream timed out, stopped (late by %lldus)",
+           (long long)latency_us);
+}
+
+void deadman_init(void (*on_expire)(void))
+{
+  s_on_expire = on_expire;
+  if (s_timer != NULL) {
+    return;
+  }
+
+  s_fire_mutex = xSemaphoreCreateMutex();
+  if (s_fire_mutex == NULL) {
+    ESP_LOGE(TAG, "Failed to create deadman mutex");
+    return;
+  }
+
+  const esp_timer_create_args_t args = {
+      .callback = deadman_fire,
+      .name = "protocol_deadman",
+  };
+  esp_err_t err = esp_timer_create(&args, &s_timer);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create deadman timer: %s", esp_err_to_name(err));
+    s_timer = NULL;
+  }
+}
+
+void deadman_feed(uint32_t timeout_ms)
+{
+  if (s_timer == NULL) {
+    return;
+  }
+
+  xSemaphoreTake(s_fire_mutex, portMAX_DELAY);
+  int64_t now_us = esp_timer_get_time();
+  uint64_t period_us =
+      ((uint64_t)timeout_ms + CONFIG_ROBOT_PROTOCOL_DEADMAN_GRACE_MS) * 1000u;
+
+  portENTER_CRITICAL(&s_lock);
+  if (s_armed) {
+    int64_t gap_us = now_us - s_last_feed_us;
+    if (gap_us > s_stats.max_gap_us) {
+      s_stats.max_gap_us = gap_us;
+    }
+    // Arrived after the sender's timeout but inside the grace period.
+    if (gap_us > (int64_t)s_timeout_ms * 1000) {
+      s_stats.near_misses++;
+    }
+  }
+  s_stats.frames++;
+  s_armed = true;
+  s_last_feed_us = now_us;
+  s_timeout_ms = timeout_ms;
+  s_deadline_us = now_us + (int64_t)period_us;
+  portEXIT_CRITICAL(&s_lock);
+
+  (void)esp_timer_stop(s_timer);
+  (void)esp_timer_start_once(s_timer, period_us);
+  xSemaphoreGive(s_fire_mutex);
+}
+
+void deadman_disarm(void)
+{
+  if (s_timer == NULL) {
+    return;
+  }
+
+  xSemaphoreTake(s_fire_mutex, portMAX_DELAY);
+  portENTER_CRITICAL(&s_lock);
+  s_armed = false;
+  portEXIT_CRITICAL(&s_lock);
+  (void)esp_timer_stop(s_timer);
+  xSemaphoreGive(s_fire_mutex);
+}
+
+void deadman_get_stats(protocol_deadman_stats_t *stats)
+{
+  if (stats == NULL) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  *stats = s_stats;
+  portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "../include/protocol.h"
+
+// One-shot deadman timer for immediate control. on_expire runs in the
+// esp_timer task, serialised with deadman_feed() and deadman_disarm(): a
+// frame fed while it runs waits for it, so its command is not undone.
+void deadman_init(void (*on_expire)(void));
+
+// Re-arm the deadman for another timeout_ms (+ grace). Call before acting
+// on the frame.
+void deadman_feed(uint32_t timeout_ms);
+
+void deadman_disarm(void);
+
+void deadman_get_stats(protocol_deadman_stats_t *stats);
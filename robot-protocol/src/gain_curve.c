@@ -0,0 +1,258 @@
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gain_curve.h"
+#include "schema.h"
+
+static const char *TAG = "protocol_gain";
+
+#define GAIN_CURVE_POINTS (PROTOCOL_GAIN_CURVE_SEGMENTS + 1)
+#define GAIN_CURVE_MAX_SHIFT 12u // 4096 mm/s per segment
+#define GAIN_Q15_ONE 32767
+
+static bool step_to_shift(uint32_t step_mm_per_s, uint8_t *shift) {
+  for (uint8_t s = 0u; s <= GAIN_CURVE_MAX_SHIFT; ++s) {
+    if (step_mm_per_s == (1u << s)) {
+      *shift = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Breakpoint outputs (0 .. 1) to the Q15 segment layout.
+static void curve_from_points(const float *points,
+                              uint8_t shift,
+                              uint16_t deadband_mm_per_s,
+                              protocol_gain_curve_t *curve) {
+  int32_t q[GAIN_CURVE_POINTS];
+  for (size_t i = 0u; i < GAIN_CURVE_POINTS; ++i) {
+    float p = points[i];
+    if (!(p > 0.0f)) {
+      p = 0.0f;
+    } else if (p > 1.0f) {
+      p = 1.0f;
+    }
+    q[i] = (int32_t)lroundf(p * (float)GAIN_Q15_ONE);
+  }
+
+  memset(curve, 0, sizeof(*curve));
+  for (size_t i = 0u; i < PROTOCOL_GAIN_CURVE_SEGMENTS; ++i) {
+    curve->segments[i].base_q15 = (int16_t)q[i];
+    curve->segments[i].delta_q15 = (int16_t)(q[i + 1] - q[i]);
+  }
+  curve->deadband_mm_per_s = deadband_mm_per_s;
+  curve->step_shift = shift;
+  curve->valid = true;
+}
+
+int32_t protocol_gain_curve_eval(const protocol_gain_curve_t *curve,
+                                 int32_t speed_mm_per_s)
+{
+  uint32_t mag = speed_mm_per_s < 0 ? 0u - (uint32_t)speed_mm_per_s
+                                    : (uint32_t)speed_mm_per_s;
+  if (!curve->valid || mag < curve->deadband_mm_per_s) {
+    return 0;
+  }
+
+  uint32_t i = mag >> curve->step_shift;
+  int32_t out;
+  if (i < PROTOCOL_GAIN_CURVE_SEGMENTS) {
+    int32_t frac = (int32_t)(mag & ((1u << curve->step_shift) - 1u));
+    out = curve->segments[i].base_q15 +
+          ((curve->segments[i].delta_q15 * frac) >> curve->step_shift);
+  } else {
+    const size_t last = PROTOCOL_GAIN_CURVE_SEGMENTS - 1u;
+    out = curve->segments[last].base_q15 + curve->segments[last].delta_q15;
+  }
+  return speed_mm_per_s < 0 ? -out : out;
+}
+
+static float lerp_output(const protocol_gain_sample_t *a,
+                         const protocol_gain_sample_t *b,
+                         float speed) {
+  return a->output + (b->output - a->output) * (speed - a->speed_mm_per_s) /
+                         (b->speed_mm_per_s - a->speed_mm_per_s);
+}
+
+// Invert the measured output -> speed relation at one speed. Only samples
+// that move the wheel faster than every earlier sample are used, so the
+// relation is strictly increasing; outside the measured range the nearest
+// pair is extrapolated.
+static float output_at_speed(const protocol_gain_sample_t *samples,
+                             size_t count,
+                             float speed) {
+  const protocol_gain_sample_t *prev = NULL;
+  const protocol_gain_sample_t *before_prev = NULL;
+  for (size_t i = 0u; i < count; ++i) {
+    const protocol_gain_sample_t *s = &samples[i];
+    if (!(s->speed_mm_per_s > 0.0f) ||
+        (prev != NULL && s->speed_mm_per_s <= prev->speed_mm_per_s)) {
+      continue;
+    }
+    if (prev != NULL && speed <= s->speed_mm_per_s) {
+      return lerp_output(prev, s, speed);
+    }
+    before_prev = prev;
+    prev = s;
+  }
+  return lerp_output(before_prev, prev, speed);
+}
+
+bool protocol_gain_curve_fit(const protocol_gain_sample_t *samples,
+                             size_t count,
+                             uint32_t step_mm_per_s,
+                             protocol_gain_curve_t *curve)
+{
+  uint8_t shift;
+  if (samples == NULL || curve == NULL ||
+      !step_to_shift(step_mm_per_s, &shift)) {
+    return false;
+  }
+
+  size_t moving = 0u;
+  float slowest = 0.0f;
+  float fastest = 0.0f;
+  for (size_t i = 0u; i < count; ++i) {
+    float speed = samples[i].speed_mm_per_s;
+    if (speed > fastest) {
+      if (moving == 0u) {
+        slowest = speed;
+      }
+      fastest = speed;
+      moving++;
+    }
+  }
+  if (moving < 2u) {
+    ESP_LOGW(TAG, "Calibration: wheel moved at fewer than 2 output levels");
+    return false;
+  }
+
+  float points[GAIN_CURVE_POINTS];
+  for (size_t k = 0u; k < GAIN_CURVE_POINTS; ++k) {
+    points[k] = output_at_speed(samples, count, (float)(k << shift));
+  }
+
+  float deadband = floorf(slowest);
+  curve_from_points(points, shift,
+                    deadband > 65535.0f ? 65535u : (uint16_t)deadband, curve);
+  if (fastest < (float)(PROTOCOL_GAIN_CURVE_SEGMENTS << shift)) {
+    ESP_LOGI(TAG, "Calibration: top speed %.0f mm/s is below the table "
+             "range; upper segments are extrapolated", (double)fastest);
+  }
+  return true;
+}
+
+static bool parse_wheel(const cJSON *wheel,
+                        uint8_t shift,
+                        protocol_gain_curve_t *curve) {
+  if (wheel == NULL) {
+    return true;
+  }
+
+  const cJSON *deadband = cJSON_GetObjectItemCaseSensitive(wheel, "deadband");
+  const cJSON *points = cJSON_GetObjectItemCaseSensitive(wheel, "points");
+  if (!cJSON_IsArray(points) ||
+      cJSON_GetArraySize(points) != GAIN_CURVE_POINTS) {
+    ESP_LOGW(TAG, "gain curve needs %d points", GAIN_CURVE_POINTS);
+    return false;
+  }
+
+  float values[GAIN_CURVE_POINTS];
+  size_t i = 0u;
+  const cJSON *point = NULL;
+  cJSON_ArrayForEach(point, points) {
+    if (!cJSON_IsNumber(point) || point->valuedouble < 0.0 ||
+        point->valuedouble > 1.0) {
+      ESP_LOGW(TAG, "gain curve points must be numbers in [0, 1]");
+      return false;
+    }
+    values[i++] = (float)point->valuedouble;
+  }
+
+  uint16_t deadband_mm_per_s = 0u;
+  if (cJSON_IsNumber(deadband) && deadband->valuedouble >= 0.0 &&
+      deadband->valuedouble <= 65535.0) {
+    deadband_mm_per_s = (uint16_t)deadband->valuedouble;
+  }
+
+  curve_from_points(values, shift, deadband_mm_per_s, curve);
+  return true;
+}
+
+bool gain_curves_parse(const cJSON *curves, protocol_drive_config_t *config)
+{
+  if (!cJSON_IsObject(curves)) {
+    ESP_LOGW(TAG, "gain_curves must be an object");
+    return false;
+  }
+
+  const cJSON *step = cJSON_GetObjectItemCaseSensitive(curves, "step");
+  uint8_t shift;
+  if (!cJSON_IsNumber(step) || step->valuedouble < 1.0 ||
+      step->valuedouble > (double)(1u << GAIN_CURVE_MAX_SHIFT) ||
+      step->valuedouble != (double)(uint32_t)step->valuedouble ||
+      !step_to_shift((uint32_t)step->valuedouble, &shift)) {
+    ESP_LOGW(TAG, "gain_curves.step must be a power of two up to %u",
+             1u << GAIN_CURVE_MAX_SHIFT);
+    return false;
+  }
+
+  bool ok = parse_wheel(cJSON_GetObjectItemCaseSensitive(curves, "left"),
+                        shift, &config->gain_curve_left);
+  ok = parse_wheel(cJSON_GetObjectItemCaseSensitive(curves, "right"), shift,
+                   &config->gain_curve_right) && ok;
+  return ok;
+}
+
+static void format_wheel(const char *name,
+                         const protocol_gain_curve_t *curve,
+                         char *buffer,
+                         size_t buffer_size,
+                         size_t *out) {
+  schema_append(buffer, buffer_size, out,
+                ",\"%s\":{\"deadband\":%u,\"points\":[", name,
+                (unsigned)curve->deadband_mm_per_s);
+  for (size_t i = 0u; i < PROTOCOL_GAIN_CURVE_SEGMENTS; ++i) {
+    schema_append(buffer, buffer_size, out, "%.4f,",
+                  (double)curve->segments[i].base_q15 / GAIN_Q15_ONE);
+  }
+  const size_t last = PROTOCOL_GAIN_CURVE_SEGMENTS - 1u;
+  schema_append(buffer, buffer_size, out, "%.4f]}",
+                (double)(curve->segments[last].base_q15 +
+                         curve->segments[last].delta_q15) / GAIN_Q15_ONE);
+}
+
+size_t protocol_format_gain_curves_json(const protocol_gain_curve_t *left,
+                                        const protocol_gain_curve_t *right,
+                                        char *buffer,
+                                        size_t buffer_size)
+{
+  if (buffer == NULL || buffer_size == 0u) {
+    return 0u;
+  }
+  buffer[0] = '\0';
+
+  // Both tables share the step of the first valid one.
+  const protocol_gain_curve_t *ref =
+      (left != NULL && left->valid) ? left : right;
+  if (ref == NULL || !ref->valid) {
+    return 0u;
+  }
+
+  size_t out = 0u;
+  schema_append(buffer, buffer_size, &out,
+                "{\"type\":\"config\",\"drive\":{\"gain_curves\":"
+                "{\"step\":%u",
+                1u << ref->step_shift);
+  if (left != NULL && left->valid && left->step_shift == ref->step_shift) {
+    format_wheel("left", left, buffer, buffer_size, &out);
+  }
+  if (right != NULL && right->valid && right->step_shift == ref->step_shift) {
+    format_wheel("right", right, buffer, buffer_size, &out);
+  }
+  schema_append(buffer, buffer_size, &out, "}}}");
+  return out;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include <cJSON.h>
+
+#include "../include/protocol.h"
+
+// Parse config.drive.gain_curves into config->gain_curve_left/right. A
+// wheel whose table is missing or invalid keeps valid == false. Returns
+// false (with a warning) if the object itself is malformed.
+bool gain_curves_parse(const cJSON *curves, protocol_drive_config_t *config);
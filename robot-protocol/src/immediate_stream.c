@@ -0,0 +1,93 @@
+#include <math.h>
+#include <string.h>
+
+#include "../include/protocol.h"
+
+#define STREAM_DEFAULT_DEADBAND 0.01f
+
+void protocol_immediate_stream_init(protocol_immediate_stream_t *stream,
+                                    uint32_t rate_hz,
+                                    uint32_t timeout_ms)
+{
+  if (stream == NULL) {
+    return;
+  }
+
+  memset(stream, 0, sizeof(*stream));
+  stream->min_interval_ms = (rate_hz > 0u) ? (1000u / rate_hz) : 0u;
+  stream->timeout_ms = timeout_ms;
+  stream->refresh_ms = timeout_ms / 3u;
+  stream->deadband = STREAM_DEFAULT_DEADBAND;
+}
+
+void protocol_immediate_stream_update(protocol_immediate_stream_t *stream,
+                                      float left_frac,
+                                      float right_frac,
+                                      uint32_t buttons_mask)
+{
+  if (stream == NULL) {
+    return;
+  }
+
+  stream->left_frac = left_frac;
+  stream->right_frac = right_frac;
+  stream->buttons_mask = buttons_mask;
+  stream->updates++;
+}
+
+static bool stream_changed(const protocol_immediate_stream_t *stream)
+{
+  return fabsf(stream->left_frac - stream->sent_left_frac) >
+             stream->deadband ||
+         fabsf(stream->right_frac - stream->sent_right_frac) >
+             stream->deadband ||
+         stream->buttons_mask != stream->sent_buttons_mask;
+}
+
+static bool stream_idle(const protocol_immediate_stream_t *stream)
+{
+  return stream->sent_left_frac == 0.0f && stream->sent_right_frac == 0.0f &&
+         stream->sent_buttons_mask == 0u;
+}
+
+size_t protocol_immediate_stream_poll(protocol_immediate_stream_t *stream,
+                                      uint32_t now_ms,
+                                      const char **frame)
+{
+  if (stream == NULL || frame == NULL) {
+    return 0u;
+  }
+
+  bool due;
+  if (!stream->has_sent) {
+    due = true;
+  } else {
+    uint32_t elapsed_ms = now_ms - stream->last_sent_ms;
+    if (stream_changed(stream)) {
+      due = elapsed_ms >= stream->min_interval_ms;
+    } else {
+      due = !stream_idle(stream) && elapsed_ms >= stream->refresh_ms;
+    }
+  }
+  if (!due) {
+    return 0u;
+  }
+
+  protocol_generate_immediate_command(stream->buffer,
+                                      sizeof(stream->buffer),
+                                      stream->left_frac,
+                                      stream->right_frac,
+                                      stream->timeout_ms,
+                                      now_ms,
+                                      stream->buttons_mask);
+
+  stream->has_sent = true;
+  stream->sent_left_frac = stream->left_frac;
+  stream->sent_right_frac = stream->right_frac;
+  stream->sent_buttons_mask = stream->buttons_mask;
+  stream->last_sent_ms = now_ms;
+  stream->frames_sent++;
+
+  *frame = stream->buffer;
+  return strlen(stream->buffer);
+}
@@ -0,0 +1,666 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cJSON.h>
+
+#include "../include/protocol.h"
+#include "schema.h"
+
+#if CONFIG_ROBOT_PROTOCOL_OPTIMIZER
+
+// The drive layer clamps waits to this, so longer sums are not merged.
+#define OPTIMIZE_MAX_WAIT_MS 30000u
+
+// {"type":"sequence","repeat":,"steps":[]} without the repeat digits.
+#define OPTIMIZE_WRAPPER_LEN 40u
+
+typedef struct {
+  bool known;  // a schema command that decodes cleanly
+  protocol_kind_t kind;
+  protocol_args_t args;
+} step_info_t;
+
+typedef struct {
+  protocol_optimize_stats_t *stats;
+  uint64_t budget;  // current dispatched count, kept up to date by the passes
+  bool ok;          // cleared on allocation failure
+} optimize_ctx_t;
+
+static void optimize_steps(optimize_ctx_t *ctx, cJSON *steps, uint32_t depth,
+                           cJSON *owner, uint64_t outer);
+
+static bool has_type(const cJSON *step, const char *type) {
+  const cJSON *t = cJSON_GetObjectItemCaseSensitive(step, "type");
+  return cJSON_IsString(t) && t->valuestring != NULL &&
+         strcmp(t->valuestring, type) == 0;
+}
+
+static bool has_kind(const cJSON *step, const char *kind) {
+  if (cJSON_GetObjectItemCaseSensitive(step, "type") != NULL) {
+    return false;
+  }
+  const cJSON *k = cJSON_GetObjectItemCaseSensitive(step, "kind");
+  return cJSON_IsString(k) && k->valuestring != NULL &&
+         strcmp(k->valuestring, kind) == 0;
+}
+
+// Repeat count as handle_sequence_type() reads it.
+static uint32_t repeat_of(const cJSON *sequence) {
+  const cJSON *repeat = cJSON_GetObjectItemCaseSensitive(sequence, "repeat");
+  if (!cJSON_IsNumber(repeat)) {
+    return 1u;
+  }
+  if (repeat->valuedouble >= (double)CONFIG_ROBOT_PROTOCOL_MAX_STEPS) {
+    return CONFIG_ROBOT_PROTOCOL_MAX_STEPS;
+  }
+  return repeat->valuedouble > 1.0 ? (uint32_t)repeat->valuedouble : 1u;
+}
+
+// A nested sequence with nothing but type, steps and repeat, which can be
+// dissolved into its parent.
+static bool is_plain_sequence(const cJSON *step) {
+  if (!cJSON_IsObject(step) || !has_type(step, "sequence") ||
+      !cJSON_IsArray(cJSON_GetObjectItemCaseSensitive(step, "steps"))) {
+    return false;
+  }
+  const cJSON *item = NULL;
+  cJSON_ArrayForEach(item, step) {
+    if (strcmp(item->string, "type") != 0 &&
+        strcmp(item->string, "steps") != 0 &&
+        strcmp(item->string, "repeat") != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool set_number(optimize_ctx_t *ctx, cJSON *object, const char *key,
+                       double value) {
+  cJSON *item = cJSON_GetObjectItemCaseSensitive(object, key);
+  if (cJSON_IsNumber(item)) {
+    cJSON_SetNumberValue(item, value);
+    return true;
+  }
+  cJSON *number = cJSON_CreateNumber(value);
+  if (number == NULL) {
+    ctx->ok = false;
+    return false;
+  }
+  if (item != NULL) {
+    cJSON_ReplaceItemInObjectCaseSensitive(object, key, number);
+  } else {
+    cJSON_AddItemToObject(object, key, number);
+  }
+  return true;
+}
+
+static void decode_step(const cJSON *step, step_info_t *info) {
+  info->known = false;
+  if (!cJSON_IsObject(step) ||
+      cJSON_GetObjectItemCaseSensitive(step, "type") != NULL) {
+    return;
+  }
+  const cJSON *kind = cJSON_GetObjectItemCaseSensitive(step, "kind");
+  if (!cJSON_IsString(kind) || kind->valuestring == NULL ||
+      !schema_find_kind(kind->valuestring, strlen(kind->valuestring),
+                        &info->kind)) {
+    return;
+  }
+  const char *bad_key = NULL;
+  info->known = schema_decode_json(info->kind, step, &info->args, &bad_key);
+}
+
+// Deepest chain of nested sequences and branches below a step.
+static uint32_t nesting(const cJSON *step) {
+  const cJSON *lists[2] = {NULL, NULL};
+  if (has_type(step, "sequence")) {
+    lists[0] = cJSON_GetObjectItemCaseSensitive(step, "steps");
+  } else if (has_kind(step, "branch")) {
+    lists[0] = cJSON_GetObjectItemCaseSensitive(step, "then");
+    lists[1] = cJSON_GetObjectItemCaseSensitive(step, "else");
+  } else {
+    return 0u;
+  }
+  uint32_t deepest = 0u;
+  for (size_t l = 0u; l < 2u; ++l) {
+    const cJSON *item = NULL;
+    cJSON_ArrayForEach(item, lists[l]) {
+      uint32_t n = nesting(item);
+      if (n > deepest) {
+        deepest = n;
+      }
+    }
+  }
+  return deepest + 1u;
+}
+
+static uint32_t count_steps(const cJSON *steps) {
+  uint32_t count = 0u;
+  const cJSON *step = NULL;
+  cJSON_ArrayForEach(step, steps) {
+    count++;
+    if (has_type(step, "sequence")) {
+      count += count_steps(cJSON_GetObjectItemCaseSensitive(step, "steps"));
+    } else if (has_kind(step, "branch")) {
+      count += count_steps(cJSON_GetObjectItemCaseSensitive(step, "then"));
+      count += count_steps(cJSON_GetObjectItemCaseSensitive(step, "else"));
+    }
+  }
+  return count;
+}
+
+// Steps charged against the robot's per-message budget: every visit
+// counts, and both arms of a branch are parsed.
+static uint64_t count_dispatched(const cJSON *steps) {
+  uint64_t count = 0u;
+  const cJSON *step = NULL;
+  cJSON_ArrayForEach(step, steps) {
+    count++;
+    if (has_type(step, "sequence")) {
+      count += (uint64_t)repeat_of(step) *
+               count_dispatched(
+                   cJSON_GetObjectItemCaseSensitive(step, "steps"));
+    } else if (has_kind(step, "branch")) {
+      count += count_dispatched(cJSON_GetObjectItemCaseSensitive(step, "then"));
+      count += count_dispatched(cJSON_GetObjectItemCaseSensitive(step, "else"));
+    }
+  }
+  return count;
+}
+
+static size_t printed_len(const cJSON *root) {
+  char *text = cJSON_PrintUnformatted(root);
+  if (text == NULL) {
+    return 0u;
+  }
+  size_t len = strlen(text);
+  cJSON_free(text);
+  return len;
+}
+
+// Move the children of steps into a vector the passes below can edit.
+static cJSON **detach_all(cJSON *steps, size_t *count) {
+  size_t n = (size_t)cJSON_GetArraySize(steps);
+  *count = n;
+  if (n == 0u) {
+    return NULL;
+  }
+  cJSON **items = malloc(n * sizeof(*items));
+  if (items == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0u; i < n; ++i) {
+    items[i] = cJSON_DetachItemFromArray(steps, 0);
+  }
+  return items;
+}
+
+static void attach_all(cJSON *steps, cJSON **items, size_t count) {
+  for (size_t i = 0u; i < count; ++i) {
+    cJSON_AddItemToArray(steps, items[i]);
+  }
+}
+
+typedef struct {
+  cJSON **items;
+  size_t count;
+  size_t capacity;
+} step_vec_t;
+
+static bool reserve(optimize_ctx_t *ctx, step_vec_t *vec, size_t extra) {
+  if (vec->count + extra <= vec->capacity) {
+    return true;
+  }
+  size_t capacity = vec->capacity * 2u;
+  if (capacity < vec->count + extra) {
+    capacity = vec->count + extra;
+  }
+  cJSON **grown = realloc(vec->items, capacity * sizeof(*grown));
+  if (grown == NULL) {
+    ctx->ok = false;
+    return false;
+  }
+  vec->items = grown;
+  vec->capacity = capacity;
+  return true;
+}
+
+// {"type":"command","command":{...}} steps become the bare command; nested
+// lists are optimised first. A plain nested sequence is dissolved into
+// this list when it runs once, or when it is the only step and its repeat
+// can be folded into the owner's. Steps move from in to out, which has
+// room for at least n. The list is run outer times the owner's repeat.
+static void simplify_children(optimize_ctx_t *ctx, cJSON **in, size_t n,
+                              step_vec_t *out, uint32_t depth, cJSON *owner,
+                              uint64_t outer) {
+  for (size_t r = 0u; r < n; ++r) {
+    cJSON *step = in[r];
+    const uint64_t visits = outer * repeat_of(owner);
+
+    const cJSON *command = cJSON_GetObjectItemCaseSensitive(step, "command");
+    if (has_type(step, "command") && cJSON_IsObject(command) &&
+        cJSON_GetObjectItemCaseSensitive(command, "type") == NULL) {
+      cJSON *bare = cJSON_DetachItemFromObjectCaseSensitive(step, "command");
+      cJSON_Delete(step);
+      step = bare;
+    }
+
+    // Lists the robot would reject for depth are left untouched.
+    bool keep = true;
+    if (depth < CONFIG_ROBOT_PROTOCOL_MAX_SEQUENCE_DEPTH) {
+      if (has_kind(step, "branch")) {
+        cJSON *then_steps = cJSON_GetObjectItemCaseSensitive(step, "then");
+        cJSON *else_steps = cJSON_GetObjectItemCaseSensitive(step, "else");
+        if (cJSON_IsArray(then_steps)) {
+          optimize_steps(ctx, then_steps, depth + 1u, NULL, visits);
+        }
+        if (cJSON_IsArray(else_steps)) {
+          optimize_steps(ctx, else_steps, depth + 1u, NULL, visits);
+        }
+      } else if (has_type(step, "sequence") &&
+                 cJSON_IsArray(cJSON_GetObjectItemCaseSensitive(step, "steps"))) {
+        cJSON *inner = cJSON_GetObjectItemCaseSensitive(step, "steps");
+        optimize_steps(ctx, inner, depth + 1u, step, visits);
+
+        uint32_t repeat = repeat_of(step);
+        uint64_t folded = (uint64_t)repeat * repeat_of(owner);
+        size_t inner_count = (size_t)cJSON_GetArraySize(inner);
+        bool fold = owner != NULL && n == 1u && repeat > 1u &&
+                    folded < CONFIG_ROBOT_PROTOCOL_MAX_STEPS;
+        // The steps still to come must keep their room in out.
+        if (is_plain_sequence(step) &&
+            (inner_count == 0u || repeat == 1u || fold) &&
+            reserve(ctx, out, inner_count + (n - r - 1u)) &&
+            (!fold || inner_count == 0u ||
+             set_number(ctx, owner, "repeat", (double)folded))) {
+          for (size_t i = 0u; i < inner_count; ++i) {
+            out->items[out->count++] = cJSON_DetachItemFromArray(inner, 0);
+          }
+          keep = false;
+        }
+      }
+    }
+
+    if (keep) {
+      out->items[out->count++] = step;
+    } else {
+      cJSON_Delete(step);
+      ctx->stats->removed++;
+      ctx->budget -= visits;
+    }
+  }
+}
+
+static bool drive_by_distance(const protocol_drive_args_t *d) {
+  return d->speed_mm_per_s > 0 && d->distance_mm > 0u;
+}
+
+// Whether the drive layer ends the step by itself. An unbounded drive keeps
+// running into whatever follows.
+static bool drive_bounded(const protocol_drive_args_t *d) {
+  return drive_by_distance(d) || d->duration_ms > 0u;
+}
+
+static bool merge_drive(optimize_ctx_t *ctx, cJSON *into,
+                        protocol_drive_args_t *a,
+                        const protocol_drive_args_t *b) {
+  if (strcmp(a->direction, b->direction) != 0 ||
+      a->speed_mm_per_s != b->speed_mm_per_s) {
+    return false;
+  }
+  if (drive_by_distance(a) && drive_by_distance(b) &&
+      a->duration_ms == 0u && b->duration_ms == 0u) {
+    uint64_t sum = (uint64_t)a->distance_mm + b->distance_mm;
+    if (sum > UINT32_MAX || !set_number(ctx, into, "distance", (double)sum)) {
+      return false;
+    }
+    a->distance_mm = (uint32_t)sum;
+    return true;
+  }
+  if (a->distance_mm == 0u && b->distance_mm == 0u &&
+      a->duration_ms > 0u && b->duration_ms > 0u) {
+    uint64_t sum = (uint64_t)a->duration_ms + b->duration_ms;
+    if (sum > UINT32_MAX || !set_number(ctx, into, "duration", (double)sum)) {
+      return false;
+    }
+    a->duration_ms = (uint32_t)sum;
+    return true;
+  }
+  return false;
+}
+
+// Two arcs of the same circle at the same speed and turning the same way.
+static bool merge_turn(optimize_ctx_t *ctx, cJSON *into,
+                       protocol_turn_args_t *a,
+                       const protocol_turn_args_t *b) {
+  if (a->radius_mm != b->radius_mm ||
+      a->speed_mm_per_s != b->speed_mm_per_s || a->speed_mm_per_s <= 0 ||
+      a->duration_ms != 0u || b->duration_ms != 0u ||
+      a->angle_deg == 0 || (a->angle_deg > 0) != (b->angle_deg > 0)) {
+    return false;
+  }
+  int64_t sum = (int64_t)a->angle_deg + b->angle_deg;
+  if (sum > INT32_MAX || sum < -INT32_MAX ||
+      !set_number(ctx, into, "angle", (double)sum)) {
+    return false;
+  }
+  a->angle_deg = (int32_t)sum;
+  return true;
+}
+
+static bool same_colour(const protocol_led_hsv_args_t *a,
+                        const protocol_led_hsv_args_t *b) {
+  return a->h == b->h && a->s == b->s && a->v == b->v;
+}
+
+// Merge compatible neighbours and drop steps with no effect. Motion and
+// LED state are only tracked from steps within this list: whatever ran
+// before it (or in the previous repeat) is unknown.
+static size_t peephole(optimize_ctx_t *ctx, cJSON **items, size_t n,
+                       uint64_t visits) {
+  step_info_t *infos = malloc(n * sizeof(*infos));
+  if (infos == NULL) {
+    ctx->ok = false;
+    return n;
+  }
+
+  bool idle = false;  // motors are known to be stopped
+  bool led_known = false;
+  protocol_led_hsv_args_t led;
+  size_t w = 0u;
+
+  for (size_t r = 0u; r < n; ++r) {
+    cJSON *step = items[r];
+    step_info_t info;
+    decode_step(step, &info);
+    step_info_t *prev = w > 0u ? &infos[w - 1u] : NULL;
+    bool prev_same = prev != NULL && prev->known && info.known &&
+                     prev->kind == info.kind;
+    bool drop = false;
+
+    if (!info.known) {
+      idle = false;
+      led_known = false;
+    } else {
+      switch (info.kind) {
+        case PROTOCOL_KIND_WAIT: {
+          uint32_t d = info.args.wait.duration_ms;
+          if (d == 0u && idle) {
+            ctx->stats->removed++;
+            drop = true;
+          } else if (prev_same && d > 0u &&
+                     prev->args.wait.duration_ms > 0u &&
+                     (uint64_t)prev->args.wait.duration_ms + d <=
+                         OPTIMIZE_MAX_WAIT_MS &&
+                     set_number(ctx, items[w - 1u], "duration",
+                                prev->args.wait.duration_ms + d)) {
+            prev->args.wait.duration_ms += d;
+            ctx->stats->merged++;
+            drop = true;
+          }
+          // A wait does not stop the motors: an unbounded drive keeps
+          // running through it, so idle stays as it was.
+          break;
+        }
+        case PROTOCOL_KIND_DRIVE:
+          if (prev_same && drive_bounded(&prev->args.drive) &&
+              merge_drive(ctx, items[w - 1u], &prev->args.drive,
+                          &info.args.drive)) {
+            ctx->stats->merged++;
+            drop = true;
+          }
+          idle = drive_bounded(&info.args.drive);
+          break;
+        case PROTOCOL_KIND_TURN:
+          if (prev_same && merge_turn(ctx, items[w - 1u], &prev->args.turn,
+                                      &info.args.turn)) {
+            ctx->stats->merged++;
+            drop = true;
+          }
+          idle = info.args.turn.angle_deg != 0 ||
+                 info.args.turn.duration_ms > 0u;
+          break;
+        case PROTOCOL_KIND_LED_HSV:
+          if (led_known && same_colour(&led, &info.args.led_hsv)) {
+            ctx->stats->removed++;
+            drop = true;
+          } else if (prev_same) {
+            // Overwritten before anything else runs.
+            cJSON_Delete(items[--w]);
+            ctx->stats->removed++;
+            ctx->budget -= visits;
+          }
+          led_known = true;
+          led = info.args.led_hsv;
+          break;
+        case PROTOCOL_KIND_STOP:
+          if (prev_same) {
+            ctx->stats->removed++;
+            drop = true;
+          }
+          idle = true;
+          break;
+        default:
+          idle = false;
+          break;
+      }
+    }
+
+    if (drop) {
+      cJSON_Delete(step);
+      ctx->budget -= visits;
+    } else {
+      items[w] = step;
+      infos[w] = info;
+      w++;
+    }
+  }
+
+  free(infos);
+  return w;
+}
+
+static uint32_t decimal_digits(uint32_t v) {
+  uint32_t digits = 1u;
+  while (v >= 10u) {
+    v /= 10u;
+    digits++;
+  }
+  return digits;
+}
+
+// Replace runs of a repeated block with a nested sequence where that is
+// shorter. Blocks are compared by their printed form. When the whole list
+// is one block repeated, the owner's repeat is multiplied instead; a new
+// nested sequence costs one more step per visit of the list, which must
+// stay within the budget.
+static size_t hoist(optimize_ctx_t *ctx, cJSON **items, size_t n,
+                    uint32_t depth, cJSON *owner, uint64_t outer) {
+  const uint64_t visits = outer * repeat_of(owner);
+  if (n < 2u || depth >= CONFIG_ROBOT_PROTOCOL_MAX_SEQUENCE_DEPTH) {
+    return n;
+  }
+  char **text = calloc(n, sizeof(*text));
+  size_t *len = malloc(n * sizeof(*len));
+  uint32_t *depths = malloc(n * sizeof(*depths));
+  if (text == NULL || len == NULL || depths == NULL) {
+    ctx->ok = false;
+    free(text);
+    free(len);
+    free(depths);
+    return n;
+  }
+  bool printed = true;
+  for (size_t i = 0u; i < n && printed; ++i) {
+    text[i] = cJSON_PrintUnformatted(items[i]);
+    printed = text[i] != NULL;
+    len[i] = printed ? strlen(text[i]) : 0u;
+    depths[i] = nesting(items[i]);
+  }
+
+  size_t w = 0u;
+  size_t i = 0u;
+  while (printed && i < n) {
+    size_t best_k = 0u;
+    uint32_t best_r = 0u;
+    int64_t best_gain = 0;
+
+    for (size_t k = 1u; i + 2u * k <= n; ++k) {
+      size_t block_len = 0u;
+      uint32_t deepest = 0u;
+      for (size_t j = i; j < i + k; ++j) {
+        block_len += len[j] + 1u;
+        if (depths[j] > deepest) {
+          deepest = depths[j];
+        }
+      }
+      uint32_t r = 1u;
+      while (i + (r + 1u) * k <= n) {
+        size_t base = i + r * k;
+        size_t j = 0u;
+        while (j < k && len[base + j] == len[i + j] &&
+               strcmp(text[base + j], text[i + j]) == 0) {
+          j++;
+        }
+        if (j < k) {
+          break;
+        }
+        r++;
+      }
+      if (r < 2u) {
+        continue;
+      }
+
+      bool whole = owner != NULL && i == 0u && r * k == n &&
+                   (uint64_t)r * repeat_of(owner) <
+                       CONFIG_ROBOT_PROTOCOL_MAX_STEPS;
+      if (!whole &&
+          (depth + 1u + deepest > CONFIG_ROBOT_PROTOCOL_MAX_SEQUENCE_DEPTH ||
+           ctx->budget + visits > CONFIG_ROBOT_PROTOCOL_MAX_STEPS)) {
+        continue;
+      }
+      int64_t gain = (int64_t)(r - 1u) * (int64_t)block_len -
+                     (whole ? 0 : OPTIMIZE_WRAPPER_LEN + decimal_digits(r));
+      if (gain > best_gain) {
+        best_gain = gain;
+        best_k = k;
+        best_r = r;
+      }
+    }
+
+    if (best_r < 2u) {
+      items[w++] = items[i++];
+      continue;
+    }
+
+    size_t end = i + best_r * best_k;
+    if (owner != NULL && i == 0u && end == n &&
+        (uint64_t)best_r * repeat_of(owner) < CONFIG_ROBOT_PROTOCOL_MAX_STEPS) {
+      if (!set_number(ctx, owner, "repeat",
+                      (double)best_r * repeat_of(owner))) {
+        break;
+      }
+      for (size_t j = 0u; j < best_k; ++j) {
+        items[w++] = items[i + j];
+      }
+    } else {
+      cJSON *wrapper = cJSON_CreateObject();
+      cJSON *steps = cJSON_CreateArray();
+      if (wrapper == NULL || steps == NULL ||
+          cJSON_AddStringToObject(wrapper, "type", "sequence") == NULL ||
+          cJSON_AddNumberToObject(wrapper, "repeat", best_r) == NULL) {
+        cJSON_Delete(wrapper);
+        cJSON_Delete(steps);
+        ctx->ok = false;
+        break;
+      }
+      cJSON_AddItemToObject(wrapper, "steps", steps);
+      for (size_t j = 0u; j < best_k; ++j) {
+        cJSON_AddItemToArray(steps, items[i + j]);
+      }
+      items[w++] = wrapper;
+      ctx->budget += visits;
+    }
+    for (size_t j = i + best_k; j < end; ++j) {
+      cJSON_Delete(items[j]);
+    }
+    ctx->stats->hoisted++;
+    i = end;
+  }
+  // Anything left after a failure is kept as it was.
+  while (i < n) {
+    items[w++] = items[i++];
+  }
+
+  for (size_t j = 0u; j < n; ++j) {
+    cJSON_free(text[j]);
+  }
+  free(text);
+  free(len);
+  free(depths);
+  return w;
+}
+
+// depth counts the sequences and branches enclosing the list, the
+// message itself being 1. owner is the sequence holding the list, whose
+// repeat may be changed, or NULL for branch arms. outer is how often the
+// list holding owner runs.
+static void optimize_steps(optimize_ctx_t *ctx, cJSON *steps, uint32_t depth,
+                           cJSON *owner, uint64_t outer) {
+  size_t n = 0u;
+  cJSON **in = detach_all(steps, &n);
+  if (in == NULL) {
+    if (n > 0u) {
+      ctx->ok = false;
+    }
+    return;
+  }
+
+  step_vec_t out = {.items = malloc(n * sizeof(cJSON *)), .count = 0u,
+                    .capacity = n};
+  if (out.items == NULL) {
+    ctx->ok = false;
+    attach_all(steps, in, n);
+    free(in);
+    return;
+  }
+  simplify_children(ctx, in, n, &out, depth, owner, outer);
+  free(in);
+
+  n = peephole(ctx, out.items, out.count, outer * repeat_of(owner));
+  n = hoist(ctx, out.items, n, depth, owner, outer);
+
+  attach_all(steps, out.items, n);
+  free(out.items);
+}
+
+bool protocol_optimize_sequence(cJSON *sequence,
+                                protocol_optimize_stats_t *stats)
+{
+  protocol_optimize_stats_t local;
+  if (stats == NULL) {
+    stats = &local;
+  }
+  memset(stats, 0, sizeof(*stats));
+
+  cJSON *steps = cJSON_GetObjectItemCaseSensitive(sequence, "steps");
+  if (!cJSON_IsObject(sequence) || !cJSON_IsArray(steps)) {
+    return false;
+  }
+
+  stats->steps_before = count_steps(steps);
+  stats->dispatched_before = count_dispatched(steps) * repeat_of(sequence);
+  stats->bytes_before = printed_len(sequence);
+
+  optimize_ctx_t ctx = {
+      .stats = stats, .budget = stats->dispatched_before, .ok = true};
+  optimize_steps(&ctx, steps, 1u, sequence, 1u);
+
+  stats->steps_after = count_steps(steps);
+  stats->dispatched_after = count_dispatched(steps) * repeat_of(sequence);
+  stats->bytes_after = printed_len(sequence);
+  return ctx.ok;
+}
+
+#endif
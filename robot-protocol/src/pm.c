@@ -0,0 +1,171 @@
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+#include "pm.h"
+
+static const char *TAG = "protocol_pm";
+
+#define PM_IDLE_US ((int64_t)CONFIG_ROBOT_PROTOCOL_PM_IDLE_MS * 1000)
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_idle_timer = NULL;
+static bool s_held = false;
+static int64_t s_held_since_us = 0;
+static int64_t s_last_activity_us = 0;
+static bool s_latency_pending = false;
+static bool s_held_at_receive = false;
+static protocol_pm_stats_t s_stats;
+
+#if CONFIG_PM_ENABLE && CONFIG_ROBOT_PROTOCOL_PM_LOCKS
+static esp_pm_lock_handle_t s_cpu_lock = NULL;
+static esp_pm_lock_handle_t s_sleep_lock = NULL;
+
+static void locks_acquire(void)
+{
+  (void)esp_pm_lock_acquire(s_cpu_lock);
+  (void)esp_pm_lock_acquire(s_sleep_lock);
+}
+
+static void locks_release(void)
+{
+  (void)esp_pm_lock_release(s_sleep_lock);
+  (void)esp_pm_lock_release(s_cpu_lock);
+}
+#endif
+
+// Runs in the esp_timer task once the idle period since the first
+// activity has passed; re-arms itself until the traffic actually stops,
+// so a 50 Hz stream does not restart the timer on every frame.
+static void pm_idle_check(void *arg)
+{
+  int64_t now_us = esp_timer_get_time();
+
+  portENTER_CRITICAL(&s_lock);
+  if (!s_held) {
+    portEXIT_CRITICAL(&s_lock);
+    return;
+  }
+  int64_t remaining_us = s_last_activity_us + PM_IDLE_US - now_us;
+  bool release = remaining_us <= 0;
+  if (release) {
+    s_held = false;
+    s_stats.held_us += (uint64_t)(now_us - s_held_since_us);
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (!release) {
+    (void)esp_timer_start_once(s_idle_timer, (uint64_t)remaining_us);
+    return;
+  }
+#if CONFIG_PM_ENABLE && CONFIG_ROBOT_PROTOCOL_PM_LOCKS
+  // Lock counts make a concurrent pm_activity() acquire safe here.
+  locks_release();
+#endif
+  ESP_LOGD(TAG, "Control idle, PM locks released");
+}
+
+void pm_init(void)
+{
+  if (s_idle_timer != NULL) {
+    return;
+  }
+
+#if CONFIG_PM_ENABLE && CONFIG_ROBOT_PROTOCOL_PM_LOCKS
+  esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "protocol_cpu",
+                                     &s_cpu_lock);
+  if (err == ESP_OK) {
+    err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "protocol_sleep",
+                             &s_sleep_lock);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create PM locks: %s", esp_err_to_name(err));
+    return;
+  }
+#endif
+
+  const esp_timer_create_args_t args = {
+      .callback = pm_idle_check,
+      .name = "protocol_pm_idle",
+  };
+  esp_err_t timer_err = esp_timer_create(&args, &s_idle_timer);
+  if (timer_err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create PM idle timer: %s",
+             esp_err_to_name(timer_err));
+    s_idle_timer = NULL;
+  }
+}
+
+void pm_activity(void)
+{
+  if (s_idle_timer == NULL) {
+    return;
+  }
+
+  int64_t now_us = esp_timer_get_time();
+
+  portENTER_CRITICAL(&s_lock);
+  bool acquire = !s_held;
+  s_last_activity_us = now_us;
+  if (acquire) {
+    s_held = true;
+    s_held_since_us = now_us;
+    s_stats.acquisitions++;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (!acquire) {
+    return;
+  }
+#if CONFIG_PM_ENABLE && CONFIG_ROBOT_PROTOCOL_PM_LOCKS
+  locks_acquire();
+#endif
+  ESP_LOGD(TAG, "Control active, PM locks taken");
+  (void)esp_timer_start_once(s_idle_timer, (uint64_t)PM_IDLE_US);
+}
+
+void pm_note_receive(int64_t rx_us, bool external)
+{
+  portENTER_CRITICAL(&s_lock);
+  s_latency_pending = external;
+  s_held_at_receive = s_held && s_held_since_us <= rx_us;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void pm_note_dispatch(int64_t rx_us)
+{
+  int64_t latency_us = esp_timer_get_time() - rx_us;
+
+  portENTER_CRITICAL(&s_lock);
+  if (s_latency_pending && latency_us >= 0) {
+    protocol_latency_stats_t *stats =
+        s_held_at_receive ? &s_stats.locked : &s_stats.unlocked;
+    stats->count++;
+    stats->total_us += (uint64_t)latency_us;
+    if ((uint32_t)latency_us > stats->max_us) {
+      stats->max_us = (uint32_t)latency_us;
+    }
+  }
+  s_latency_pending = false;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void pm_get_stats(protocol_pm_stats_t *stats)
+{
+  if (stats == NULL) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  portENTER_CRITICAL(&s_lock);
+  *stats = s_stats;
+  if (s_held) {
+    stats->held_us += (uint64_t)(now_us - s_held_since_us);
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
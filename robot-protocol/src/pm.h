@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../include/protocol.h"
+
+// Power-management locks held while control traffic is active.
+
+void pm_init(void);
+
+// Note control activity (immediate frame or sequence): take the locks if
+// they are not held and push back the idle release.
+void pm_activity(void);
+
+// Record the receive-to-dispatch latency of the current message against
+// the lock state at rx_us. Only messages whose rx_us came from the
+// transport (external) are recorded: timed from entry into the decoder
+// the interval would only cover parsing. Only the first dispatch per
+// message counts.
+void pm_note_receive(int64_t rx_us, bool external);
+void pm_note_dispatch(int64_t rx_us);
+
+void pm_get_stats(protocol_pm_stats_t *stats);
@@ -0,0 +1,119 @@
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "profiles.h"
+
+static const char *TAG = "protocol_profiles";
+
+#define PROFILES_NVS_NAMESPACE "robot_proto"
+
+typedef struct {
+  bool valid;
+  protocol_drive_config_t config;
+} profile_slot_t;
+
+static profile_slot_t s_profiles[CONFIG_ROBOT_PROTOCOL_DRIVE_PROFILES];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int32_t s_pending = -1;
+
+static void profile_key(uint32_t id, char *key, size_t key_size)
+{
+  snprintf(key, key_size, "profile%u", (unsigned)id);
+}
+
+void protocol_load_drive_profiles(void)
+{
+  nvs_handle_t nvs;
+  if (nvs_open(PROFILES_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+    return;
+  }
+
+  for (uint32_t id = 0u; id < CONFIG_ROBOT_PROTOCOL_DRIVE_PROFILES; ++id) {
+    char key[16];
+    profile_key(id, key, sizeof(key));
+
+    protocol_drive_config_t config;
+    size_t size = sizeof(config);
+    if (nvs_get_blob(nvs, key, &config, &size) != ESP_OK ||
+        size != sizeof(config)) {
+      continue;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_profiles[id].config = config;
+    s_profiles[id].valid = true;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Loaded drive profile %u", (unsigned)id);
+  }
+  nvs_close(nvs);
+}
+
+bool profiles_store(uint32_t id, const protocol_drive_config_t *config)
+{
+  if (id >= CONFIG_ROBOT_PROTOCOL_DRIVE_PROFILES) {
+    ESP_LOGW(TAG, "Drive profile id %u out of range", (unsigned)id);
+    return false;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  s_profiles[id].config = *config;
+  s_profiles[id].valid = true;
+  portEXIT_CRITICAL(&s_lock);
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(PROFILES_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    char key[16];
+    profile_key(id, key, sizeof(key));
+    err = nvs_set_blob(nvs, key, config, sizeof(*config));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to persist drive profile %u: %s", (unsigned)id,
+             esp_err_to_name(err));
+  }
+  return true;
+}
+
+bool profiles_select(uint32_t id)
+{
+  if (id >= CONFIG_ROBOT_PROTOCOL_DRIVE_PROFILES) {
+    ESP_LOGW(TAG, "Drive profile id %u out of range", (unsigned)id);
+    return false;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  bool valid = s_profiles[id].valid;
+  if (valid) {
+    s_pending = (int32_t)id;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (!valid) {
+    ESP_LOGW(TAG, "Drive profile %u is empty", (unsigned)id);
+  }
+  return valid;
+}
+
+bool protocol_take_drive_profile(protocol_drive_config_t *config)
+{
+  if (config == NULL || s_pending < 0) {
+    return false;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  int32_t id = s_pending;
+  if (id >= 0) {
+    *config = s_profiles[id].config;
+    s_pending = -1;
+  }
+  portEXIT_CRITICAL(&s_lock);
+  return id >= 0;
+}
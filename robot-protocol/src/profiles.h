@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../include/protocol.h"
+
+// Store a profile in RAM and NVS. Returns false if id is out of range.
+bool profiles_store(uint32_t id, const protocol_drive_config_t *config);
+
+// Mark a stored profile for pickup by protocol_take_drive_profile().
+// Returns false if id is out of range or the slot is empty.
+bool profiles_select(uint32_t id);
@@ -7,13 +7,58 @@
 #include <cJSON.h>
 
 #include "../include/protocol.h"
+#include "bench.h"
+#include "gain_curve.h"
+#include "deadman.h"
+#include "pm.h"
+#include "profiles.h"
+#include "scan.h"
+#include "schema.h"
+#include "trace.h"
 
 static const char *TAG = "protocol";
 
 static protocol_handlers_t s_handlers;
 
+// Table the decoder dispatches to: s_handlers, or kBenchHandlers while
+// protocol_bench_dispatch() runs. Only used from the protocol task.
+static const protocol_handlers_t kBenchHandlers = {0};
+static const protocol_handlers_t *s_active = &s_handlers;
+static bool s_benchmarking = false;
+
+// Per-message work budget, reset by begin_message().
+static uint32_t s_steps_left = 0u;
+static uint32_t s_sequence_depth = 0u;
+static uint32_t s_branch_depth = 0u;
+
 static void handle_command(const cJSON *root, const cJSON *type);
 
+static void message_received(void) {
+  if (s_benchmarking) {
+    return;
+  }
+  trace_receive();
+  pm_note_receive(trace_rx_time_us(), trace_rx_time_external());
+}
+
+// Called before any handler runs; only the first call per message counts.
+static void message_dispatched(void) {
+  if (s_benchmarking) {
+    return;
+  }
+  trace_dispatch();
+  pm_note_dispatch(trace_rx_time_us());
+}
+
+#if CONFIG_ROBOT_PROTOCOL_DEADMAN
+static void deadman_stop(void)
+{
+  if (s_handlers.stop != NULL) {
+    s_handlers.stop();
+  }
+}
+#endif
+
 void protocol_set_handlers(const protocol_handlers_t *handlers)
 {
   if (handlers != NULL) {
@@ -22,150 +67,482 @@ void protocol_set_handlers(const protocol_handlers_t *handlers)
     protocol_handlers_t empty = {0};
     s_handlers = empty;
   }
+#if CONFIG_ROBOT_PROTOCOL_DEADMAN
+  deadman_init(deadman_stop);
+#endif
+  pm_init();
+}
+
+void protocol_get_pm_stats(protocol_pm_stats_t *stats)
+{
+  pm_get_stats(stats);
+}
+
+void protocol_get_deadman_stats(protocol_deadman_stats_t *stats)
+{
+  deadman_get_stats(stats);
+}
+
+// Called for commands that take over from an immediate stream.
+static void deadman_release(void)
+{
+#if CONFIG_ROBOT_PROTOCOL_DEADMAN
+  if (s_benchmarking) {
+    return;
+  }
+  deadman_disarm();
+#endif
 }
 
-static bool handle_drive_command(const cJSON *command) {
-  const cJSON *direction =
-      cJSON_GetObjectItemCaseSensitive(command, "direction");
-  const cJSON *speed = cJSON_GetObjectItemCaseSensitive(command, "speed");
-  const cJSON *duration = cJSON_GetObjectItemCaseSensitive(command, "duration");
-  const cJSON *distance = cJSON_GetObjectItemCaseSensitive(command, "distance");
+static bool handle_drive(const protocol_drive_args_t *args) {
+  ESP_LOGD(TAG,
+           "drive: direction=%s, speed=%d, duration=%u, distance=%u",
+           args->direction, (int)args->speed_mm_per_s,
+           (unsigned)args->duration_ms, (unsigned)args->distance_mm);
 
-  if (!cJSON_IsString(direction) || direction->valuestring == NULL ||
-      !cJSON_IsNumber(speed)) {
-    ESP_LOGW(TAG, "Invalid drive command payload");
+  if (s_active->drive != NULL) {
+    s_active->drive(args->direction,
+                     args->speed_mm_per_s,
+                     args->duration_ms,
+                     args->distance_mm);
+  }
+  return true;
+}
+
+static bool handle_turn(const protocol_turn_args_t *args) {
+  // Require at least one of speed or duration.
+  if (args->speed_mm_per_s <= 0 && args->duration_ms == 0u) {
+    ESP_LOGW(TAG, "Turn command requires speed or duration");
     return false;
   }
 
-  int32_t speed_mm_per_s = (int32_t)speed->valuedouble;
-  uint32_t duration_ms = (duration != NULL && cJSON_IsNumber(duration))
-                             ? (uint32_t)duration->valuedouble
-                             : 0u;
-  uint32_t distance_mm = (distance != NULL && cJSON_IsNumber(distance))
-                             ? (uint32_t)distance->valuedouble
-                             : 0u;
   ESP_LOGD(TAG,
-           "drive: direction=%s, speed=%d, duration=%d, distance=%d",
-           direction->valuestring, speed_mm_per_s, duration_ms, distance_mm);
+           "turn: radius=%d, angle=%d, speed=%d, duration=%u",
+           (int)args->radius_mm, (int)args->angle_deg,
+           (int)args->speed_mm_per_s, (unsigned)args->duration_ms);
 
-  if (s_handlers.drive != NULL) {
-    s_handlers.drive(direction->valuestring,
-                     speed_mm_per_s,
-                     duration_ms,
-                     distance_mm);
+  if (s_active->turn != NULL) {
+    s_active->turn(args->radius_mm,
+                    args->angle_deg,
+                    args->speed_mm_per_s,
+                    args->duration_ms);
   }
   return true;
 }
 
-static bool handle_turn_command(const cJSON *command) {
-  const cJSON *radius = cJSON_GetObjectItemCaseSensitive(command, "radius");
-  const cJSON *angle = cJSON_GetObjectItemCaseSensitive(command, "angle");
-  const cJSON *speed = cJSON_GetObjectItemCaseSensitive(command, "speed");
-  const cJSON *duration = cJSON_GetObjectItemCaseSensitive(command, "duration");
+static bool handle_led_hsv(const protocol_led_hsv_args_t *args) {
+  uint16_t hue = (uint16_t)args->h;
+  uint8_t sat = (uint8_t)args->s;
+  uint8_t val = (uint8_t)args->v;
 
-  if (!cJSON_IsNumber(radius) || !cJSON_IsNumber(angle)) {
-    ESP_LOGW(TAG, "Invalid turn command payload (radius/angle)");
-    return false;
+  ESP_LOGD(TAG, "led_hsv: h=%u s=%u v=%u", (unsigned)hue,
+           (unsigned)sat, (unsigned)val);
+
+  if (s_active->set_led_hsv != NULL) {
+    s_active->set_led_hsv(hue, sat, val);
   }
+  return true;
+}
 
-  int32_t radius_mm = (int32_t)radius->valuedouble;
-  int32_t angle_deg = (int32_t)angle->valuedouble;
+// The handler's now_ms is the local receive time; args->now_ms is the
+// sender's clock and only logged.
+static bool handle_immediate(const protocol_immediate_args_t *args) {
+  uint32_t now_ms = (uint32_t)esp_log_timestamp();
 
-  int32_t speed_mm_per_s = 0;
-  uint32_t duration_ms = 0u;
+  ESP_LOGD(TAG,
+           "immediate: left=%f, right=%f, timeout=%u, now=%u, sent=%u, "
+           "buttons=%u",
+           (double)args->left_frac,
+           (double)args->right_frac,
+           (unsigned)args->timeout_ms,
+           (unsigned)now_ms,
+           (unsigned)args->now_ms,
+           (unsigned)args->buttons_mask);
 
-  if (cJSON_IsNumber(speed)) {
-    speed_mm_per_s = (int32_t)speed->valuedouble;
+  if (!s_benchmarking) {
+#if CONFIG_ROBOT_PROTOCOL_DEADMAN
+    deadman_feed(args->timeout_ms);
+#endif
+    pm_activity();
   }
-  if (cJSON_IsNumber(duration)) {
-    duration_ms = (uint32_t)duration->valuedouble;
+
+  if (s_active->immediate != NULL) {
+    s_active->immediate(args->left_frac,
+                         args->right_frac,
+                         args->timeout_ms,
+                         now_ms,
+                         args->buttons_mask);
   }
+  return true;
+}
 
-  // Require at least one of speed or duration.
-  if (speed_mm_per_s <= 0 && duration_ms == 0u) {
-    ESP_LOGW(TAG, "Turn command requires speed or duration");
+// The robot is stopped first, since the run blocks the protocol task for
+// longer than any immediate timeout. Corpus commands go through
+// protocol_bench_dispatch(), so they reach no handler.
+static bool handle_bench(const protocol_bench_args_t *args) {
+#if CONFIG_ROBOT_PROTOCOL_BENCH
+  if (s_sequence_depth > 0u || s_benchmarking) {
+    ESP_LOGW(TAG, "bench is not allowed inside a sequence");
     return false;
   }
 
-  ESP_LOGD(TAG,
-           "turn: radius=%d, angle=%d, speed=%d, duration=%u",
-           radius_mm, angle_deg, speed_mm_per_s, (unsigned)duration_ms);
+  deadman_release();
+  if (s_handlers.stop != NULL) {
+    s_handlers.stop();
+  }
+  bench_run(&s_handlers, args->iterations);
+  return true;
+#else
+  (void)args;
+  ESP_LOGW(TAG, "bench: not built (CONFIG_ROBOT_PROTOCOL_BENCH)");
+  return false;
+#endif
+}
+
+static bool handle_profile(const protocol_profile_args_t *args) {
+  if (s_sequence_depth > 0u) {
+    ESP_LOGW(TAG, "profile is not allowed inside a sequence");
+    return false;
+  }
+  if (s_active->profile == NULL) {
+    ESP_LOGW(TAG, "profile: no handler");
+    return false;
+  }
+  s_active->profile(args->duration_ms);
+  return true;
+}
+
+static bool handle_sched_bench(const protocol_sched_bench_args_t *args) {
+  if (s_sequence_depth > 0u) {
+    ESP_LOGW(TAG, "sched_bench is not allowed inside a sequence");
+    return false;
+  }
+  if (s_active->sched_bench == NULL) {
+    ESP_LOGW(TAG, "sched_bench: no handler");
+    return false;
+  }
+  s_active->sched_bench(args->duration_ms);
+  return true;
+}
 
-  if (s_handlers.turn != NULL) {
-    s_handlers.turn(radius_mm, angle_deg, speed_mm_per_s, duration_ms);
+// The run spins the wheels through their whole range, so it is only
+// accepted as a standalone command.
+static bool handle_calibrate(const protocol_calibrate_args_t *args) {
+  if (s_sequence_depth > 0u) {
+    ESP_LOGW(TAG, "calibrate is not allowed inside a sequence");
+    return false;
   }
+  if (s_active->calibrate == NULL) {
+    ESP_LOGW(TAG, "calibrate: no handler");
+    return false;
+  }
+  if (args->duty_steps < 2u || args->sample_ms == 0u) {
+    ESP_LOGW(TAG, "calibrate: need at least 2 steps and sample_ms > 0");
+    return false;
+  }
+  deadman_release();
+  s_active->calibrate(args->duty_steps,
+                       args->settle_ms,
+                       args->sample_ms,
+                       args->step_mm_per_s);
   return true;
 }
 
-static bool handle_led_hsv_command(const cJSON *command) {
-  const cJSON *h = cJSON_GetObjectItemCaseSensitive(command, "h");
-  const cJSON *s = cJSON_GetObjectItemCaseSensitive(command, "s");
-  const cJSON *v = cJSON_GetObjectItemCaseSensitive(command, "v");
+// Branch arms are queued and only one of them runs, so they may only hold
+// kinds that go through the executor queue. Anything else would take
+// effect while the message is parsed, whatever the condition.
+static bool queued_kind(protocol_kind_t kind) {
+  switch (kind) {
+    case PROTOCOL_KIND_DRIVE:
+    case PROTOCOL_KIND_TURN:
+    case PROTOCOL_KIND_LED_HSV:
+    case PROTOCOL_KIND_WAIT:
+    case PROTOCOL_KIND_STOP:
+      return true;
+    default:
+      return false;
+  }
+}
 
-  if (!cJSON_IsNumber(h)) {
-    ESP_LOGW(TAG, "Invalid led_hsv command payload (missing h)");
+// Dispatch a decoded command of any schema kind.
+static bool dispatch_args(protocol_kind_t kind, const protocol_args_t *args) {
+  if (s_branch_depth > 0u && !queued_kind(kind)) {
+    ESP_LOGW(TAG, "%s is not allowed inside a branch",
+             protocol_kind_name(kind));
     return false;
   }
+  message_dispatched();
+  switch (kind) {
+    case PROTOCOL_KIND_DRIVE:
+      deadman_release();
+      return handle_drive(&args->drive);
+    case PROTOCOL_KIND_TURN:
+      deadman_release();
+      return handle_turn(&args->turn);
+    case PROTOCOL_KIND_LED_HSV:
+      return handle_led_hsv(&args->led_hsv);
+    case PROTOCOL_KIND_IMMEDIATE:
+      return handle_immediate(&args->immediate);
+    case PROTOCOL_KIND_WAIT:
+      if (s_active->wait != NULL) {
+        s_active->wait(args->wait.duration_ms);
+      }
+      return true;
+    case PROTOCOL_KIND_SELECT_PROFILE:
+      return profiles_select(args->select_profile.id);
+    case PROTOCOL_KIND_STOP:
+      deadman_release();
+      if (s_active->stop != NULL) {
+        s_active->stop();
+      }
+      return true;
+    case PROTOCOL_KIND_PAUSE:
+      // will stop the current command, stop moving, but keep the queue
+      // drive_command_pause();
+      return true;
+    case PROTOCOL_KIND_RESUME:
+      // if paused, will resume the current command, and continue processing
+      // the queue drive_command_resume();
+      return true;
+    case PROTOCOL_KIND_CLEAR_QUEUE:
+      // clears the queue, and stops the current command (?)
+      deadman_release();
+      if (s_active->clear_queue != NULL) {
+        s_active->clear_queue();
+      }
+      return true;
+    case PROTOCOL_KIND_BENCH:
+      return handle_bench(&args->bench);
+    case PROTOCOL_KIND_PROFILE:
+      return handle_profile(&args->profile);
+    case PROTOCOL_KIND_CALIBRATE:
+      return handle_calibrate(&args->calibrate);
+    case PROTOCOL_KIND_SCHED_BENCH:
+      return handle_sched_bench(&args->sched_bench);
+    case PROTOCOL_KIND_COUNT:
+      break;
+  }
+  return false;
+}
 
-  uint16_t hue = (uint16_t)h->valuedouble;
-  uint8_t sat = cJSON_IsNumber(s) ? (uint8_t)s->valuedouble : 255u;
-  uint8_t val = cJSON_IsNumber(v) ? (uint8_t)v->valuedouble : 32u;
+/* Fast path for single commands, the immediate stream in particular. The
+ * bare command object is indexed in one pass by scan_object() and decoded
+ * through the schema tables without building a cJSON tree. Returns false
+ * if the body is not a plain schema command (unknown kind, invalid or
+ * escaped fields, too many members, ...); the caller then falls back to
+ * cJSON, which also reports any error. kind is NULL when it must be read
+ * from the body. */
+#define FAST_PATH_MAX_FIELDS 8
 
-  ESP_LOGD(TAG, "led_hsv: h=%u s=%u v=%u", (unsigned)hue,
-           (unsigned)sat, (unsigned)val);
+// Trace ids are whole numbers that fit a uint32_t; anything else is
+// treated as "no trace".
+static uint32_t trace_id_from(double value) {
+  if (!(value >= 0.0 && value <= (double)UINT32_MAX) ||
+      value != (double)(uint32_t)value) {
+    return 0u;
+  }
+  return (uint32_t)value;
+}
 
-  if (s_handlers.set_led_hsv != NULL) {
-    s_handlers.set_led_hsv(hue, sat, val);
+// Optional "trace" id carried by a message or its command object.
+static uint32_t trace_id_of(const cJSON *object) {
+  const cJSON *trace = cJSON_GetObjectItemCaseSensitive(object, "trace");
+  if (!cJSON_IsNumber(trace)) {
+    return 0u;
+  }
+  return trace_id_from(trace->valuedouble);
+}
+
+static bool try_fast_command(const char *data, size_t len,
+                             const char *kind_name, uint32_t trace_id) {
+  scan_field_t fields[FAST_PATH_MAX_FIELDS];
+  int count = scan_object(data, len, fields, FAST_PATH_MAX_FIELDS);
+  if (count < 0) {
+    return false;
   }
+
+  protocol_kind_t kind;
+  if (kind_name != NULL) {
+    if (!schema_find_kind(kind_name, strlen(kind_name), &kind)) {
+      return false;
+    }
+  } else {
+    const scan_field_t *field = scan_find(fields, count, "kind");
+    if (field == NULL || field->type != SCAN_VALUE_STRING ||
+        !schema_find_kind(field->value, field->value_len, &kind)) {
+      return false;
+    }
+  }
+
+  protocol_args_t args;
+  if (!schema_decode_scan(kind, fields, count, &args)) {
+    return false;
+  }
+
+  double value;
+  if (trace_id == 0u &&
+      scan_number(scan_find(fields, count, "trace"), &value)) {
+    trace_id = trace_id_from(value);
+  }
+
+  if (s_benchmarking) {
+    (void)dispatch_args(kind, &args);
+    return true;
+  }
+  trace_begin(trace_id);
+  (void)dispatch_args(kind, &args);
+  trace_end();
   return true;
 }
 
-static bool handle_immediate_command(const cJSON *command) {
-  const cJSON *left = cJSON_GetObjectItemCaseSensitive(command, "left");
-  const cJSON *right = cJSON_GetObjectItemCaseSensitive(command, "right");
-  const cJSON *timeout =
-      cJSON_GetObjectItemCaseSensitive(command, "timeout_ms");
-  const cJSON *buttons =
-      cJSON_GetObjectItemCaseSensitive(command, "buttons");
+// Envelope form: {"type":"command","command":{"kind":...}}
+static bool try_fast_command_message(const char *data, size_t len) {
+  scan_field_t fields[FAST_PATH_MAX_FIELDS];
+  int count = scan_object(data, len, fields, FAST_PATH_MAX_FIELDS);
+  if (count < 0 ||
+      !scan_string_equals(scan_find(fields, count, "type"), "command")) {
+    return false;
+  }
+  const scan_field_t *command = scan_find(fields, count, "command");
+  if (command == NULL || command->type != SCAN_VALUE_OBJECT) {
+    return false;
+  }
+  double trace;
+  uint32_t trace_id = 0u;
+  if (scan_number(scan_find(fields, count, "trace"), &trace)) {
+    trace_id = trace_id_from(trace);
+  }
+  return try_fast_command(command->value, command->value_len, NULL,
+                          trace_id);
+}
 
-  if (!cJSON_IsNumber(left) || !cJSON_IsNumber(right)) {
-    ESP_LOGW(TAG, "Invalid immediate command payload (left/right)");
+/* Conditions are objects with exactly one test, optionally negated:
+ *   {"elapsed_ms":1500} {"distance_mm":500} {"buttons":4}
+ *   {"queue_empty":true} {"distance_mm":500,"not":true} */
+static bool parse_condition(const cJSON *object,
+                            protocol_condition_t *condition) {
+  static const struct {
+    const char *key;
+    protocol_condition_kind_t kind;
+  } kTests[] = {
+      {"elapsed_ms", PROTOCOL_CONDITION_ELAPSED_MS},
+      {"distance_mm", PROTOCOL_CONDITION_DISTANCE_MM},
+      {"buttons", PROTOCOL_CONDITION_BUTTONS},
+  };
+
+  if (!cJSON_IsObject(object)) {
     return false;
   }
 
-  float left_frac = (float)left->valuedouble;
-  float right_frac = (float)right->valuedouble;
+  uint32_t tests = 0u;
+  for (size_t i = 0u; i < sizeof(kTests) / sizeof(kTests[0]); ++i) {
+    const cJSON *value = cJSON_GetObjectItemCaseSensitive(object,
+                                                          kTests[i].key);
+    if (value == NULL) {
+      continue;
+    }
+    if (!cJSON_IsNumber(value) || value->valuedouble < 0.0 ||
+        value->valuedouble > (double)UINT32_MAX) {
+      return false;
+    }
+    condition->kind = kTests[i].kind;
+    condition->value = (uint32_t)value->valuedouble;
+    tests++;
+  }
+  const cJSON *queue_empty =
+      cJSON_GetObjectItemCaseSensitive(object, "queue_empty");
+  if (queue_empty != NULL) {
+    if (!cJSON_IsBool(queue_empty)) {
+      return false;
+    }
+    condition->kind = PROTOCOL_CONDITION_QUEUE_EMPTY;
+    condition->value = 0u;
+    tests++;
+  }
+  if (tests != 1u) {
+    return false;
+  }
 
-  uint32_t timeout_ms =
-      (timeout != NULL && cJSON_IsNumber(timeout))
-          ? (uint32_t)timeout->valuedouble
-          : 200u;
+  // {"queue_empty":false} is the negation of {"queue_empty":true}.
+  const cJSON *negate = cJSON_GetObjectItemCaseSensitive(object, "not");
+  condition->negate = cJSON_IsTrue(negate);
+  if (queue_empty != NULL && cJSON_IsFalse(queue_empty)) {
+    condition->negate = !condition->negate;
+  }
+  return true;
+}
+
+static bool handle_wait_until_command(const cJSON *command) {
+  protocol_condition_t condition;
+  if (!parse_condition(cJSON_GetObjectItemCaseSensitive(command, "until"),
+                       &condition)) {
+    ESP_LOGW(TAG, "Invalid wait_until command payload (until)");
+    return false;
+  }
+  const cJSON *timeout =
+      cJSON_GetObjectItemCaseSensitive(command, "timeout_ms");
+  uint32_t timeout_ms = 0u;
+  if (cJSON_IsNumber(timeout) && timeout->valuedouble > 0.0) {
+    if (timeout->valuedouble > (double)UINT32_MAX) {
+      ESP_LOGW(TAG, "Invalid wait_until command payload (timeout_ms)");
+      return false;
+    }
+    timeout_ms = (uint32_t)timeout->valuedouble;
+  }
 
-  uint32_t buttons_mask =
-      (buttons != NULL && cJSON_IsNumber(buttons))
-          ? (uint32_t)buttons->valuedouble
-          : 0u;
+  ESP_LOGD(TAG, "wait_until: kind=%d, value=%u, negate=%d, timeout=%u",
+           (int)condition.kind, (unsigned)condition.value,
+           (int)condition.negate, (unsigned)timeout_ms);
 
-  uint32_t now_ms = (uint32_t)esp_log_timestamp();
+  if (s_active->wait_until != NULL) {
+    s_active->wait_until(&condition, timeout_ms);
+  }
+  return true;
+}
 
-  ESP_LOGD(TAG, "immediate: left=%f, right=%f, timeout=%u, now=%u, buttons=%u",
-           left_frac,
-           right_frac,
-           (unsigned)timeout_ms,
-           (unsigned)now_ms,
-           (unsigned)buttons_mask);
+static bool handle_branch_command(const cJSON *command);
 
-  if (s_handlers.immediate != NULL) {
-    s_handlers.immediate(left_frac,
-                         right_frac,
-                         timeout_ms,
-                         now_ms,
-                         buttons_mask);
+static bool dispatch_command_kind(const char *kind, const cJSON *command) {
+  protocol_kind_t schema_kind;
+  if (schema_find_kind(kind, strlen(kind), &schema_kind)) {
+    protocol_args_t args;
+    const char *bad_key = NULL;
+    if (!schema_decode_json(schema_kind, command, &args, &bad_key)) {
+      ESP_LOGW(TAG, "Invalid %s command payload (%s)", kind, bad_key);
+      return false;
+    }
+    return dispatch_args(schema_kind, &args);
+  }
+
+  message_dispatched();
+  if (strcmp(kind, "wait_until") == 0) {
+    return handle_wait_until_command(command);
+  }
+  if (strcmp(kind, "branch") == 0) {
+    return handle_branch_command(command);
+  }
+
+  ESP_LOGW(TAG, "Unknown command kind: %s", kind);
+  return false;
+}
+
+static bool within_key_limit(const cJSON *object) {
+  uint32_t keys = 0u;
+  const cJSON *item = NULL;
+  cJSON_ArrayForEach(item, object) {
+    if (++keys > CONFIG_ROBOT_PROTOCOL_MAX_KEYS) {
+      ESP_LOGW(TAG, "Command object has too many keys");
+      return false;
+    }
   }
   return true;
 }
 
 static bool handle_single_command_object(const cJSON *command) {
+  if (!within_key_limit(command)) {
+    return false;
+  }
+
   const cJSON *kind = cJSON_GetObjectItemCaseSensitive(command, "kind");
   if (!cJSON_IsString(kind) || kind->valuestring == NULL) {
     ESP_LOGW(TAG, "JSON command missing kind");
@@ -173,58 +550,79 @@ static bool handle_single_command_object(const cJSON *command) {
   }
 
   ESP_LOGD(TAG, "parsed command - kind=%s", kind->valuestring);
+  return dispatch_command_kind(kind->valuestring, command);
+}
 
-  if (strcmp(kind->valuestring, "drive") == 0) {
-    return handle_drive_command(command);
-  }
-  if (strcmp(kind->valuestring, "turn") == 0) {
-    return handle_turn_command(command);
-  }
-  if (strcmp(kind->valuestring, "led_hsv") == 0) {
-    return handle_led_hsv_command(command);
-  }
-  if (strcmp(kind->valuestring, "immediate") == 0) {
-    return handle_immediate_command(command);
-  }
-  if (strcmp(kind->valuestring, "stop") == 0) {
-    if (s_handlers.stop != NULL) {
-      s_handlers.stop();
+// Dispatch each step of a steps array. Returns false once the
+// per-message step budget is exhausted.
+static bool dispatch_steps(const cJSON *steps) {
+  const cJSON *step = NULL;
+  cJSON_ArrayForEach(step, steps) {
+    if (s_steps_left == 0u) {
+      ESP_LOGW(TAG, "Sequence exceeds step budget, truncating");
+      return false;
     }
-    return true;
-  }
-  if (strcmp(kind->valuestring, "wait") == 0) {
-    const cJSON *duration =
-        cJSON_GetObjectItemCaseSensitive(command, "duration");
-    uint32_t duration_ms = 0u;
-    if (cJSON_IsNumber(duration)) {
-      duration_ms = (uint32_t)duration->valuedouble;
+    s_steps_left--;
+
+    if (!cJSON_IsObject(step)) {
+      ESP_LOGW(TAG, "Sequence step is not an object");
+      continue;
     }
 
-    if (s_handlers.wait != NULL) {
-      s_handlers.wait(duration_ms);
+    /* A step may be either:
+     *  - a full message object with its own "type" (command/sequence/config),
+     *    or
+     *  - a bare command object with a "kind" field.
+     */
+    const cJSON *step_type = cJSON_GetObjectItemCaseSensitive(step, "type");
+    if (cJSON_IsString(step_type) && step_type->valuestring != NULL) {
+      ESP_LOGD(TAG, "Sequence step type: %s", step_type->valuestring);
+      handle_command(step, step_type);
+    } else {
+      (void)handle_single_command_object(step);
     }
-    return true;
   }
-  if (strcmp(kind->valuestring, "pause") == 0) {
-    // will stop the current command, stop moving, but keep the queue
-    // drive_command_pause();
-    return true;
+  return true;
+}
+
+/* Emits BEGIN(cond), the "then" steps, ELSE, the "else" steps and END.
+ * END is always emitted once BEGIN was, even if the step budget runs out
+ * inside the branch, so the executor's nesting stays balanced. */
+static bool handle_branch_command(const cJSON *command) {
+  protocol_condition_t condition;
+  if (!parse_condition(cJSON_GetObjectItemCaseSensitive(command, "if"),
+                       &condition)) {
+    ESP_LOGW(TAG, "Invalid branch command payload (if)");
+    return false;
   }
-  if (strcmp(kind->valuestring, "resume") == 0) {
-    // if paused, will resume the current command, and continue processing the
-    // queue drive_command_resume();
-    return true;
+  const cJSON *then_steps = cJSON_GetObjectItemCaseSensitive(command, "then");
+  const cJSON *else_steps = cJSON_GetObjectItemCaseSensitive(command, "else");
+  if ((then_steps != NULL && !cJSON_IsArray(then_steps)) ||
+      (else_steps != NULL && !cJSON_IsArray(else_steps))) {
+    ESP_LOGW(TAG, "Invalid branch command payload (then/else)");
+    return false;
   }
-  if (strcmp(kind->valuestring, "clear_queue") == 0) {
-    // clears the queue, and stops the current command (?)
-    if (s_handlers.clear_queue != NULL) {
-      s_handlers.clear_queue();
-    }
-    return true;
+  if (s_sequence_depth >= CONFIG_ROBOT_PROTOCOL_MAX_SEQUENCE_DEPTH) {
+    ESP_LOGW(TAG, "Branch nested too deeply");
+    return false;
+  }
+  if (s_active->branch == NULL) {
+    ESP_LOGW(TAG, "No branch handler, dropping branch");
+    return false;
   }
 
-  ESP_LOGW(TAG, "Unknown command kind: %s", kind->valuestring);
-  return false;
+  s_sequence_depth++;
+  s_branch_depth++;
+  s_active->branch(PROTOCOL_BRANCH_BEGIN, &condition);
+  bool within_budget = dispatch_steps(then_steps);
+  s_active->branch(PROTOCOL_BRANCH_ELSE, NULL);
+  if (within_budget) {
+    (void)dispatch_steps(else_steps);
+  }
+  s_active->branch(PROTOCOL_BRANCH_END, NULL);
+  s_branch_depth--;
+  s_sequence_depth--;
+  return true;
 }
 
 static void handle_sequence_type(const cJSON *root) {
@@ -234,42 +632,42 @@ static void handle_sequence_type(const cJSON *root) {
     return;
   }
 
+  if (s_sequence_depth >= CONFIG_ROBOT_PROTOCOL_MAX_SEQUENCE_DEPTH) {
+    ESP_LOGW(TAG, "Sequence nested too deeply");
+    return;
+  }
+
   /* Optional repeat count: how many times to run the sequence steps.
-   * Defaults to 1 if omitted or invalid. Values < 1 are treated as 1. */
+   * Defaults to 1 if omitted or invalid. Values < 1 are treated as 1.
+   * Large values are bounded by the per-message step budget. */
   uint32_t repeat_count = 1u;
   const cJSON *repeat = cJSON_GetObjectItemCaseSensitive(root, "repeat");
   if (cJSON_IsNumber(repeat)) {
     double repeat_val = repeat->valuedouble;
-    if (repeat_val > 1.0) {
+    if (repeat_val >= (double)CONFIG_ROBOT_PROTOCOL_MAX_STEPS) {
+      repeat_count = CONFIG_ROBOT_PROTOCOL_MAX_STEPS;
+    } else if (repeat_val > 1.0) {
       repeat_count = (uint32_t)repeat_val;
     }
   }
 
-  const cJSON *step = NULL;
+  if (!s_benchmarking) {
+    pm_activity();
+  }
+  s_sequence_depth++;
   for (uint32_t i = 0u; i < repeat_count; ++i) {
-    cJSON_ArrayForEach(step, steps) {
-      if (!cJSON_IsObject(step)) {
-        ESP_LOGW(TAG, "Sequence step is not an object");
-        continue;
-      }
-
-      /* A step may be either:
-       *  - a full message object with its own "type" (command/sequence/config),
-       *    or
-       *  - a bare command object with a "kind" field.
-       */
-      const cJSON *step_type = cJSON_GetObjectItemCaseSensitive(step, "type");
-      ESP_LOGD(TAG, "Sequence step type: %s", step_type->valuestring);
-      if (cJSON_IsString(step_type) && step_type->valuestring != NULL) {
-        handle_command(step, step_type);
-      } else {
-        (void)handle_single_command_object(step);
-      }
+    if (!dispatch_steps(steps)) {
+      break;
     }
   }
+  s_sequence_depth--;
 }
 
 static void handle_config_type(const cJSON *root) {
+  if (s_branch_depth > 0u) {
+    ESP_LOGW(TAG, "config is not allowed inside a branch");
+    return;
+  }
   const cJSON *drive = cJSON_GetObjectItemCaseSensitive(root, "drive");
   if (!cJSON_IsObject(drive)) {
     return;
@@ -339,8 +737,29 @@ static void handle_config_type(const cJSON *root) {
     cfg.motor_gain_right = (float)motor_gain_right->valuedouble;
   }
 
-  if (s_handlers.set_drive_config != NULL) {
-    s_handlers.set_drive_config(&cfg);
+  const cJSON *gain_curves =
+      cJSON_GetObjectItemCaseSensitive(drive, "gain_curves");
+  if (gain_curves != NULL) {
+    (void)gain_curves_parse(gain_curves, &cfg);
+  }
+
+  // With a "profile" id the config is stored for later selection instead
+  // of being applied.
+  const cJSON *profile = cJSON_GetObjectItemCaseSensitive(root, "profile");
+  if (cJSON_IsNumber(profile)) {
+    double id = profile->valuedouble;
+    if (id >= 0.0 && id < (double)CONFIG_ROBOT_PROTOCOL_DRIVE_PROFILES &&
+        id == (double)(uint32_t)id) {
+      (void)profiles_store((uint32_t)id, &cfg);
+    } else {
+      ESP_LOGW(TAG, "Invalid drive profile id");
+    }
+    return;
+  }
+
+  message_dispatched();
+  if (s_active->set_drive_config != NULL) {
+    s_active->set_drive_config(&cfg);
   }
 }
 
@@ -365,25 +784,131 @@ static void handle_command(const cJSON *root, const cJSON *type) {
   }
 }
 
-void protocol_handle_command_json(const char *data, size_t len) {
-  if (data == NULL || len == 0u) {
-    return;
+// Linear scan rejecting documents nested deeper than
+// CONFIG_ROBOT_PROTOCOL_MAX_JSON_DEPTH before cJSON recurses into them.
+static bool json_depth_ok(const char *data, size_t len) {
+  uint32_t depth = 0u;
+  bool in_string = false;
+  for (size_t i = 0u; i < len; ++i) {
+    char c = data[i];
+    if (in_string) {
+      if (c == '\\') {
+        ++i;
+      } else if (c == '"') {
+        in_string = false;
+      }
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == '{' || c == '[') {
+      if (++depth > CONFIG_ROBOT_PROTOCOL_MAX_JSON_DEPTH) {
+        return false;
+      }
+    } else if ((c == '}' || c == ']') && depth > 0u) {
+      --depth;
+    }
   }
+  return true;
+}
+
+static void begin_message(void) {
+  s_steps_left = CONFIG_ROBOT_PROTOCOL_MAX_STEPS;
+  s_sequence_depth = 0u;
+  s_branch_depth = 0u;
+}
 
-  char *buffer = malloc(len + 1u);
+static cJSON *parse_json(const char *data, size_t len) {
+  if (!json_depth_ok(data, len)) {
+    ESP_LOGW(TAG, "JSON command nested too deeply");
+    return NULL;
+  }
+
+  // Through cJSON's hooks, like the tree itself, so an allocation
+  // counter installed there sees every allocation of a message.
+  char *buffer = cJSON_malloc(len + 1u);
   if (buffer == NULL) {
     ESP_LOGE(TAG, "Failed to allocate buffer for JSON parse");
-    return;
+    return NULL;
   }
 
   memcpy(buffer, data, len);
   buffer[len] = '\0';
 
   cJSON *root = cJSON_Parse(buffer);
-  free(buffer);
+  cJSON_free(buffer);
 
   if (root == NULL) {
     ESP_LOGE(TAG, "Failed to parse JSON command");
+  }
+  return root;
+}
+
+// Decompress a PROTOCOL_COMPRESSED_MAGIC message into a new buffer that
+// the caller frees with cJSON_free(). Returns NULL on error.
+static char *decompress_message(const char *data, size_t len,
+                                size_t *out_len) {
+  uint8_t version = protocol_compressed_version(data, len);
+  if (version != PROTOCOL_COMPRESSED_VERSION) {
+    ESP_LOGW(TAG, "Unsupported compressed message version %u",
+             (unsigned)version);
+    return NULL;
+  }
+  size_t raw_len = protocol_decompressed_len(data, len);
+  if (raw_len == 0u || raw_len > CONFIG_ROBOT_PROTOCOL_MAX_DECOMPRESSED_LEN) {
+    ESP_LOGW(TAG, "Compressed message has invalid size (%u)",
+             (unsigned)raw_len);
+    return NULL;
+  }
+
+  char *buffer = cJSON_malloc(raw_len);
+  if (buffer == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate buffer for decompression");
+    return NULL;
+  }
+
+  *out_len = protocol_decompress(data, len, buffer, raw_len);
+  if (*out_len != raw_len || protocol_is_compressed(buffer, raw_len)) {
+    ESP_LOGW(TAG, "Failed to decompress message");
+    cJSON_free(buffer);
+    return NULL;
+  }
+  return buffer;
+}
+
+void protocol_handle_command_json(const char *data, size_t len) {
+  if (data == NULL || len == 0u) {
+    return;
+  }
+
+  if (protocol_is_compressed(data, len)) {
+    size_t raw_len = 0u;
+    char *raw = decompress_message(data, len, &raw_len);
+    if (raw != NULL) {
+      protocol_handle_command_json(raw, raw_len);
+      cJSON_free(raw);
+    }
+    return;
+  }
+
+  message_received();
+  if (protocol_is_binary(data, len)) {
+    protocol_kind_t kind;
+    protocol_args_t args;
+    if (!schema_decode_binary(data, len, &kind, &args)) {
+      ESP_LOGW(TAG, "Invalid binary command (len=%u)", (unsigned)len);
+      return;
+    }
+    trace_begin(0u);
+    (void)dispatch_args(kind, &args);
+    trace_end();
+    return;
+  }
+
+  if (try_fast_command_message(data, len)) {
+    return;
+  }
+
+  cJSON *root = parse_json(data, len);
+  if (root == NULL) {
     return;
   }
 
@@ -395,10 +920,96 @@ void protocol_handle_command_json(const char *data, size_t len) {
   }
 
   ESP_LOGD(TAG, "parsed json - type=%s", type->valuestring);
+  uint32_t trace_id = trace_id_of(root);
+  if (trace_id == 0u) {
+    trace_id = trace_id_of(cJSON_GetObjectItemCaseSensitive(root, "command"));
+  }
+  trace_begin(trace_id);
+  begin_message();
   handle_command(root, type);
+  trace_end();
   cJSON_Delete(root);
 }
 
+void protocol_bench_dispatch(const char *data, size_t len)
+{
+  uint32_t steps_left = s_steps_left;
+  uint32_t sequence_depth = s_sequence_depth;
+  uint32_t branch_depth = s_branch_depth;
+  s_active = &kBenchHandlers;
+  s_benchmarking = true;
+
+  if (!try_fast_command_message(data, len)) {
+    cJSON *root = parse_json(data, len);
+    const cJSON *type = cJSON_GetObjectItemCaseSensitive(root, "type");
+    if (cJSON_IsString(type) && type->valuestring != NULL) {
+      begin_message();
+      handle_command(root, type);
+    }
+    cJSON_Delete(root);
+  }
+
+  s_benchmarking = false;
+  s_active = &s_handlers;
+  s_steps_left = steps_left;
+  s_sequence_depth = sequence_depth;
+  s_branch_depth = branch_depth;
+}
+
+void protocol_handle_kind_json(const char *kind,
+                               const char *data,
+                               size_t len) {
+  if (kind == NULL || kind[0] == '\0') {
+    return;
+  }
+
+  // Commands without fields (stop, pause, ...) may be sent with an empty
+  // body.
+  if (data == NULL || len == 0u) {
+    data = "{}";
+    len = 2u;
+  }
+
+  if (protocol_is_compressed(data, len)) {
+    size_t raw_len = 0u;
+    char *raw = decompress_message(data, len, &raw_len);
+    if (raw != NULL) {
+      protocol_handle_kind_json(kind, raw, raw_len);
+      cJSON_free(raw);
+    }
+    return;
+  }
+
+  message_received();
+  if (try_fast_command(data, len, kind, 0u)) {
+    return;
+  }
+
+  cJSON *body = parse_json(data, len);
+  if (body == NULL) {
+    return;
+  }
+  if (!cJSON_IsObject(body)) {
+    ESP_LOGW(TAG, "Body for kind %s is not an object", kind);
+    cJSON_Delete(body);
+    return;
+  }
+
+  ESP_LOGD(TAG, "parsed body - kind=%s", kind);
+
+  trace_begin(trace_id_of(body));
+  begin_message();
+  if (strcmp(kind, "sequence") == 0) {
+    handle_sequence_type(body);
+  } else if (strcmp(kind, "config") == 0) {
+    handle_config_type(body);
+  } else if (within_key_limit(body)) {
+    (void)dispatch_command_kind(kind, body);
+  }
+  trace_end();
+  cJSON_Delete(body);
+}
+
 void protocol_generate_immediate_command(char *buffer,
                                 size_t buffer_size,
                                 float left_frac,
@@ -407,26 +1018,13 @@ void protocol_generate_immediate_command(char *buffer,
                                 uint32_t now_ms,
                                 uint32_t buttons_mask)
 {
-  if (buffer == NULL || buffer_size == 0u) {
-    return;
-  }
-
-  // Format JSON matching the "immediate" command format consumed by
-  // handle_immediate_command(). Example:
-  // {"type":"command","command":{...}}
-  int written = snprintf(buffer,
-                         buffer_size,
-                         "{\"type\":\"command\"," \
-                         "\"command\":{\"kind\":\"immediate\"," \
-                         "\"left\":%.3f,\"right\":%.3f,\"timeout_ms\":%u,\"now_ms\":%u,\"buttons\":%u}}",
-                         (double)left_frac,
-                         (double)right_frac,
-                         (unsigned)timeout_ms,
-                         (unsigned)now_ms,
-                         (unsigned)buttons_mask);
-
-  if (written < 0) {
-    // snprintf error, ensure buffer is at least terminated
-    buffer[0] = '\0';
-  }
+  const protocol_immediate_args_t args = {
+      .left_frac = left_frac,
+      .right_frac = right_frac,
+      .timeout_ms = timeout_ms,
+      .now_ms = now_ms,
+      .buttons_mask = buttons_mask,
+  };
+  (void)protocol_encode_command_json(PROTOCOL_KIND_IMMEDIATE, &args, buffer,
+                                     buffer_size);
 }
\ No newline at end of file
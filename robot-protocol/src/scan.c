@@ -0,0 +1,264 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+
+static size_t skip_ws(const char *text, size_t pos, size_t len)
+{
+  while (pos < len && (text[pos] == ' ' || text[pos] == '\t' ||
+                       text[pos] == '\n' || text[pos] == '\r')) {
+    ++pos;
+  }
+  return pos;
+}
+
+// pos is just past the opening quote. Returns the index of the closing
+// quote, or len if unterminated. Sets *escaped if a backslash was seen.
+static size_t scan_string(const char *text,
+                          size_t pos,
+                          size_t len,
+                          bool *escaped)
+{
+  while (pos < len) {
+    char c = text[pos];
+    if (c == '"') {
+      return pos;
+    }
+    if (c == '\\') {
+      *escaped = true;
+      ++pos;
+    }
+    ++pos;
+  }
+  return len;
+}
+
+// Deepest nesting skip_container() tracks; deeper values fall back to cJSON.
+#define SCAN_MAX_DEPTH 64u
+
+// pos is at an opening brace/bracket. Returns the index just past the
+// matching close, or 0 on error, including a close of the wrong kind such
+// as "[}". One bit per level records whether it opened with '['.
+static size_t skip_container(const char *text, size_t pos, size_t len)
+{
+  uint64_t arrays = 0u;
+  size_t depth = 0u;
+  while (pos < len) {
+    char c = text[pos];
+    if (c == '"') {
+      bool escaped = false;
+      pos = scan_string(text, pos + 1u, len, &escaped);
+      if (pos >= len) {
+        return 0u;
+      }
+    } else if (c == '{' || c == '[') {
+      if (depth >= SCAN_MAX_DEPTH) {
+        return 0u;
+      }
+      arrays = (arrays << 1) | (c == '[' ? 1u : 0u);
+      ++depth;
+    } else if (c == '}' || c == ']') {
+      if ((arrays & 1u) != (c == ']' ? 1u : 0u)) {
+        return 0u;
+      }
+      arrays >>= 1;
+      if (--depth == 0u) {
+        return pos + 1u;
+      }
+    }
+    ++pos;
+  }
+  return 0u;
+}
+
+static size_t skip_digits(const char *text, size_t pos, size_t len)
+{
+  while (pos < len && text[pos] >= '0' && text[pos] <= '9') {
+    ++pos;
+  }
+  return pos;
+}
+
+// Length of the number at pos under the strict JSON grammar
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?, or 0 if there is none.
+// cJSON is more lenient ("01", "1."), so anything outside the grammar goes
+// to the cJSON path, which makes the call.
+static size_t number_len(const char *text, size_t pos, size_t len)
+{
+  size_t end = pos;
+  if (end < len && text[end] == '-') {
+    ++end;
+  }
+  if (end >= len || text[end] < '0' || text[end] > '9') {
+    return 0u;
+  }
+  end = (text[end] == '0') ? end + 1u : skip_digits(text, end, len);
+
+  if (end < len && text[end] == '.') {
+    size_t digits = skip_digits(text, end + 1u, len);
+    if (digits == end + 1u) {
+      return 0u;
+    }
+    end = digits;
+  }
+  if (end < len && (text[end] == 'e' || text[end] == 'E')) {
+    ++end;
+    if (end < len && (text[end] == '+' || text[end] == '-')) {
+      ++end;
+    }
+    size_t digits = skip_digits(text, end, len);
+    if (digits == end) {
+      return 0u;
+    }
+    end = digits;
+  }
+  return end - pos;
+}
+
+static bool match_literal(const char *text,
+                          size_t pos,
+                          size_t len,
+                          const char *literal,
+                          size_t literal_len)
+{
+  return pos + literal_len <= len &&
+         memcmp(text + pos, literal, literal_len) == 0;
+}
+
+int scan_object(const char *text,
+                size_t len,
+                scan_field_t *fields,
+                int max_fields)
+{
+  size_t pos = skip_ws(text, 0u, len);
+  if (pos >= len || text[pos] != '{') {
+    return -1;
+  }
+  pos = skip_ws(text, pos + 1u, len);
+  if (pos < len && text[pos] == '}') {
+    return 0;
+  }
+
+  int count = 0;
+  while (pos < len) {
+    if (text[pos] != '"' || count >= max_fields) {
+      return -1;
+    }
+
+    scan_field_t *field = &fields[count];
+    bool escaped = false;
+    size_t key_end = scan_string(text, pos + 1u, len, &escaped);
+    if (key_end >= len || escaped) {
+      return -1;
+    }
+    field->key = text + pos + 1u;
+    field->key_len = key_end - pos - 1u;
+
+    pos = skip_ws(text, key_end + 1u, len);
+    if (pos >= len || text[pos] != ':') {
+      return -1;
+    }
+    pos = skip_ws(text, pos + 1u, len);
+    if (pos >= len) {
+      return -1;
+    }
+
+    char c = text[pos];
+    size_t end;
+    if (c == '"') {
+      end = scan_string(text, pos + 1u, len, &escaped);
+      if (end >= len) {
+        return -1;
+      }
+      field->type = SCAN_VALUE_STRING;
+      field->value = text + pos + 1u;
+      field->value_len = end - pos - 1u;
+      end += 1u;
+    } else if (c == '{' || c == '[') {
+      end = skip_container(text, pos, len);
+      if (end == 0u) {
+        return -1;
+      }
+      field->type = (c == '{') ? SCAN_VALUE_OBJECT : SCAN_VALUE_ARRAY;
+      field->value = text + pos;
+      field->value_len = end - pos;
+    } else if (match_literal(text, pos, len, "true", 4u)) {
+      field->type = SCAN_VALUE_TRUE;
+      field->value = text + pos;
+      field->value_len = 4u;
+      end = pos + 4u;
+    } else if (match_literal(text, pos, len, "false", 5u)) {
+      field->type = SCAN_VALUE_FALSE;
+      field->value = text + pos;
+      field->value_len = 5u;
+      end = pos + 5u;
+    } else if (match_literal(text, pos, len, "null", 4u)) {
+      field->type = SCAN_VALUE_NULL;
+      field->value = text + pos;
+      field->value_len = 4u;
+      end = pos + 4u;
+    } else {
+      size_t number = number_len(text, pos, len);
+      if (number == 0u) {
+        return -1;
+      }
+      end = pos + number;
+      field->type = SCAN_VALUE_NUMBER;
+      field->value = text + pos;
+      field->value_len = end - pos;
+    }
+    ++count;
+
+    pos = skip_ws(text, end, len);
+    if (pos >= len) {
+      return -1;
+    }
+    if (text[pos] == '}') {
+      return count;
+    }
+    if (text[pos] != ',') {
+      return -1;
+    }
+    pos = skip_ws(text, pos + 1u, len);
+  }
+  return -1;
+}
+
+const scan_field_t *scan_find(const scan_field_t *fields,
+                              int count,
+                              const char *key)
+{
+  size_t key_len = strlen(key);
+  for (int i = 0; i < count; ++i) {
+    if (fields[i].key_len == key_len &&
+        memcmp(fields[i].key, key, key_len) == 0) {
+      return &fields[i];
+    }
+  }
+  return NULL;
+}
+
+bool scan_string_equals(const scan_field_t *field, const char *value)
+{
+  return field != NULL && field->type == SCAN_VALUE_STRING &&
+         field->value_len == strlen(value) &&
+         memcmp(field->value, value, field->value_len) == 0;
+}
+
+bool scan_number(const scan_field_t *field, double *out)
+{
+  if (field == NULL || field->type != SCAN_VALUE_NUMBER ||
+      field->value_len >= 32u) {
+    return false;
+  }
+
+  // The span is not terminated; copy it so strtod cannot read past it.
+  char number[32];
+  memcpy(number, field->value, field->value_len);
+  number[field->value_len] = '\0';
+
+  char *end = NULL;
+  *out = strtod(number, &end);
+  return end == number + field->value_len;
+}
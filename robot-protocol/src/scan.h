@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Single-pass structural index of a flat JSON object. Used as a fast path
+// for high-rate messages; anything the scanner does not handle makes the
+// caller fall back to cJSON.
+
+typedef enum {
+  SCAN_VALUE_NUMBER,
+  SCAN_VALUE_STRING, // span excludes the quotes, escapes left as-is
+  SCAN_VALUE_TRUE,
+  SCAN_VALUE_FALSE,
+  SCAN_VALUE_NULL,
+  SCAN_VALUE_OBJECT, // span includes the braces
+  SCAN_VALUE_ARRAY,  // span includes the brackets
+} scan_value_type_t;
+
+typedef struct {
+  const char *key;
+  size_t key_len;
+  const char *value;
+  size_t value_len;
+  scan_value_type_t type;
+} scan_field_t;
+
+// Index the members of the object in text[0..len). Nested objects and
+// arrays are recorded as a single span and not descended into. Returns the
+// number of members, or -1 if the text is not a well-formed object, a key
+// contains an escape, or there are more than max_fields members.
+int scan_object(const char *text,
+                size_t len,
+                scan_field_t *fields,
+                int max_fields);
+
+// Find a member by key. Returns NULL if absent.
+const scan_field_t *scan_find(const scan_field_t *fields,
+                              int count,
+                              const char *key);
+
+// True if field is a string equal to value.
+bool scan_string_equals(const scan_field_t *field, const char *value);
+
+// Parse a number member. Returns false if field is NULL or not a number.
+bool scan_number(const scan_field_t *field, double *out);
@@ -0,0 +1,359 @@
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "schema.h"
+
+typedef enum {
+  SCHEMA_I32,
+  SCHEMA_U32,
+  SCHEMA_F32,
+  SCHEMA_STR,
+} schema_type_t;
+
+typedef struct {
+  const char *key;
+  uint16_t offset;
+  uint8_t type;
+  bool required;
+  double default_value;
+} schema_field_t;
+
+typedef struct {
+  const char *name;
+  const schema_field_t *fields;
+  size_t field_count;
+} schema_kind_t;
+
+#define SCHEMA_REQUIRED true
+#define SCHEMA_OPTIONAL false
+
+#define SCHEMA_FIELD(args_t, member, key, type, presence, def)          \
+  {key, (uint16_t)offsetof(args_t, member), SCHEMA_##type,               \
+   SCHEMA_##presence, def},
+#define SCHEMA_FIELD_TABLE(ID, name, FIELDS)                             \
+  static const schema_field_t s_##name##_fields[] = {                    \
+      FIELDS(SCHEMA_FIELD, protocol_##name##_args_t)};
+#define SCHEMA_NO_FIELD_TABLE(ID, name)
+
+PROTOCOL_SCHEMA_KINDS(SCHEMA_FIELD_TABLE, SCHEMA_NO_FIELD_TABLE)
+
+#define SCHEMA_KIND(ID, name, FIELDS)                                    \
+  [PROTOCOL_KIND_##ID] = {#name, s_##name##_fields,                      \
+                          sizeof(s_##name##_fields) /                    \
+                              sizeof(s_##name##_fields[0])},
+#define SCHEMA_BARE_KIND(ID, name) [PROTOCOL_KIND_##ID] = {#name, NULL, 0u},
+
+static const schema_kind_t s_kinds[PROTOCOL_KIND_COUNT] = {
+    PROTOCOL_SCHEMA_KINDS(SCHEMA_KIND, SCHEMA_BARE_KIND)};
+
+#define SCHEMA_BINARY_HEADER_LEN (sizeof(PROTOCOL_BINARY_MAGIC) - 1u + 1u)
+
+bool schema_find_kind(const char *name, size_t name_len,
+                      protocol_kind_t *kind)
+{
+  for (size_t i = 0u; i < PROTOCOL_KIND_COUNT; ++i) {
+    if (strncmp(s_kinds[i].name, name, name_len) == 0 &&
+        s_kinds[i].name[name_len] == '\0') {
+      *kind = (protocol_kind_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *protocol_kind_name(protocol_kind_t kind)
+{
+  return ((unsigned)kind < PROTOCOL_KIND_COUNT) ? s_kinds[kind].name : NULL;
+}
+
+// Range-checked conversion; out-of-range values are invalid rather than
+// undefined casts.
+static bool store_number(const schema_field_t *field, double value,
+                         void *args)
+{
+  uint8_t *slot = (uint8_t *)args + field->offset;
+  switch (field->type) {
+    case SCHEMA_I32: {
+      if (!(value >= (double)INT32_MIN && value <= (double)INT32_MAX)) {
+        return false;
+      }
+      int32_t v = (int32_t)value;
+      memcpy(slot, &v, sizeof(v));
+      return true;
+    }
+    case SCHEMA_U32: {
+      if (!(value >= 0.0 && value <= (double)UINT32_MAX)) {
+        return false;
+      }
+      uint32_t v = (uint32_t)value;
+      memcpy(slot, &v, sizeof(v));
+      return true;
+    }
+    case SCHEMA_F32: {
+      if (!(value >= -(double)FLT_MAX && value <= (double)FLT_MAX)) {
+        return false;
+      }
+      float v = (float)value;
+      memcpy(slot, &v, sizeof(v));
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+static bool store_string(const schema_field_t *field, const char *value,
+                         size_t len, void *args)
+{
+  if (len >= PROTOCOL_SCHEMA_STR_MAX) {
+    return false;
+  }
+  char *slot = (char *)args + field->offset;
+  memcpy(slot, value, len);
+  slot[len] = '\0';
+  return true;
+}
+
+static void store_default(const schema_field_t *field, void *args)
+{
+  if (field->type == SCHEMA_STR) {
+    (void)store_string(field, "", 0u, args);
+  } else {
+    (void)store_number(field, field->default_value, args);
+  }
+}
+
+bool schema_decode_json(protocol_kind_t kind,
+                        const cJSON *object,
+                        protocol_args_t *args,
+                        const char **bad_key)
+{
+  const schema_kind_t *desc = &s_kinds[kind];
+  for (size_t i = 0u; i < desc->field_count; ++i) {
+    const schema_field_t *field = &desc->fields[i];
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, field->key);
+
+    bool stored = false;
+    if (field->type == SCHEMA_STR) {
+      stored = cJSON_IsString(item) && item->valuestring != NULL &&
+               store_string(field, item->valuestring,
+                            strlen(item->valuestring), args);
+    } else {
+      stored = cJSON_IsNumber(item) &&
+               store_number(field, item->valuedouble, args);
+    }
+
+    if (!stored) {
+      if (field->required) {
+        *bad_key = field->key;
+        return false;
+      }
+      store_default(field, args);
+    }
+  }
+  return true;
+}
+
+bool schema_decode_scan(protocol_kind_t kind,
+                        const scan_field_t *fields,
+                        int count,
+                        protocol_args_t *args)
+{
+  const schema_kind_t *desc = &s_kinds[kind];
+  for (size_t i = 0u; i < desc->field_count; ++i) {
+    const schema_field_t *field = &desc->fields[i];
+    const scan_field_t *item = scan_find(fields, count, field->key);
+
+    if (item == NULL) {
+      if (field->required) {
+        return false;
+      }
+      store_default(field, args);
+      continue;
+    }
+
+    if (field->type == SCHEMA_STR) {
+      if (item->type != SCAN_VALUE_STRING ||
+          memchr(item->value, '\\', item->value_len) != NULL ||
+          !store_string(field, item->value, item->value_len, args)) {
+        return false;
+      }
+    } else {
+      double value;
+      if (!scan_number(item, &value) || !store_number(field, value, args)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool protocol_is_binary(const char *data, size_t len)
+{
+  return data != NULL && len >= SCHEMA_BINARY_HEADER_LEN &&
+         memcmp(data, PROTOCOL_BINARY_MAGIC,
+                sizeof(PROTOCOL_BINARY_MAGIC) - 1u) == 0;
+}
+
+bool schema_decode_binary(const char *data,
+                          size_t len,
+                          protocol_kind_t *kind,
+                          protocol_args_t *args)
+{
+  if (!protocol_is_binary(data, len)) {
+    return false;
+  }
+  const uint8_t *p = (const uint8_t *)data + SCHEMA_BINARY_HEADER_LEN - 1u;
+  const uint8_t *end = (const uint8_t *)data + len;
+  if (*p >= PROTOCOL_KIND_COUNT) {
+    return false;
+  }
+  *kind = (protocol_kind_t)*p++;
+
+  const schema_kind_t *desc = &s_kinds[*kind];
+  for (size_t i = 0u; i < desc->field_count; ++i) {
+    const schema_field_t *field = &desc->fields[i];
+    if (field->type == SCHEMA_STR) {
+      if (p >= end || (size_t)(end - p) < 1u + (size_t)p[0] ||
+          !store_string(field, (const char *)p + 1, p[0], args)) {
+        return false;
+      }
+      p += 1u + p[0];
+    } else {
+      if ((size_t)(end - p) < 4u) {
+        return false;
+      }
+      uint32_t raw = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                     ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+      if (field->type == SCHEMA_F32) {
+        float f;
+        memcpy(&f, &raw, sizeof(f));
+        if (!isfinite(f)) {
+          return false;
+        }
+      }
+      memcpy((uint8_t *)args + field->offset, &raw, sizeof(raw));
+      p += 4u;
+    }
+  }
+  return p == end;
+}
+
+size_t protocol_encode_command_binary(protocol_kind_t kind,
+                                      const void *args,
+                                      char *buffer,
+                                      size_t buffer_size)
+{
+  if ((unsigned)kind >= PROTOCOL_KIND_COUNT || buffer == NULL ||
+      buffer_size < SCHEMA_BINARY_HEADER_LEN) {
+    return 0u;
+  }
+  memcpy(buffer, PROTOCOL_BINARY_MAGIC, sizeof(PROTOCOL_BINARY_MAGIC) - 1u);
+  size_t used = SCHEMA_BINARY_HEADER_LEN;
+  buffer[used - 1u] = (char)kind;
+
+  const schema_kind_t *desc = &s_kinds[kind];
+  for (size_t i = 0u; i < desc->field_count; ++i) {
+    const schema_field_t *field = &desc->fields[i];
+    const uint8_t *slot = (const uint8_t *)args + field->offset;
+    if (field->type == SCHEMA_STR) {
+      size_t str_len = strnlen((const char *)slot, PROTOCOL_SCHEMA_STR_MAX - 1u);
+      if (buffer_size - used < 1u + str_len) {
+        return 0u;
+      }
+      buffer[used++] = (char)str_len;
+      memcpy(buffer + used, slot, str_len);
+      used += str_len;
+    } else {
+      if (buffer_size - used < 4u) {
+        return 0u;
+      }
+      uint32_t raw;
+      memcpy(&raw, slot, sizeof(raw));
+      for (size_t b = 0u; b < 4u; ++b) {
+        buffer[used++] = (char)(raw >> (8u * b));
+      }
+    }
+  }
+  return used;
+}
+
+void schema_append(char *buffer, size_t buffer_size, size_t *out,
+                   const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  size_t room = (*out < buffer_size) ? buffer_size - *out : 0u;
+  int written = vsnprintf(room > 0u ? buffer + *out : NULL, room, fmt, ap);
+  va_end(ap);
+  if (written > 0) {
+    *out += (size_t)written;
+  }
+}
+
+size_t protocol_encode_command_json(protocol_kind_t kind,
+                                    const void *args,
+                                    char *buffer,
+                                    size_t buffer_size)
+{
+  if ((unsigned)kind >= PROTOCOL_KIND_COUNT || buffer == NULL ||
+      buffer_size == 0u) {
+    return 0u;
+  }
+
+  size_t out = 0u;
+  const schema_kind_t *desc = &s_kinds[kind];
+  schema_append(buffer, buffer_size, &out,
+                "{\"type\":\"command\",\"command\":{\"kind\":\"%s\"",
+                desc->name);
+
+  for (size_t i = 0u; i < desc->field_count; ++i) {
+    const schema_field_t *field = &desc->fields[i];
+    const uint8_t *slot = (const uint8_t *)args + field->offset;
+    schema_append(buffer, buffer_size, &out, ",\"%s\":", field->key);
+
+    switch (field->type) {
+      case SCHEMA_I32: {
+        int32_t v;
+        memcpy(&v, slot, sizeof(v));
+        schema_append(buffer, buffer_size, &out, "%d", (int)v);
+        break;
+      }
+      case SCHEMA_U32: {
+        uint32_t v;
+        memcpy(&v, slot, sizeof(v));
+        schema_append(buffer, buffer_size, &out, "%u", (unsigned)v);
+        break;
+      }
+      case SCHEMA_F32: {
+        float v;
+        memcpy(&v, slot, sizeof(v));
+        schema_append(buffer, buffer_size, &out, "%.3f", (double)v);
+        break;
+      }
+      case SCHEMA_STR: {
+        const char *s = (const char *)slot;
+        schema_append(buffer, buffer_size, &out, "\"");
+        for (size_t c = 0u; c < PROTOCOL_SCHEMA_STR_MAX && s[c] != '\0'; ++c) {
+          unsigned char ch = (unsigned char)s[c];
+          if (ch == '"' || ch == '\\') {
+            schema_append(buffer, buffer_size, &out, "\\%c", ch);
+          } else if (ch < 0x20u) {
+            schema_append(buffer, buffer_size, &out, "\\u%04x", ch);
+          } else {
+            schema_append(buffer, buffer_size, &out, "%c", ch);
+          }
+        }
+        schema_append(buffer, buffer_size, &out, "\"");
+        break;
+      }
+    }
+  }
+  schema_append(buffer, buffer_size, &out, "}}");
+  return out;
+}
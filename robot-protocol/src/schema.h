@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <cJSON.h>
+
+#include "../include/protocol.h"
+#include "scan.h"
+
+// Table-driven decoders generated from PROTOCOL_SCHEMA_KINDS.
+
+bool schema_find_kind(const char *name, size_t name_len,
+                      protocol_kind_t *kind);
+
+// Fill args from a cJSON object. On failure *bad_key names the offending
+// required field.
+bool schema_decode_json(protocol_kind_t kind,
+                        const cJSON *object,
+                        protocol_args_t *args,
+                        const char **bad_key);
+
+// Fill args from a scan_object() index. Fails on anything the cJSON path
+// might judge differently (escaped strings, invalid members, missing
+// required fields) so the caller can fall back to it.
+bool schema_decode_scan(protocol_kind_t kind,
+                        const scan_field_t *fields,
+                        int count,
+                        protocol_args_t *args);
+
+// Decode a PROTOCOL_BINARY_MAGIC message.
+bool schema_decode_binary(const char *data,
+                          size_t len,
+                          protocol_kind_t *kind,
+                          protocol_args_t *args);
+
+// snprintf-style append: out grows by what would have been written, so
+// the caller can report the full length even when truncated.
+void schema_append(char *buffer, size_t buffer_size, size_t *out,
+                   const char *fmt, ...);
@@ -0,0 +1,192 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_timer.h"
+
+#include "trace.h"
+
+typedef struct {
+  uint32_t trace_id;
+  bool closed;
+  bool emitted;
+  uint32_t rx_us;                          // low 32 bits of esp_timer time
+  int32_t delta_us[PROTOCOL_TRACE_STAGE_COUNT]; // from rx_us, -1 if unset
+} trace_record_t;
+
+static trace_record_t s_records[CONFIG_ROBOT_PROTOCOL_TRACE_RECORDS];
+static uint32_t s_next_record = 0u;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t s_rx_override_us = 0;
+static int64_t s_rx_us = 0;
+static bool s_rx_external = false;
+static trace_record_t *s_current = NULL;
+
+// Must be called with s_lock held.
+static trace_record_t *find_record(uint32_t trace_id)
+{
+  for (size_t i = 0u; i < CONFIG_ROBOT_PROTOCOL_TRACE_RECORDS; ++i) {
+    if (s_records[i].trace_id == trace_id) {
+      return &s_records[i];
+    }
+  }
+  return NULL;
+}
+
+// Must be called with s_lock held.
+static void stamp(trace_record_t *record, protocol_trace_stage_t stage,
+                  int64_t now_us)
+{
+  if (record != NULL && stage < PROTOCOL_TRACE_STAGE_COUNT) {
+    record->delta_us[stage] = (int32_t)((uint32_t)now_us - record->rx_us);
+  }
+}
+
+void protocol_trace_set_rx_time(int64_t rx_us)
+{
+  s_rx_override_us = rx_us;
+}
+
+void trace_receive(void)
+{
+  s_rx_external = (s_rx_override_us != 0);
+  s_rx_us = s_rx_external ? s_rx_override_us : esp_timer_get_time();
+  s_rx_override_us = 0;
+}
+
+int64_t trace_rx_time_us(void)
+{
+  return s_rx_us;
+}
+
+bool trace_rx_time_external(void)
+{
+  return s_rx_external;
+}
+
+void trace_begin(uint32_t trace_id)
+{
+  s_current = NULL;
+  if (trace_id == 0u) {
+    return;
+  }
+
+  int64_t now_us = esp_timer_get_time();
+
+  portENTER_CRITICAL(&s_lock);
+  trace_record_t *record = &s_records[s_next_record];
+  s_next_record = (s_next_record + 1u) % CONFIG_ROBOT_PROTOCOL_TRACE_RECORDS;
+  record->trace_id = trace_id;
+  record->closed = false;
+  record->emitted = false;
+  record->rx_us = (uint32_t)s_rx_us;
+  for (size_t i = 0u; i < PROTOCOL_TRACE_STAGE_COUNT; ++i) {
+    record->delta_us[i] = -1;
+  }
+  stamp(record, PROTOCOL_TRACE_RX, s_rx_us);
+  stamp(record, PROTOCOL_TRACE_DECODED, now_us);
+  s_current = record;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void trace_dispatch(void)
+{
+  if (s_current == NULL) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  portENTER_CRITICAL(&s_lock);
+  if (s_current->delta_us[PROTOCOL_TRACE_DISPATCH] < 0) {
+    stamp(s_current, PROTOCOL_TRACE_DISPATCH, now_us);
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void trace_end(void)
+{
+  if (s_current == NULL) {
+    return;
+  }
+  portENTER_CRITICAL(&s_lock);
+  if (s_current->delta_us[PROTOCOL_TRACE_QUEUED] < 0) {
+    s_current->closed = true;
+  }
+  s_current = NULL;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+uint32_t protocol_trace_current(void)
+{
+  trace_record_t *current = s_current;
+  return (current != NULL) ? current->trace_id : 0u;
+}
+
+void protocol_trace_mark(uint32_t trace_id, protocol_trace_stage_t stage)
+{
+  if (trace_id == 0u) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  portENTER_CRITICAL(&s_lock);
+  trace_record_t *record = find_record(trace_id);
+  stamp(record, stage, now_us);
+  if (record != NULL && stage == PROTOCOL_TRACE_EXEC_END) {
+    record->closed = true;
+  }
+  portEXIT_CRITICAL(&s_lock);
+}
+
+size_t protocol_trace_format_batch(char *buffer, size_t buffer_size)
+{
+  if (buffer == NULL || buffer_size == 0u) {
+    return 0u;
+  }
+
+  size_t used = (size_t)snprintf(buffer, buffer_size, "{\"traces\":[");
+  size_t count = 0u;
+
+  for (size_t i = 0u; i < CONFIG_ROBOT_PROTOCOL_TRACE_RECORDS; ++i) {
+    portENTER_CRITICAL(&s_lock);
+    trace_record_t record = s_records[i];
+    portEXIT_CRITICAL(&s_lock);
+
+    if (record.trace_id == 0u || !record.closed || record.emitted) {
+      continue;
+    }
+
+    char entry[128];
+    int len = snprintf(entry, sizeof(entry),
+                       "%s[%u,%u,%d,%d,%d,%d,%d]",
+                       count > 0u ? "," : "",
+                       (unsigned)record.trace_id,
+                       (unsigned)record.rx_us,
+                       (int)record.delta_us[PROTOCOL_TRACE_DECODED],
+                       (int)record.delta_us[PROTOCOL_TRACE_DISPATCH],
+                       (int)record.delta_us[PROTOCOL_TRACE_QUEUED],
+                       (int)record.delta_us[PROTOCOL_TRACE_EXEC_START],
+                       (int)record.delta_us[PROTOCOL_TRACE_EXEC_END]);
+    // Keep room for the closing "]}".
+    if (len < 0 || used + (size_t)len + 3u > buffer_size) {
+      break;
+    }
+    memcpy(buffer + used, entry, (size_t)len);
+    used += (size_t)len;
+    count++;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_records[i].trace_id == record.trace_id) {
+      s_records[i].emitted = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+  }
+
+  if (count == 0u) {
+    buffer[0] = '\0';
+    return 0u;
+  }
+  memcpy(buffer + used, "]}", 3u);
+  return used + 2u;
+}
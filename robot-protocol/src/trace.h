@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../include/protocol.h"
+
+// Internal hooks used by the decoder to record trace stages for the
+// message currently being handled.
+
+// Record the receive time of the message about to be decoded: the time
+// given to protocol_trace_set_rx_time(), or now.
+void trace_receive(void);
+
+// Receive time recorded by the last trace_receive().
+int64_t trace_rx_time_us(void);
+
+// True if that time came from protocol_trace_set_rx_time(), i.e. from the
+// transport, rather than from entry into protocol_handle_*.
+bool trace_rx_time_external(void);
+
+// Open a record for trace_id (0 = untraced) and stamp RX and DECODED.
+void trace_begin(uint32_t trace_id);
+
+// Stamp DISPATCH for the current trace.
+void trace_dispatch(void);
+
+// Finish handling of the current message. The record is closed unless a
+// handler marked it QUEUED, in which case it stays open until EXEC_END.
+void trace_end(void);
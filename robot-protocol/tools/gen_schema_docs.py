@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Regenerate the field reference in README.md from protocol_schema.h.
+
+Usage: tools/gen_schema_docs.py [--check]
+
+The table between the <!-- schema:begin --> and <!-- schema:end --> markers
+is replaced. With --check, exit with status 1 if README.md is out of date
+instead of writing it.
+"""
+
+import pathlib
+import re
+import sys
+
+ROOT = pathlib.Path(__file__).resolve().parent.parent
+SCHEMA = ROOT / "include" / "protocol_schema.h"
+README = ROOT / "README.md"
+
+BEGIN = "<!-- schema:begin -->"
+END = "<!-- schema:end -->"
+
+TYPES = {
+    "I32": "int32",
+    "U32": "uint32",
+    "F32": "float",
+    "STR": "string",
+}
+
+
+def parse(text):
+    text = text.replace("\\\n", " ")
+    fields = {}
+    for m in re.finditer(r"#define PROTOCOL_(\w+)_FIELDS\(F, X\)(.*)", text):
+        fields[m.group(1)] = re.findall(
+            r'F\(X, (\w+), "([^"]+)", (\w+), (\w+), ([^)]+)\)', m.group(2))
+
+    kinds_def = re.search(r"#define PROTOCOL_SCHEMA_KINDS\(K, B\)(.*)", text)
+    kinds = []
+    for m in re.finditer(r"([KB])\((\w+), (\w+)(?:, PROTOCOL_(\w+)_FIELDS)?\)",
+                         kinds_def.group(1)):
+        kinds.append((m.group(3), fields.get(m.group(4), [])))
+    return kinds
+
+
+def render(kinds):
+    lines = [
+        BEGIN,
+        "<!-- Generated by tools/gen_schema_docs.py from "
+        "include/protocol_schema.h; do not edit. -->",
+        "",
+        "| Id | Kind | Field | Type | Required | Default |",
+        "|----|------|-------|------|----------|---------|",
+    ]
+    for kind_id, (name, kind_fields) in enumerate(kinds):
+        if not kind_fields:
+            lines.append(f"| {kind_id} | `{name}` | – | – | – | – |")
+        for member, key, ftype, presence, default in kind_fields:
+            required = "yes" if presence == "REQUIRED" else "no"
+            shown = "–" if presence == "REQUIRED" else (
+                '`""`' if ftype == "STR" else f"`{default.strip()}`")
+            lines.append(f"| {kind_id} | `{name}` | `{key}` | "
+                         f"{TYPES[ftype]} | {required} | {shown} |")
+    lines.append(END)
+    return "\n".join(lines)
+
+
+def main():
+    readme = README.read_text(encoding="utf-8")
+    start = readme.index(BEGIN)
+    end = readme.index(END) + len(END)
+    updated = (readme[:start] + render(parse(SCHEMA.read_text())) +
+               readme[end:])
+
+    if "--check" in sys.argv[1:]:
+        if updated != readme:
+            print("README.md field reference is out of date", file=sys.stderr)
+            return 1
+        return 0
+
+    README.write_text(updated, encoding="utf-8")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
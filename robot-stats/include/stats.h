@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// Periodic runtime statistics published as compact binary telemetry.
+//
+// A low-priority sampler task snapshots the FreeRTOS run-time counters
+// once per CONFIG_ROBOT_STATS_PERIOD_MS, computes each task's share of the
+// CPU over that window and publishes one record with
+// mqtt_publish_binary_telemetry(). Watched queues are sampled every
+// CONFIG_ROBOT_STATS_QUEUE_SAMPLE_MS in between. All buffers are static, so
+// the steady-state cost is one uxTaskGetSystemState() per window plus a few
+// queue reads.
+//
+// Per-task CPU needs CONFIG_FREERTOS_USE_TRACE_FACILITY and
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS; without them records carry only
+// the heap and queue fields and STATS_FLAG_NO_RUNTIME is set.
+//
+// Record layout, little endian:
+//   header (20 bytes)
+//     char     magic[2]        "RS"
+//     uint8_t  version         STATS_RECORD_VERSION
+//     uint8_t  flags           STATS_FLAG_*
+//     uint16_t window_ms       actual length of the window
+//     uint8_t  task_count
+//     uint8_t  queue_count
+//     uint32_t uptime_ms
+//     uint32_t free_heap       bytes
+//     uint32_t min_free_heap   bytes, low-water mark since boot
+//   task_count entries (14 bytes)
+//     char     name[8]         zero padded, truncated
+//     uint16_t cpu_permille    share of all cores over the window
+//     uint16_t stack_free      stack high-water mark, bytes
+//     uint8_t  priority        current priority
+//     uint8_t  core            pinned core, or 0xFF if not pinned/unknown
+//   queue_count entries (14 bytes)
+//     char     name[8]
+//     uint16_t waiting         items queued at the end of the window
+//     uint16_t peak            most items queued during the window
+//     uint16_t capacity
+
+#define STATS_RECORD_VERSION      1
+#define STATS_RECORD_HEADER_SIZE  20
+#define STATS_RECORD_ENTRY_SIZE   14
+#define STATS_NAME_LEN            8
+
+#define STATS_FLAG_NO_RUNTIME     0x01 // run-time stats not enabled
+#define STATS_FLAG_TASKS_OMITTED  0x02 // more tasks than CONFIG_ROBOT_STATS_MAX_TASKS; no task entries
+#define STATS_FLAG_FIRST_WINDOW   0x04 // no previous snapshot; CPU fields are 0
+
+// Start the sampler task.
+esp_err_t stats_init(void);
+
+// Report the fill level of queue under name (truncated to 8 characters).
+// Returns ESP_ERR_NO_MEM once CONFIG_ROBOT_STATS_MAX_QUEUES are watched.
+esp_err_t stats_watch_queue(QueueHandle_t queue, const char *name);
+
+// Sampling profiler (CONFIG_ROBOT_STATS_PROFILER).
+//
+// Records the program counter interrupted by a periodic timer into a
+// fixed hash histogram for duration_ms, then publishes it from the sampler
+// task with mqtt_publish_binary_telemetry(). On the device, samples come
+// from an esp_timer ISR callback, which runs on one core only. The PC is
+// read from the exception frame the FreeRTOS port saves for the
+// interrupted task. Code that runs with interrupts masked is not sampled.
+// On the Linux target, ITIMER_PROF/SIGPROF samples the whole process.
+// tools/symbolize_profile.py turns the dump into folded stacks for
+// flamegraph.pl.
+//
+// The dump is split into chunks of at most
+// CONFIG_ROBOT_STATS_PROFILER_CHUNK_SIZE bytes, little endian:
+//   header (32 bytes)
+//     char     magic[2]       "RP"
+//     uint8_t  version        STATS_PROFILE_VERSION
+//     uint8_t  pc_size        4, or 8 on 64-bit hosts
+//     uint16_t session        increments with each profile
+//     uint16_t chunk          0 .. chunk_count - 1
+//     uint16_t chunk_count
+//     uint16_t hz             sample rate
+//     uint16_t entry_count    entries in this chunk
+//     uint16_t flags          STATS_PROFILE_FLAG_*
+//     uint32_t samples        samples taken in the whole profile
+//     uint32_t dropped        samples lost to a full histogram
+//     uint64_t anchor         runtime address of stats_profile_start()
+//   entry_count entries
+//     pc_size  pc             0 if the PC could not be determined
+//     uint32_t count
+// The anchor lets the host tool relocate PCs of position-independent
+// Linux builds; on the device it equals the ELF address.
+
+#define STATS_PROFILE_VERSION        1
+#define STATS_PROFILE_HEADER_SIZE    32
+
+#define STATS_PROFILE_FLAG_LINUX     0x0001 // PCs from a Linux host build
+
+// Start profiling for duration_ms. Any profile still running is discarded.
+// Returns ESP_ERR_NOT_SUPPORTED when the profiler is not built or ISR
+// dispatch is unavailable, and ESP_ERR_INVALID_STATE before stats_init().
+esp_err_t stats_profile_start(uint32_t duration_ms);
+
+// End the running profile early; it is published as if it had completed.
+void stats_profile_stop(void);
+
+// Scheduling latency benchmark.
+//
+// A periodic esp_timer (ISR dispatch when available) wakes a probe task
+// every CONFIG_ROBOT_STATS_LATENCY_PERIOD_US for duration_ms. The probe
+// runs at CONFIG_ROBOT_STATS_LATENCY_PRIORITY on
+// CONFIG_ROBOT_STATS_LATENCY_CORE and records how late each wake-up is
+// against the timer schedule. At the end the sampler task publishes a
+// JSON report with mqtt_publish_telemetry():
+//   {"sched_latency":{"dispatch":"isr","period_us":1000,"samples":5000,
+//     "overruns":0,"min_us":9,"p50_us":16,"p99_us":48,"max_us":131,
+//     "tasks":[{"name":"mqtt_task","prio":5,"core":-1},...]}}
+// Percentiles are the upper edge of an 8 us histogram bucket. Overruns
+// count periods the probe missed entirely. "tasks" lists the priority and
+// core (-1 = not pinned) of the network, worker, LED and system tasks
+// found at that moment, so reports from different task layouts can be
+// compared side by side.
+
+// Start a run of duration_ms. Returns ESP_ERR_INVALID_STATE before
+// stats_init() or while a run is in progress.
+esp_err_t stats_latency_start(uint32_t duration_ms);
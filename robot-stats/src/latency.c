@@ -0,0 +1,257 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_attr.h"
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "mqtt.h"
+
+#include "latency.h"
+
+static const char *TAG = "stats_latency";
+
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#define LATENCY_DISPATCH ESP_TIMER_ISR
+#define LATENCY_DISPATCH_NAME "isr"
+#else
+#define LATENCY_DISPATCH ESP_TIMER_TASK
+#define LATENCY_DISPATCH_NAME "task"
+#endif
+
+#define LATENCY_PERIOD_US CONFIG_ROBOT_STATS_LATENCY_PERIOD_US
+#define LATENCY_BUCKET_US 8u
+#define LATENCY_BUCKETS 128u // the last bucket also holds everything above
+
+// Tasks whose priority and core are included in the report, when present.
+static const char *const LAYOUT_TASKS[] = {
+    "latency", "mqtt_task", "mqtt_worker", "led",
+    "wifi",    "sys_evt",   "tiT",         "esp_timer",
+};
+
+static TaskHandle_t s_probe;
+static esp_timer_handle_t s_timer;
+
+// Written by the probe task only while s_running; read by the sampler task
+// once s_done is set.
+static uint32_t s_hist[LATENCY_BUCKETS];
+static uint32_t s_samples;
+static uint32_t s_overruns;
+static uint32_t s_min_us;
+static uint32_t s_max_us;
+static uint32_t s_seen;
+static int64_t s_t0_us;
+static int64_t s_end_us;
+static volatile bool s_running;
+static int s_done;
+
+static char s_report[640];
+
+static IRAM_ATTR void latency_tick(void *arg)
+{
+  (void)arg;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(s_probe, &woken);
+  if (woken == pdTRUE) {
+    esp_timer_isr_dispatch_need_yield();
+  }
+#else
+  xTaskNotifyGive(s_probe);
+#endif
+}
+
+static void record(uint32_t latency_us, uint32_t missed)
+{
+  uint32_t bucket = latency_us / LATENCY_BUCKET_US;
+  if (bucket >= LATENCY_BUCKETS) {
+    bucket = LATENCY_BUCKETS - 1u;
+  }
+  s_hist[bucket]++;
+  s_samples++;
+  s_overruns += missed;
+  if (latency_us < s_min_us) {
+    s_min_us = latency_us;
+  }
+  if (latency_us > s_max_us) {
+    s_max_us = latency_us;
+  }
+}
+
+// Periodic esp_timer alarms stay on the start + k * period grid even when
+// a callback is late, so the wake-up latency is measured against that
+// grid. It includes the timer dispatch as well as the time the probe
+// waits for its core. s_t0_us is read just before the timer is armed,
+// which adds a microsecond or two.
+static void probe_task(void *arg)
+{
+  (void)arg;
+  for (;;) {
+    uint32_t n = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int64_t now_us = esp_timer_get_time();
+    if (!s_running || n == 0u) {
+      continue;
+    }
+
+    s_seen += n;
+    int64_t due_us = s_t0_us + (int64_t)s_seen * LATENCY_PERIOD_US;
+    int64_t latency_us = now_us - due_us;
+    if (latency_us < 0) {
+      latency_us = 0;
+    } else if (latency_us > UINT32_MAX) {
+      latency_us = UINT32_MAX;
+    }
+    // Several pending notifications mean whole periods were missed.
+    record((uint32_t)latency_us, n - 1u);
+
+    if (now_us >= s_end_us) {
+      (void)esp_timer_stop(s_timer);
+      s_running = false;
+      __atomic_store_n(&s_done, 1, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+// Upper edge of the bucket holding the q-th percentile, capped at the
+// largest sample.
+static uint32_t percentile_us(uint32_t q)
+{
+  uint64_t target = ((uint64_t)s_samples * q + 99u) / 100u;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += s_hist[i];
+    if (seen >= target && seen > 0u) {
+      uint32_t edge = (i + 1u) * LATENCY_BUCKET_US;
+      return edge < s_max_us ? edge : s_max_us;
+    }
+  }
+  return s_max_us;
+}
+
+static int task_core(TaskHandle_t task)
+{
+#if !CONFIG_FREERTOS_UNICORE && !CONFIG_IDF_TARGET_LINUX
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+  BaseType_t core = xTaskGetCoreID(task);
+#else
+  BaseType_t core = xTaskGetAffinity(task);
+#endif
+  if (core >= 0 && core < portNUM_PROCESSORS) {
+    return (int)core;
+  }
+#else
+  (void)task;
+#endif
+  return -1;
+}
+
+static void publish_report(void)
+{
+  size_t cap = sizeof(s_report);
+  int len = snprintf(
+      s_report, cap,
+      "{\"sched_latency\":{\"dispatch\":\"%s\",\"period_us\":%u,"
+      "\"samples\":%u,\"overruns\":%u,\"min_us\":%u,\"p50_us\":%u,"
+      "\"p99_us\":%u,\"max_us\":%u,\"tasks\":[",
+      LATENCY_DISPATCH_NAME, (unsigned)LATENCY_PERIOD_US,
+      (unsigned)s_samples, (unsigned)s_overruns,
+      (unsigned)(s_samples > 0u ? s_min_us : 0u),
+      (unsigned)percentile_us(50), (unsigned)percentile_us(99),
+      (unsigned)s_max_us);
+
+  bool first = true;
+  for (size_t i = 0; i < sizeof(LAYOUT_TASKS) / sizeof(LAYOUT_TASKS[0]); i++) {
+    TaskHandle_t task = xTaskGetHandle(LAYOUT_TASKS[i]);
+    if (task == NULL || len < 0 || (size_t)len >= cap) {
+      continue;
+    }
+    len += snprintf(s_report + len, cap - (size_t)len,
+                    "%s{\"name\":\"%s\",\"prio\":%u,\"core\":%d}",
+                    first ? "" : ",", LAYOUT_TASKS[i],
+                    (unsigned)uxTaskPriorityGet(task), task_core(task));
+    first = false;
+  }
+  if (len >= 0 && (size_t)len < cap) {
+    len += snprintf(s_report + len, cap - (size_t)len, "]}}");
+  }
+  if (len < 0 || (size_t)len >= cap) {
+    ESP_LOGW(TAG, "Latency report truncated");
+    return;
+  }
+
+  mqtt_publish_telemetry(s_report);
+  ESP_LOGI(TAG, "%u samples: p50 %u us, p99 %u us, max %u us, %u overruns",
+           (unsigned)s_samples, (unsigned)percentile_us(50),
+           (unsigned)percentile_us(99), (unsigned)s_max_us,
+           (unsigned)s_overruns);
+}
+
+esp_err_t latency_start(uint32_t duration_ms)
+{
+  if (s_running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (s_probe == NULL) {
+    const BaseType_t core =
+        (CONFIG_ROBOT_STATS_LATENCY_CORE < 0 ||
+         CONFIG_ROBOT_STATS_LATENCY_CORE >= portNUM_PROCESSORS)
+            ? tskNO_AFFINITY
+            : CONFIG_ROBOT_STATS_LATENCY_CORE;
+    if (xTaskCreatePinnedToCore(probe_task, "latency", 2048, NULL,
+                                CONFIG_ROBOT_STATS_LATENCY_PRIORITY, &s_probe,
+                                core) != pdPASS) {
+      ESP_LOGE(TAG, "Failed to create probe task");
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  if (s_timer == NULL) {
+    const esp_timer_create_args_t args = {
+        .callback = latency_tick,
+        .arg = NULL,
+        .dispatch_method = LATENCY_DISPATCH,
+        .name = "latency",
+        .skip_unhandled_events = false,
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  memset(s_hist, 0, sizeof(s_hist));
+  s_samples = 0;
+  s_overruns = 0;
+  s_min_us = UINT32_MAX;
+  s_max_us = 0;
+  s_seen = 0;
+  __atomic_store_n(&s_done, 0, __ATOMIC_RELAXED);
+  s_t0_us = esp_timer_get_time();
+  s_end_us = s_t0_us + (int64_t)duration_ms * 1000;
+  s_running = true;
+
+  esp_err_t err = esp_timer_start_periodic(s_timer, LATENCY_PERIOD_US);
+  if (err != ESP_OK) {
+    s_running = false;
+    ESP_LOGE(TAG, "Failed to start timer: %s", esp_err_to_name(err));
+    return err;
+  }
+  ESP_LOGI(TAG, "Measuring for %u ms every %d us at priority %d",
+           (unsigned)duration_ms, LATENCY_PERIOD_US,
+           CONFIG_ROBOT_STATS_LATENCY_PRIORITY);
+  return ESP_OK;
+}
+
+void latency_service(void)
+{
+  if (__atomic_load_n(&s_done, __ATOMIC_ACQUIRE) == 0) {
+    return;
+  }
+  __atomic_store_n(&s_done, 0, __ATOMIC_RELAXED);
+  publish_report();
+}
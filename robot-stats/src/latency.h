@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "../include/stats.h"
+
+// Scheduling latency probe behind stats_latency_start(). The report is
+// published from latency_service(), called from the sampler task.
+
+esp_err_t latency_start(uint32_t duration_ms);
+
+// Publish the report of a finished run. Cheap when idle.
+void latency_service(void);
@@ -0,0 +1,355 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // REG_RIP/REG_EIP in <ucontext.h>
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#elif CONFIG_IDF_TARGET_ARCH_XTENSA
+#include "xtensa_context.h"
+#elif CONFIG_IDF_TARGET_ARCH_RISCV
+#include "riscv/rvruntime-frames.h"
+#endif
+
+#include "mqtt.h"
+
+#include "profiler.h"
+
+static const char *TAG = "stats_profiler";
+
+#if CONFIG_ROBOT_STATS_PROFILER &&                                   \
+    (CONFIG_IDF_TARGET_LINUX ||                                      \
+     (CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD &&               \
+      (CONFIG_IDF_TARGET_ARCH_XTENSA || CONFIG_IDF_TARGET_ARCH_RISCV)))
+#define PROFILER_ENABLED 1
+#else
+#define PROFILER_ENABLED 0
+#endif
+
+#if PROFILER_ENABLED
+
+#define PROFILER_BUCKETS CONFIG_ROBOT_STATS_PROFILER_BUCKETS
+#define PROFILER_MASK ((uint32_t)PROFILER_BUCKETS - 1u)
+#define PROFILER_MAX_PROBES 16u
+
+_Static_assert((PROFILER_BUCKETS & (PROFILER_BUCKETS - 1)) == 0,
+               "CONFIG_ROBOT_STATS_PROFILER_BUCKETS must be a power of two");
+_Static_assert(CONFIG_ROBOT_STATS_PROFILER_CHUNK_SIZE >=
+                   STATS_PROFILE_HEADER_SIZE + sizeof(uintptr_t) + 4,
+               "CONFIG_ROBOT_STATS_PROFILER_CHUNK_SIZE too small");
+
+typedef struct {
+  uintptr_t pc;
+  uint32_t count; // 0 = free
+} profile_bucket_t;
+
+static profile_bucket_t s_hist[PROFILER_BUCKETS];
+static volatile uint32_t s_samples;
+static volatile uint32_t s_dropped;
+static volatile bool s_running;
+static int s_busy; // sample in progress; guards against a nested signal
+static volatile bool s_stop_requested;
+static int64_t s_end_us;
+static uint16_t s_session;
+static uint8_t s_chunk[CONFIG_ROBOT_STATS_PROFILER_CHUNK_SIZE];
+
+#if !CONFIG_IDF_TARGET_LINUX
+static esp_timer_handle_t s_timer;
+#endif
+
+// Single writer (the timer ISR or the signal handler); lock-free, bounded
+// probing so a sample never takes more than a handful of loads.
+static IRAM_ATTR void record_sample(uintptr_t pc)
+{
+  if (__atomic_exchange_n(&s_busy, 1, __ATOMIC_ACQUIRE) != 0) {
+    s_dropped++;
+    return;
+  }
+
+  s_samples++;
+  uint32_t h = (uint32_t)(pc >> 1) * 2654435761u;
+  uint32_t i = (h ^ (h >> 16)) & PROFILER_MASK;
+  bool stored = false;
+  for (uint32_t n = 0; n < PROFILER_MAX_PROBES; n++) {
+    profile_bucket_t *b = &s_hist[(i + n) & PROFILER_MASK];
+    if (b->count == 0u) {
+      b->pc = pc;
+      b->count = 1u;
+      stored = true;
+      break;
+    }
+    if (b->pc == pc) {
+      b->count++;
+      stored = true;
+      break;
+    }
+  }
+  if (!stored) {
+    s_dropped++;
+  }
+
+  __atomic_store_n(&s_busy, 0, __ATOMIC_RELEASE);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+
+static void profiler_signal(int sig, siginfo_t *info, void *context)
+{
+  (void)sig;
+  (void)info;
+  if (!s_running) {
+    return;
+  }
+
+  const ucontext_t *uc = (const ucontext_t *)context;
+  uintptr_t pc = 0;
+#if defined(__x86_64__)
+  pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+  pc = (uintptr_t)uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+  pc = (uintptr_t)uc->uc_mcontext.pc;
+#else
+  (void)uc;
+#endif
+  record_sample(pc);
+}
+
+static esp_err_t sampler_start(void)
+{
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = profiler_signal;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, NULL) != 0) {
+    return ESP_FAIL;
+  }
+
+  struct itimerval tv;
+  memset(&tv, 0, sizeof(tv));
+  tv.it_interval.tv_usec = 1000000 / CONFIG_ROBOT_STATS_PROFILER_HZ;
+  tv.it_value = tv.it_interval;
+  return setitimer(ITIMER_PROF, &tv, NULL) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static void sampler_stop(void)
+{
+  struct itimerval tv;
+  memset(&tv, 0, sizeof(tv));
+  (void)setitimer(ITIMER_PROF, &tv, NULL);
+}
+
+#else
+
+// The port's interrupt entry saves the interrupted task's stack pointer,
+// which points at its exception frame, in the first word of the TCB. That
+// is only true for the outermost interrupt. The timer ISR itself is level
+// 1 of the port's nesting counter, so a deeper level means the sample
+// landed on top of another ISR and is recorded with pc 0.
+// xPortInterruptedFromISRContext() cannot tell the two apart, since it is
+// true in any ISR.
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+extern volatile unsigned port_interruptNesting[portNUM_PROCESSORS];
+#define ISR_NESTING() port_interruptNesting[xPortGetCoreID()]
+#else
+extern volatile UBaseType_t port_uxInterruptNesting[portNUM_PROCESSORS];
+#define ISR_NESTING() port_uxInterruptNesting[xPortGetCoreID()]
+#endif
+
+static IRAM_ATTR uintptr_t interrupted_pc(void)
+{
+  if (ISR_NESTING() > 1u) {
+    return 0;
+  }
+  void *const *tcb = (void *const *)xTaskGetCurrentTaskHandle();
+  if (tcb == NULL || *tcb == NULL) {
+    return 0;
+  }
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+  return (uintptr_t)((const XtExcFrame *)*tcb)->pc;
+#else
+  return (uintptr_t)((const RvExcFrame *)*tcb)->mepc;
+#endif
+}
+
+static IRAM_ATTR void profiler_tick(void *arg)
+{
+  (void)arg;
+  if (s_running) {
+    record_sample(interrupted_pc());
+  }
+}
+
+static esp_err_t sampler_start(void)
+{
+  if (s_timer == NULL) {
+    const esp_timer_create_args_t args = {
+        .callback = profiler_tick,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_ISR,
+        .name = "profiler",
+        .skip_unhandled_events = true,
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  return esp_timer_start_periodic(s_timer,
+                                  1000000u / CONFIG_ROBOT_STATS_PROFILER_HZ);
+}
+
+static void sampler_stop(void)
+{
+  if (s_timer != NULL) {
+    (void)esp_timer_stop(s_timer);
+  }
+}
+
+#endif
+
+static uint8_t *put_le(uint8_t *p, uint64_t v, size_t bytes)
+{
+  for (size_t i = 0; i < bytes; i++) {
+    p[i] = (uint8_t)(v >> (8u * i));
+  }
+  return p + bytes;
+}
+
+static void publish_profile(uint32_t samples, uint32_t dropped)
+{
+  const size_t entry_size = sizeof(uintptr_t) + 4u;
+  const size_t per_chunk =
+      (sizeof(s_chunk) - STATS_PROFILE_HEADER_SIZE) / entry_size;
+
+  size_t used = 0;
+  for (size_t i = 0; i < PROFILER_BUCKETS; i++) {
+    if (s_hist[i].count != 0u) {
+      used++;
+    }
+  }
+  size_t chunk_count = used == 0 ? 1 : (used + per_chunk - 1) / per_chunk;
+  if (chunk_count > 0xFFFFu) {
+    chunk_count = 0xFFFFu;
+  }
+
+  uint16_t flags = 0;
+#if CONFIG_IDF_TARGET_LINUX
+  flags |= STATS_PROFILE_FLAG_LINUX;
+#endif
+
+  size_t next = 0;
+  for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+    uint8_t *p = s_chunk + STATS_PROFILE_HEADER_SIZE;
+    size_t entries = 0;
+    while (next < PROFILER_BUCKETS && entries < per_chunk) {
+      const profile_bucket_t *b = &s_hist[next++];
+      if (b->count == 0u) {
+        continue;
+      }
+      p = put_le(p, b->pc, sizeof(uintptr_t));
+      p = put_le(p, b->count, 4);
+      entries++;
+    }
+
+    uint8_t *h = s_chunk;
+    *h++ = 'R';
+    *h++ = 'P';
+    *h++ = STATS_PROFILE_VERSION;
+    *h++ = (uint8_t)sizeof(uintptr_t);
+    h = put_le(h, s_session, 2);
+    h = put_le(h, chunk, 2);
+    h = put_le(h, chunk_count, 2);
+    h = put_le(h, CONFIG_ROBOT_STATS_PROFILER_HZ, 2);
+    h = put_le(h, entries, 2);
+    h = put_le(h, flags, 2);
+    h = put_le(h, samples, 4);
+    h = put_le(h, dropped, 4);
+    (void)put_le(h, (uintptr_t)&stats_profile_start, 8);
+
+    mqtt_publish_binary_telemetry(s_chunk, (size_t)(p - s_chunk));
+  }
+
+  ESP_LOGI(TAG, "profile %u: %u samples, %u dropped, %u PCs in %u chunks",
+           (unsigned)s_session, (unsigned)samples, (unsigned)dropped,
+           (unsigned)used, (unsigned)chunk_count);
+}
+
+esp_err_t profiler_start(uint32_t duration_ms)
+{
+  if (s_running) {
+    sampler_stop();
+    s_running = false;
+  }
+
+  memset(s_hist, 0, sizeof(s_hist));
+  s_samples = 0;
+  s_dropped = 0;
+  s_stop_requested = false;
+  s_session++;
+  s_end_us = esp_timer_get_time() + (int64_t)duration_ms * 1000;
+  s_running = true;
+
+  esp_err_t err = sampler_start();
+  if (err != ESP_OK) {
+    s_running = false;
+    ESP_LOGE(TAG, "Failed to start sampling: %s", esp_err_to_name(err));
+    return err;
+  }
+  ESP_LOGI(TAG, "profile %u: %u ms at %d Hz", (unsigned)s_session,
+           (unsigned)duration_ms, CONFIG_ROBOT_STATS_PROFILER_HZ);
+  return ESP_OK;
+}
+
+void profiler_request_stop(void)
+{
+  s_stop_requested = true;
+}
+
+void profiler_service(void)
+{
+  if (!s_running) {
+    return;
+  }
+  if (!s_stop_requested && esp_timer_get_time() < s_end_us) {
+    return;
+  }
+
+  sampler_stop();
+  s_running = false;
+  // Let a sample that was already in flight finish before reading.
+  while (__atomic_load_n(&s_busy, __ATOMIC_ACQUIRE) != 0) {
+    vTaskDelay(1);
+  }
+  publish_profile(s_samples, s_dropped);
+}
+
+#else
+
+esp_err_t profiler_start(uint32_t duration_ms)
+{
+  (void)duration_ms;
+  ESP_LOGW(TAG, "Profiler not available in this build");
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+void profiler_request_stop(void)
+{
+}
+
+void profiler_service(void)
+{
+}
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../include/stats.h"
+
+// PC sampling profiler behind stats_profile_start(). Publishing happens in
+// profiler_service(), called from the sampler task.
+
+esp_err_t profiler_start(uint32_t duration_ms);
+
+// Request the running profile to end at the next profiler_service().
+void profiler_request_stop(void);
+
+// Stop a profile whose time is up (or that was asked to stop) and publish
+// it. Cheap when idle.
+void profiler_service(void);
@@ -0,0 +1,338 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "mqtt.h"
+
+#include "../include/stats.h"
+#include "latency.h"
+#include "profiler.h"
+
+static const char *TAG = "stats";
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define STATS_HAVE_RUNTIME 1
+#else
+#define STATS_HAVE_RUNTIME 0
+#endif
+
+#define STATS_CORE_UNKNOWN 0xFFu
+
+#define STATS_RECORD_MAX_SIZE                                   \
+  (STATS_RECORD_HEADER_SIZE +                                   \
+   STATS_RECORD_ENTRY_SIZE * (CONFIG_ROBOT_STATS_MAX_TASKS +    \
+                              CONFIG_ROBOT_STATS_MAX_QUEUES))
+
+typedef struct {
+  QueueHandle_t queue;
+  char name[STATS_NAME_LEN];
+  uint16_t capacity;
+  uint16_t waiting;
+  uint16_t peak;
+} watched_queue_t;
+
+#if STATS_HAVE_RUNTIME
+// Run-time counter of each task at the start of the window, matched by
+// xTaskNumber since tasks may come and go between samples.
+typedef struct {
+  UBaseType_t number;
+  uint32_t runtime;
+} task_counter_t;
+
+static TaskStatus_t s_tasks[CONFIG_ROBOT_STATS_MAX_TASKS];
+static task_counter_t s_prev[CONFIG_ROBOT_STATS_MAX_TASKS];
+static UBaseType_t s_prev_count;
+static uint32_t s_prev_total;
+static bool s_have_prev;
+static bool s_tasks_omitted; // last sample had too many tasks; warned once
+#endif
+
+static watched_queue_t s_queues[CONFIG_ROBOT_STATS_MAX_QUEUES > 0 ? CONFIG_ROBOT_STATS_MAX_QUEUES : 1];
+static size_t s_queue_count;
+static portMUX_TYPE s_queue_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t s_record[STATS_RECORD_MAX_SIZE];
+static TaskHandle_t s_task;
+
+static uint8_t *put_u16(uint8_t *p, uint32_t v)
+{
+  if (v > 0xFFFFu) {
+    v = 0xFFFFu;
+  }
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+  return p + 4;
+}
+
+static uint8_t *put_name(uint8_t *p, const char *name)
+{
+  memset(p, 0, STATS_NAME_LEN);
+  if (name != NULL) {
+    size_t len = strnlen(name, STATS_NAME_LEN);
+    memcpy(p, name, len);
+  }
+  return p + STATS_NAME_LEN;
+}
+
+static void sample_queues(void)
+{
+  portENTER_CRITICAL(&s_queue_lock);
+  size_t count = s_queue_count;
+  portEXIT_CRITICAL(&s_queue_lock);
+
+  for (size_t i = 0; i < count; i++) {
+    watched_queue_t *q = &s_queues[i];
+    UBaseType_t waiting = uxQueueMessagesWaiting(q->queue);
+    q->waiting = waiting > 0xFFFFu ? 0xFFFFu : (uint16_t)waiting;
+    if (q->waiting > q->peak) {
+      q->peak = q->waiting;
+    }
+  }
+}
+
+#if STATS_HAVE_RUNTIME
+static uint32_t prev_runtime(UBaseType_t number, bool *found)
+{
+  for (UBaseType_t i = 0; i < s_prev_count; i++) {
+    if (s_prev[i].number == number) {
+      *found = true;
+      return s_prev[i].runtime;
+    }
+  }
+  *found = false;
+  return 0;
+}
+
+// Append task entries to p and roll the snapshot forward. Returns the new
+// write position; *count and *flags are updated.
+static uint8_t *encode_tasks(uint8_t *p, uint8_t *count, uint8_t *flags)
+{
+  uint32_t total = 0;
+  UBaseType_t n = uxTaskGetSystemState(s_tasks,
+                                       CONFIG_ROBOT_STATS_MAX_TASKS,
+                                       &total);
+  if (n == 0) {
+    // The array is too small for the current number of tasks, and
+    // FreeRTOS fills nothing in that case, so no task is reported.
+    if (!s_tasks_omitted) {
+      ESP_LOGW(TAG, "%u tasks exceed CONFIG_ROBOT_STATS_MAX_TASKS (%d); "
+               "task entries omitted",
+               (unsigned)uxTaskGetNumberOfTasks(),
+               CONFIG_ROBOT_STATS_MAX_TASKS);
+      s_tasks_omitted = true;
+    }
+    *flags |= STATS_FLAG_TASKS_OMITTED;
+    s_have_prev = false;
+    return p;
+  }
+  s_tasks_omitted = false;
+
+  // Counters are 32-bit and wrap; unsigned differences stay correct as
+  // long as a window is shorter than one wrap.
+  uint64_t window = (uint64_t)(uint32_t)(total - s_prev_total) *
+                    portNUM_PROCESSORS;
+  if (!s_have_prev || window == 0) {
+    *flags |= STATS_FLAG_FIRST_WINDOW;
+  }
+
+  for (UBaseType_t i = 0; i < n; i++) {
+    const TaskStatus_t *t = &s_tasks[i];
+    uint32_t permille = 0;
+    if (s_have_prev && window != 0) {
+      bool found = false;
+      uint32_t before = prev_runtime(t->xTaskNumber, &found);
+      // A task created during the window ran for all of its counter.
+      uint32_t delta = t->ulRunTimeCounter - (found ? before : 0u);
+      permille = (uint32_t)(((uint64_t)delta * 1000u + window / 2u) / window);
+    }
+
+    uint32_t core = STATS_CORE_UNKNOWN;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+    if (t->xCoreID >= 0 && t->xCoreID < portNUM_PROCESSORS) {
+      core = (uint32_t)t->xCoreID;
+    }
+#endif
+
+    p = put_name(p, t->pcTaskName);
+    p = put_u16(p, permille);
+    p = put_u16(p, t->usStackHighWaterMark);
+    *p++ = t->uxCurrentPriority > 0xFFu ? 0xFFu : (uint8_t)t->uxCurrentPriority;
+    *p++ = (uint8_t)core;
+
+    s_prev[i].number = t->xTaskNumber;
+    s_prev[i].runtime = t->ulRunTimeCounter;
+  }
+
+  *count = (uint8_t)n;
+  s_prev_count = n;
+  s_prev_total = total;
+  s_have_prev = true;
+  return p;
+}
+#endif
+
+static size_t encode_record(uint32_t window_ms)
+{
+  uint8_t *p = s_record + STATS_RECORD_HEADER_SIZE;
+  uint8_t flags = 0;
+  uint8_t task_count = 0;
+
+#if STATS_HAVE_RUNTIME
+  p = encode_tasks(p, &task_count, &flags);
+#else
+  flags |= STATS_FLAG_NO_RUNTIME;
+#endif
+
+  portENTER_CRITICAL(&s_queue_lock);
+  size_t queue_count = s_queue_count;
+  portEXIT_CRITICAL(&s_queue_lock);
+
+  for (size_t i = 0; i < queue_count; i++) {
+    watched_queue_t *q = &s_queues[i];
+    p = put_name(p, q->name);
+    p = put_u16(p, q->waiting);
+    p = put_u16(p, q->peak);
+    p = put_u16(p, q->capacity);
+    q->peak = q->waiting;
+  }
+
+  uint8_t *h = s_record;
+  *h++ = 'R';
+  *h++ = 'S';
+  *h++ = STATS_RECORD_VERSION;
+  *h++ = flags;
+  h = put_u16(h, window_ms);
+  *h++ = task_count;
+  *h++ = (uint8_t)queue_count;
+  h = put_u32(h, (uint32_t)(esp_timer_get_time() / 1000));
+  h = put_u32(h, esp_get_free_heap_size());
+  (void)put_u32(h, esp_get_minimum_free_heap_size());
+
+  return (size_t)(p - s_record);
+}
+
+static void stats_task(void *arg)
+{
+  (void)arg;
+
+  const TickType_t sample_ticks =
+      pdMS_TO_TICKS(CONFIG_ROBOT_STATS_QUEUE_SAMPLE_MS) > 0
+          ? pdMS_TO_TICKS(CONFIG_ROBOT_STATS_QUEUE_SAMPLE_MS)
+          : 1;
+  int64_t window_start_us = esp_timer_get_time();
+  TickType_t last_wake = xTaskGetTickCount();
+
+#if STATS_HAVE_RUNTIME
+  // Take the opening snapshot so the first published record has CPU data.
+  uint8_t first_flags = 0;
+  uint8_t first_count = 0;
+  (void)encode_tasks(s_record + STATS_RECORD_HEADER_SIZE,
+                     &first_count, &first_flags);
+#endif
+
+  for (;;) {
+    vTaskDelayUntil(&last_wake, sample_ticks);
+    sample_queues();
+    profiler_service();
+    latency_service();
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t elapsed_ms = (now_us - window_start_us) / 1000;
+    if (elapsed_ms < CONFIG_ROBOT_STATS_PERIOD_MS) {
+      continue;
+    }
+
+    size_t len = encode_record((uint32_t)elapsed_ms);
+    window_start_us = now_us;
+    mqtt_publish_binary_telemetry(s_record, len);
+  }
+}
+
+esp_err_t stats_init(void)
+{
+  if (s_task != NULL) {
+    return ESP_OK;
+  }
+
+#if !STATS_HAVE_RUNTIME
+  ESP_LOGW(TAG, "FreeRTOS run-time stats disabled; per-task CPU not reported");
+#endif
+
+  if (xTaskCreate(stats_task, "stats",
+                  CONFIG_ROBOT_STATS_TASK_STACK_SIZE, NULL,
+                  CONFIG_ROBOT_STATS_TASK_PRIORITY,
+                  &s_task) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create stats task");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t stats_watch_queue(QueueHandle_t queue, const char *name)
+{
+  if (queue == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  UBaseType_t waiting = uxQueueMessagesWaiting(queue);
+  UBaseType_t capacity = waiting + uxQueueSpacesAvailable(queue);
+
+  esp_err_t err = ESP_OK;
+  portENTER_CRITICAL(&s_queue_lock);
+  if (s_queue_count >= CONFIG_ROBOT_STATS_MAX_QUEUES) {
+    err = ESP_ERR_NO_MEM;
+  } else {
+    watched_queue_t *q = &s_queues[s_queue_count];
+    q->queue = queue;
+    (void)put_name((uint8_t *)q->name, name);
+    q->capacity = capacity > 0xFFFFu ? 0xFFFFu : (uint16_t)capacity;
+    q->waiting = 0;
+    q->peak = 0;
+    s_queue_count++;
+  }
+  portEXIT_CRITICAL(&s_queue_lock);
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Queue '%s' not watched: limit reached", name ? name : "");
+  }
+  return err;
+}
+
+esp_err_t stats_profile_start(uint32_t duration_ms)
+{
+  // The profile is ended and published by the sampler task.
+  if (s_task == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return profiler_start(duration_ms);
+}
+
+void stats_profile_stop(void)
+{
+  profiler_request_stop();
+}
+
+esp_err_t stats_latency_start(uint32_t duration_ms)
+{
+  // The report is published by the sampler task.
+  if (s_task == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return latency_start(duration_ms);
+}
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+"""Symbolise a profile published by stats_profile_start().
+
+Usage: tools/symbolize_profile.py --elf build/app.elf [options] DUMP...
+
+Each DUMP file holds binary telemetry payloads back to back, e.g. from
+`mosquitto_sub -t robot/telemetry/bin -N > dump.bin`. Profile chunks ("RP")
+are collected, and stats records ("RS") are skipped. The most recent
+complete session is used unless --session is given.
+
+Program counters are resolved with addr2line, with inlined frames
+expanded. The result is written in the folded format read by
+flamegraph.pl and speedscope, one line per PC:
+
+    outer_function;inlined_function count
+
+Only the interrupted PC is sampled, so each stack is the inline chain of a
+single PC, not a call stack. A summary of the top functions goes to
+stderr.
+
+Options:
+  --elf PATH        ELF the firmware (or Linux build) was linked from
+  --addr2line CMD   addr2line to use, e.g. xtensa-esp32-elf-addr2line
+                    (default: addr2line); nm is derived from it
+  --session N       profile session to report (default: latest)
+  --top N           functions in the stderr summary (default: 15)
+  -o PATH           write folded output to PATH instead of stdout
+"""
+
+import argparse
+import collections
+import struct
+import subprocess
+import sys
+
+STATS_HEADER = struct.Struct("<2sBBHBBIII")
+STATS_ENTRY_SIZE = 14
+PROFILE_HEADER = struct.Struct("<2sBBHHHHHHIIQ")
+ANCHOR_SYMBOL = "stats_profile_start"
+
+
+class Chunk:
+    def __init__(self, header, entries):
+        (_, self.version, self.pc_size, self.session, self.index, self.count,
+         self.hz, _, self.flags, self.samples, self.dropped,
+         self.anchor) = header
+        self.entries = entries
+
+
+def parse_stream(data):
+    """Yield profile chunks from concatenated telemetry payloads."""
+    pos = 0
+    while pos < len(data):
+        magic = data[pos:pos + 2]
+        if magic == b"RS":
+            if pos + STATS_HEADER.size > len(data):
+                raise ValueError(f"truncated stats record at offset {pos}")
+            fields = STATS_HEADER.unpack_from(data, pos)
+            pos += STATS_HEADER.size + STATS_ENTRY_SIZE * (fields[4] + fields[5])
+        elif magic == b"RP":
+            if pos + PROFILE_HEADER.size > len(data):
+                raise ValueError(f"truncated profile chunk at offset {pos}")
+            header = PROFILE_HEADER.unpack_from(data, pos)
+            pc_size, entry_count = header[2], header[7]
+            if pc_size not in (4, 8):
+                raise ValueError(f"bad pc size {pc_size} at offset {pos}")
+            entry = struct.Struct("<" + ("I" if pc_size == 4 else "Q") + "I")
+            pos += PROFILE_HEADER.size
+            end = pos + entry.size * entry_count
+            if end > len(data):
+                raise ValueError(f"truncated profile chunk at offset {pos}")
+            entries = [entry.unpack_from(data, off)
+                       for off in range(pos, end, entry.size)]
+            pos = end
+            yield Chunk(header, entries)
+        else:
+            raise ValueError(f"unknown record {magic!r} at offset {pos}")
+
+
+def select_session(chunks, session):
+    sessions = collections.OrderedDict()
+    for chunk in chunks:
+        sessions.setdefault(chunk.session, {})[chunk.index] = chunk
+    if not sessions:
+        raise ValueError("no profile chunks found")
+    if session is None:
+        session = next(reversed(sessions))
+    if session not in sessions:
+        raise ValueError(f"session {session} not found "
+                         f"(have {', '.join(map(str, sessions))})")
+    parts = sessions[session]
+    first = next(iter(parts.values()))
+    missing = [i for i in range(first.count) if i not in parts]
+    if missing:
+        print(f"warning: session {session} is missing chunks {missing}",
+              file=sys.stderr)
+    return session, first, [parts[i] for i in sorted(parts)]
+
+
+def symbol_address(nm, elf, name):
+    out = subprocess.run([nm, "--defined-only", elf], check=True,
+                         capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[2] == name:
+            return int(parts[0], 16)
+    raise ValueError(f"{name} not found in {elf}")
+
+
+def resolve(addr2line, elf, pcs):
+    """Map each pc to its inline chain, outermost function first."""
+    if not pcs:
+        return {}
+    proc = subprocess.run(
+        [addr2line, "-a", "-f", "-i", "-C", "-e", elf],
+        input="".join(f"{pc:#x}\n" for pc in pcs),
+        check=True, capture_output=True, text=True)
+    chains = {}
+    lines = proc.stdout.splitlines()
+    i = 0
+    for pc in pcs:
+        # "-a" prints the address, then function/location pairs.
+        i += 1
+        frames = []
+        while i + 1 < len(lines) and not lines[i].startswith("0x"):
+            frames.append(lines[i])
+            i += 2
+        frames = [f for f in frames if f != "??"] or [f"[{pc:#x}]"]
+        chains[pc] = list(reversed(frames))
+    return chains
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.split("\n\n")[0])
+    parser.add_argument("dumps", nargs="+")
+    parser.add_argument("--elf", required=True)
+    parser.add_argument("--addr2line", default="addr2line")
+    parser.add_argument("--session", type=int)
+    parser.add_argument("--top", type=int, default=15)
+    parser.add_argument("-o", dest="output")
+    args = parser.parse_args()
+
+    chunks = []
+    for path in args.dumps:
+        with open(path, "rb") as f:
+            chunks.extend(parse_stream(f.read()))
+    session, first, parts = select_session(chunks, args.session)
+
+    nm = args.addr2line[:-len("addr2line")] + "nm" \
+        if args.addr2line.endswith("addr2line") else "nm"
+    bias = first.anchor - symbol_address(nm, args.elf, ANCHOR_SYMBOL)
+
+    counts = collections.Counter()
+    for chunk in parts:
+        for pc, count in chunk.entries:
+            counts[pc] += count
+
+    known = sorted(pc for pc in counts if pc != 0)
+    chains = resolve(args.addr2line, args.elf, [pc - bias for pc in known])
+
+    folded = collections.Counter()
+    for pc, count in counts.items():
+        frames = chains[pc - bias] if pc != 0 else ["[in interrupt]"]
+        folded[";".join(frames)] += count
+
+    text = "".join(f"{stack} {count}\n" for stack, count in
+                   sorted(folded.items(), key=lambda kv: -kv[1]))
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+    self_counts = collections.Counter()
+    for stack, count in folded.items():
+        self_counts[stack.split(";")[-1]] += count
+    total = sum(counts.values()) or 1
+    print(f"session {session}: {first.samples} samples at {first.hz} Hz, "
+          f"{first.dropped} dropped, {len(counts)} distinct PCs",
+          file=sys.stderr)
+    for name, count in self_counts.most_common(args.top):
+        print(f"{100.0 * count / total:6.2f}% {count:8d}  {name}",
+              file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except (ValueError, OSError, subprocess.CalledProcessError) as e:
+        print(f"error: {e}", file=sys.stderr)
+        sys.exit(1)